@@ -12,38 +12,94 @@
 #include "dbs.h"
 #include <stdint.h>
 #include "allocate.h"
+#include "swapScan.h"
+#include "fftConvolve.h"
+#include "hvsCache.h"
+#include "imageStorage.h"
+#include "levelArena.h"
+#include "checkpoint.h"
+#include "matrixFile.h"
+#include "outputWriter.h"
+#include "sweep.h"
+#include "phaseTrace.h"
+#include "passTelemetry.h"
+#include "swapWindow.h"
+#include "initialDesign.h"
+#include "randomStream.h"
 
 Config* getConfigurations();
 
+static unsigned int getFirstSequenceId(int phase, int checkpointPhase, unsigned int checkpointSeqId, unsigned int lastSeqId);
+
+static void checkpointLevel(Config *config, int phase, unsigned int seqId, unsigned int lastSeqId,
+		struct pxm_img **planes, int planeCount, struct doubleImage **matrices, int matrixCount);
+static struct matrixFile* openLevelMatrixFile(Config *config, char *path, struct doubleImage *matrix);
+static void writeLevelMatrix(struct outputWriter *writer, struct matrixFile *file, struct doubleImage *matrix, char *textPath);
+
 /* The entry point of the code.*/
 int main(int argc, char **argv) {
 
 	time_t blockStart;
 	time_t blockEnd;
 	
-	int randomizationSeed = 0;
 	double maxGrayLevel = 255.0;
 	
 	Config *config = getConfigurations();
+	setHugePageThreshold(config->hugePageThreshold);
+
+	// A sweep runs the initial joint design for every configuration of a list, instead of the screen design.
+	if (argc > 2 && strcmp(argv[1], "--sweep") == 0) {
+		return runConfigurationSweep(config, argv[2]);
+	}
+
+	// The matrices and the halftone snapshots are written by a separate thread, so that the design does not wait for
+	// the disk.
+	struct outputWriter *outputWriter = NULL;
+	if (config->outputQueueCapacity > 0) {
+		outputWriter = createOutputWriter(config->outputQueueCapacity);
+	}
+	setSnapshotWriter(outputWriter);
+
+	if (config->tracePath != NULL) {
+		openTrace(config->tracePath);
+	}
+
+	if (config->telemetryPath != NULL) {
+		openPassTelemetry(config->telemetryPath);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--resume") == 0) {
+		config->resumeFromCheckpoint = 1;
+	}
+
+	// A resumed design takes its planes and matrices from the checkpoint, instead of designing the initial patterns.
+	int isResuming = config->resumeFromCheckpoint && config->checkpointPath != NULL && hasCheckpoint(config->checkpointPath);
 
-	struct doubleImage *psf = generateHvsFunction(config);
-	struct doubleImage *cpp = generateCpp(psf);
+	// Pick the swap scan once, so that every design step runs the same kernel.
+	config->scanKernel = resolveScanKernel(config->scanKernel);
+
+	struct doubleImage *psf;
+	struct doubleImage *cpp;
+	getHvsTables(config, &psf, &cpp);
 
 	struct doubleImage *inputImage = readDoubleImage(config->inputImagePath, maxGrayLevel, config->gamma);
 	struct doubleImage *inputImage2 = readDoubleImage(config->inputImagePath2, maxGrayLevel, config->gamma);
 	//struct doubleImage *inputImage3 = readDoubleImage(config->inputImagePath3, maxGrayLevel, config->gamma);
 
-	struct pxm_img *halftoneCMY = getInitialHalftone(config->initialHalftonePath, inputImage, maxGrayLevel, randomizationSeed);
+	// Transform Cpp once for the whole design, when calculateCpe goes through the FFT.
+	if (chooseConvolutionMethod(config, inputImage, cpp) == DBS_CONVOLUTION_FFT) {
+		prepareKernelSpectrum(cpp, inputImage->height, inputImage->width);
+	}
+
+	// The initial halftone and its split draw from stream 0 of the seed, as the first stream of a portfolio does.
+	struct randomStream random;
+	initRandomStream(&random, config->randomSeed, 0);
+
+	struct pxm_img *halftoneCMY = getInitialHalftone(config->initialHalftonePath, inputImage, maxGrayLevel, &random);
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
-	struct pxm_img *halftoneCM = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-	halftoneCM->height = halftoneCMY->height;
-	halftoneCM->width = halftoneCMY->width;
-	halftoneCM->pxm_type = 'g';
-	halftoneCM->mono = (uint8_t **) get_img(halftoneCM->width, halftoneCM->height, sizeof(uint8_t));
-
 	struct pxm_img *halftoneC = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
 	halftoneC->height = halftoneCMY->height;
 	halftoneC->width = halftoneCMY->width;
@@ -67,37 +123,26 @@ int main(int argc, char **argv) {
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
-	separateCM (halftoneCMY, halftoneCM, halftoneY, 0.66666, 0.33333);
-	separateCM (halftoneCM, halftoneC, halftoneM, 0.5, 0.5);
-
-
-	double test71 =  countNum(halftoneC);
-	double test72 =  countNum(halftoneM);
-	double test73 =  countNum(halftoneY);
-	printf("The halftoneC, M, Y is %f, %f, %f\n ", test71, test72,test73);
-
-	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
-	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
-
-	struct doubleImage *cpeCMY = calculateCpe(inputImage, halftoneCMY, cpp);
-	struct doubleImage *cpeC = calculateCpe(inputImage2, halftoneC, cpp);
-	struct doubleImage *cpeM = calculateCpe(inputImage2, halftoneM, cpp);
-	struct doubleImage *cpeY = calculateCpe(inputImage2, halftoneY, cpp);
-
+	// The cpe planes of the level loops, which take them from the arena.
+	struct doubleImage *cpeC;
+	struct doubleImage *cpeM;
+	struct doubleImage *cpeY;
 
-	for (int i = 0; i<10; i++){
+	if (!isResuming) {
 
-		printf("Iteration %d : Jointly optimize C and Y patterns  \n", i+1);
-		performCompleteDBSForScreenDesign(config,inputImage2,halftoneCMY,cpeCMY,halftoneC,cpeC,halftoneY,cpeY,
-				halftoneCMY,halftoneY, halftoneC, cpp, 1);
+		// The pass records of the initial joint design, coarse levels included, are those of phase 0.
+		setTelemetryLevel(0, 0);
 
-		printf("Iteration %d :Jointly optimize M and Y patterns \n",i+1);
-		performCompleteDBSForScreenDesign(config,inputImage2,halftoneCMY,cpeCMY,halftoneM, cpeM, halftoneY,cpeY,
-				halftoneCMY,halftoneY, halftoneM, cpp, 1);
+		if (config->portfolioSeedCount > 1) {
+			designInitialPortfolio(config, inputImage, inputImage2, cpp, halftoneCMY, halftoneC, halftoneM, halftoneY,
+					NULL);
+		}
+		else {
+			designInitialPatterns(config, inputImage, inputImage2, cpp, &random, halftoneCMY, halftoneC, halftoneM, halftoneY,
+					NULL);
+		}
 
-		printf("Iteration %d :Jointly optimize C and M patterns\n",i+1);
-		performCompleteDBSForScreenDesign(config,inputImage2,halftoneCMY,cpeCMY,halftoneC,cpeC,halftoneM,cpeM,
-				halftoneCMY,halftoneM, halftoneC, cpp, 1);
+		printDesignSwapHistogram(stdout, "the initial joint design");
 	}
 
 	struct pxm_img *htY =  samepattern(halftoneY);
@@ -112,10 +157,36 @@ int main(int argc, char **argv) {
 	struct doubleImage *matrixM = AllocateMatrix(config->MatrixSize);
 	struct doubleImage *matrixY = AllocateMatrix(config->MatrixSize);
 
+	// The live planes and matrices of the design, which the level loops update in place, in checkpoint order.
+	struct pxm_img *checkpointPlanes[7] = { halftoneC, halftoneM, halftoneY, htC, htM, htY, ht2Y };
+	struct doubleImage *checkpointMatrices[3] = { matrixC, matrixM, matrixY };
+
+	int checkpointPhase = 0;
+	unsigned int checkpointSeqId = 0;
+
+	if (isResuming) {
+		readCheckpoint(config->checkpointPath, &checkpointPhase, &checkpointSeqId, checkpointPlanes, 7, checkpointMatrices, 3);
+		printf("Resuming after level %u of design phase %d\n", checkpointSeqId, checkpointPhase);
+	}
+
+	// The binary matrices get the entries assigned by every level, and the text ones are written once at the end.
+	// They start from the matrices restored by a resumed design.
+	struct matrixFile *matrixFileC = openLevelMatrixFile(config, config->outputBinaryMatrixCPath, matrixC);
+	struct matrixFile *matrixFileM = openLevelMatrixFile(config, config->outputBinaryMatrixMPath, matrixM);
+	struct matrixFile *matrixFileY = openLevelMatrixFile(config, config->outputBinaryMatrixYPath, matrixY);
+
+	// The temporaries of a level (copies of the patterns, their differences, C-T images and cpe planes) live in an
+	// arena reset at the start of every level. It starts with room for the 9 images and 6 halftones of a level of the
+	// first design phase, and grows once if the first level needs more.
+	int imageHeight = halftoneCMY->height;
+	int imageWidth = halftoneCMY->width;
+	struct levelArena *levelArena = createLevelArena(9 * (size_t) imageHeight * getImageStride(imageWidth) * sizeof(dbsReal)
+			+ 6 * (size_t) imageHeight * imageWidth);
+
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-	for (unsigned int seqId = 1; seqId <=85; seqId++){
+	for (unsigned int seqId = getFirstSequenceId(1, checkpointPhase, checkpointSeqId, 85); seqId <=85; seqId++){
 
 		fprintf(stdout,"\n***********************************************************************************************************");
 		fprintf(stdout, "\n \t\t\t  MATRIX size %u Processing order: 85->0 (Level %u)", config->MatrixSize, (85 - seqId +1));
@@ -127,15 +198,19 @@ int main(int argc, char **argv) {
 		int level = (int)currentlevel;
 		//double level = (double) (generationSeq - seqId);
 
-		struct pxm_img* beforeC =  samepattern(halftoneC);
-		struct pxm_img* beforeM =  samepattern(halftoneM);
-		struct pxm_img* beforeY =  samepattern(halftoneY);
+		resetLevelArena(levelArena);
+		TRACE_BEGIN(levelScope, TRACE_SCOPE_GLOBAL);
+		setTelemetryLevel(1, level);
+
+		struct pxm_img* beforeC =  samepatternInto(halftoneC, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img* beforeM =  samepatternInto(halftoneM, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img* beforeY =  samepatternInto(halftoneY, createArenaHalftone(levelArena, imageHeight, imageWidth));
 
 		double differ = 85 - currentlevel;
 
-		halftoneC = removeDots(halftoneC, differ, 4, config->MatrixSize, config->MaxLevel,  1);
-		halftoneM = removeDots(halftoneM, differ, 4, config->MatrixSize, config->MaxLevel,  1);
-		halftoneY = removeDots(halftoneY, differ, 4, config->MatrixSize, config->MaxLevel,  1);
+		halftoneC = removeDots(config, halftoneC, differ, 4, config->MatrixSize, config->MaxLevel,  1, cpp);
+		halftoneM = removeDots(config, halftoneM, differ, 4, config->MatrixSize, config->MaxLevel,  1, cpp);
+		halftoneY = removeDots(config, halftoneY, differ, 4, config->MatrixSize, config->MaxLevel,  1, cpp);
 
 		printf("TEST \n");
 		double test325 =  countNum(halftoneC);
@@ -143,43 +218,27 @@ int main(int argc, char **argv) {
 		double test327 =  countNum(halftoneY);
 		printf("C, M ,Y after remove  %f\n ", test325, test326, test327);
 
-		struct doubleImage *inputImageC1 = generateCTImage(halftoneC);
+		struct doubleImage *inputImageC1 = generateCTImageInto(halftoneC, createArenaImage(levelArena, imageHeight, imageWidth));
 
-		cpeC = calculateCpe(inputImageC1, halftoneC, cpp);
-		cpeM = calculateCpe(inputImageC1, halftoneM, cpp);
-		cpeY = calculateCpe(inputImageC1, halftoneY, cpp);
+		cpeC = calculateCpeInto(config, levelArena, inputImageC1, halftoneC, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
+		cpeM = calculateCpeInto(config, levelArena, inputImageC1, halftoneM, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
+		cpeY = calculateCpeInto(config, levelArena, inputImageC1, halftoneY, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
 
 		// Design uniform pattern respectively
 
-		performCompleteDBSForScreenDesign(config, inputImageC1,halftoneC,cpeC,halftoneC,cpeC,
-				halftoneC, cpeC, beforeC,beforeC, beforeC, cpp, 2);
-
-		performCompleteDBSForScreenDesign(config, inputImageC1,halftoneM,cpeM,halftoneM,cpeM,
-				halftoneM, cpeM, beforeM,beforeM, beforeM, cpp, 2);
+		struct screenDesignCall uniformCalls[3] = {
+				{ inputImageC1, halftoneC, cpeC, halftoneC, cpeC, halftoneC, cpeC, beforeC, beforeC, beforeC, cpp, 2, "C" },
+				{ inputImageC1, halftoneM, cpeM, halftoneM, cpeM, halftoneM, cpeM, beforeM, beforeM, beforeM, cpp, 2, "M" },
+				{ inputImageC1, halftoneY, cpeY, halftoneY, cpeY, halftoneY, cpeY, beforeY, beforeY, beforeY, cpp, 2, "Y" } };
 
-		performCompleteDBSForScreenDesign(config, inputImageC1,halftoneY,cpeY,halftoneY,cpeY,
-				halftoneY, cpeY, beforeY,beforeY, beforeY, cpp, 2);
+		performIndependentDBSForScreenDesign(config, uniformCalls, 3);
 
 
 
 
-		struct pxm_img *differC = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differC->height = halftoneC->height;
-		differC->width = halftoneC->width;
-		differC->pxm_type = 'g';
-		differC->mono = (uint8_t **) get_img(differC->width, differC->height, sizeof(uint8_t));
-
-		struct pxm_img *differM = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differM->height = halftoneC->height;
-		differM->width = halftoneC->width;
-		differM->pxm_type = 'g';
-		differM->mono = (uint8_t **) get_img(differM->width, differM->height, sizeof(uint8_t));
-
-		struct pxm_img *differY = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differY->height = halftoneC->height;
-		differY->width = halftoneC->width;
-		differY->pxm_type = 'g';
-		differY->mono = (uint8_t **) get_img(differY->width, differY->height, sizeof(uint8_t));
+		struct pxm_img *differC = createArenaHalftone(levelArena, imageHeight, imageWidth);
+		struct pxm_img *differM = createArenaHalftone(levelArena, imageHeight, imageWidth);
+		struct pxm_img *differY = createArenaHalftone(levelArena, imageHeight, imageWidth);
 
 
 
@@ -187,27 +246,29 @@ int main(int argc, char **argv) {
 		differM = findDifference(halftoneM, beforeM, differM);
 		differY = findDifference(halftoneY, beforeY, differY);
 
-		struct doubleImage *inputImageC2 = generateCTImage(differC);
+		struct doubleImage *inputImageC2 = generateCTImageInto(differC, createArenaImage(levelArena, imageHeight, imageWidth));
 
-		cpeC = calculateCpe(inputImageC2, differC, cpp);
-		cpeM = calculateCpe(inputImageC2, differM, cpp);
-		cpeY = calculateCpe(inputImageC2, differY, cpp);
+		cpeC = calculateCpeInto(config, levelArena, inputImageC2, differC, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
+		cpeM = calculateCpeInto(config, levelArena, inputImageC2, differM, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
+		cpeY = calculateCpeInto(config, levelArena, inputImageC2, differY, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
 
 		// Optimize overall uniform pattern
 
 		for (int i = 0; i<10; i++){
 
 			printf("Iteration %d : Jointly optimize C and Y patterns  \n", i+1);
-
+			setTelemetryColorants("CY");
 			performCompleteDBSForScreenDesign(config,inputImageC2,halftoneC,cpeC,differC,cpeC,differY,cpeY,
 					beforeC,beforeC,beforeC,cpp, 1);
 
 
 			printf("Iteration %d :Jointly optimize M and Y patterns \n",i+1);
+			setTelemetryColorants("MY");
 			performCompleteDBSForScreenDesign(config,inputImageC2,halftoneC,cpeC,differM,cpeM,differY,cpeY,
 					beforeC,beforeC,beforeC,cpp, 1);
 
 			printf("Iteration %d :Jointly optimize C and M patterns\n",i+1);
+			setTelemetryColorants("CM");
 			performCompleteDBSForScreenDesign(config,inputImageC2,halftoneC,cpeC,differC,cpeC,differM,cpeM,
 					beforeC,beforeC,beforeC,cpp, 1);
 		}
@@ -217,41 +278,21 @@ int main(int argc, char **argv) {
 		updateMatrix(halftoneM, matrixM, currentlevel, 1, beforeM);
 		updateMatrix(halftoneY, matrixY, currentlevel, 1, beforeY);
 
-		writeMatrix(matrixC, config->outputMatrixCPath);
-		writeMatrix(matrixM, config->outputMatrixMPath);
-		writeMatrix(matrixY, config->outputMatrixYPath);
+		writeLevelMatrix(outputWriter, matrixFileC, matrixC, config->outputMatrixCPath);
+		writeLevelMatrix(outputWriter, matrixFileM, matrixM, config->outputMatrixMPath);
+		writeLevelMatrix(outputWriter, matrixFileY, matrixY, config->outputMatrixYPath);
 
-
-		//FREE memories
-		multifree((double *)inputImageC1->data,2);
-		free(inputImageC1);
-
-		multifree((double *)inputImageC2->data,2);
-		free(inputImageC2);
-
-		multifree((double *)cpeC->data,2);
-		free(cpeC);
-		multifree((double *)cpeM->data,2);
-		free(cpeM);
-		multifree((double *)cpeY->data,2);
-		free(cpeY);
-
-
-		free_pxm(differC);
-		free_pxm(beforeC);
-
-		free_pxm(differM);
-		free_pxm(beforeM);
-
-		free_pxm(differY);
-		free_pxm(beforeY);
+		TRACE_END(levelScope, "level", "level", level);
+		checkpointLevel(config, 1, seqId, 85, checkpointPlanes, 7, checkpointMatrices, 3);
 	}
 
+	printDesignSwapHistogram(stdout, "levels 85->0");
+
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	// Level by level design from 86->128
 
-	for (unsigned int seqId = 1; seqId <= 43; seqId++){
+	for (unsigned int seqId = getFirstSequenceId(2, checkpointPhase, checkpointSeqId, 43); seqId <= 43; seqId++){
 
 
 		fprintf(stdout,"\n***********************************************************************************************************");
@@ -263,9 +304,13 @@ int main(int argc, char **argv) {
 		double currentlevel = (double) (seqId + 85);
 		int level = (int)currentlevel;
 
-		struct pxm_img *beforeY =  samepattern(htY);
-		struct pxm_img *beforeC =  samepattern(htC);
-		struct pxm_img *beforeM =  samepattern(htM);
+		resetLevelArena(levelArena);
+		TRACE_BEGIN(levelScope, TRACE_SCOPE_GLOBAL);
+		setTelemetryLevel(2, level);
+
+		struct pxm_img *beforeY =  samepatternInto(htY, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img *beforeC =  samepatternInto(htC, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img *beforeM =  samepatternInto(htM, createArenaHalftone(levelArena, imageHeight, imageWidth));
 
 		double differ = 129 - currentlevel;
 
@@ -277,21 +322,18 @@ int main(int argc, char **argv) {
 		printf("Ytwdots is %d\n", Ytwdots );
 
 
-		htY = removeDots(htY, differ, 2, config->MatrixSize,Ytwdots, 2);
+		htY = removeDots(config, htY, differ, 2, config->MatrixSize,Ytwdots, 2, cpp);
 
-		struct doubleImage *inputImageY = generateCTImage(htY);
+		struct doubleImage *inputImageY = generateCTImageInto(htY, createArenaImage(levelArena, imageHeight, imageWidth));
 
-		cpeY = calculateCpe(inputImageY, htY, cpp);
+		cpeY = calculateCpeInto(config, levelArena, inputImageY, htY, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
 
+		setTelemetryColorants("Y");
 		performCompleteDBSForScreenDesign(config, inputImageY,htY,cpeY,htY,cpeY,
 				htY, cpeY, beforeY,beforeY, beforeY, cpp, 2);
 
 
-		struct pxm_img *differY = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differY->height = htY->height;
-		differY->width = htY->width;
-		differY->pxm_type = 'g';
-		differY->mono = (uint8_t **) get_img(differY->width, differY->height, sizeof(uint8_t));
+		struct pxm_img *differY = createArenaHalftone(levelArena, imageHeight, imageWidth);
 
 		differY = findDifference(htY, beforeY, differY);
 
@@ -299,18 +341,6 @@ int main(int argc, char **argv) {
 		printf("The differY is %f\n ", test6);
 
 
-		struct pxm_img *differC = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differC->height = differY->height;
-		differC->width = differY->width;
-		differC->pxm_type = 'g';
-		differC->mono = (uint8_t **) get_img(differC->width, differC->height, sizeof(uint8_t));
-
-		struct pxm_img *differM = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
-		differM->height = differY->height;
-		differM->width = differY->width;
-		differM->pxm_type = 'g';
-		differM->mono = (uint8_t **) get_img(differM->width, differM->height, sizeof(uint8_t));
-
 
 		htC = mergePattern(differY,htC, 0.50);
 		htM = mergePattern(differY,htM, 1);
@@ -320,15 +350,16 @@ int main(int argc, char **argv) {
 		double test28 =  countNum(htM);
 		printf("The htM is %f\n ", test28);
 
-		struct doubleImage *inputImageC = generateCTImage(htC);
+		struct doubleImage *inputImageC = generateCTImageInto(htC, createArenaImage(levelArena, imageHeight, imageWidth));
 
-		cpeC = calculateCpe(inputImageC, htC, cpp);
-		cpeM = calculateCpe(inputImageC, htM, cpp);
+		cpeC = calculateCpeInto(config, levelArena, inputImageC, htC, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
+		cpeM = calculateCpeInto(config, levelArena, inputImageC, htM, cpp, createArenaImage(levelArena, imageHeight, imageWidth));
 
 
 		for (int i = 0; i<5; i++){
 
 			printf("Iteration %d :Jointly optimize C and M patterns\n",i+1);
+			setTelemetryColorants("CM");
 			performCompleteDBSForScreenDesign(config,inputImageC,htY,cpeY,htC,cpeC,htM,cpeM,
 					beforeY, beforeC, beforeM, cpp, 3);
 		}
@@ -337,38 +368,22 @@ int main(int argc, char **argv) {
 		updateMatrix(htC, matrixC, currentlevel, 1, beforeC);
 		updateMatrix(htM, matrixM, currentlevel, 1, beforeM);
 
-		writeMatrix(matrixC, config->outputMatrixCPath);
-		writeMatrix(matrixM, config->outputMatrixMPath);
-
+		writeLevelMatrix(outputWriter, matrixFileC, matrixC, config->outputMatrixCPath);
+		writeLevelMatrix(outputWriter, matrixFileM, matrixM, config->outputMatrixMPath);
 
-		//FREE memories
-		multifree((double *)inputImageY->data,2);
-		free(inputImageY);
-
-		multifree((double *)inputImageC->data,2);
-		free(inputImageC);
-
-		multifree((double *)cpeY->data,2);
-		free(cpeY);
-		multifree((double *)cpeC->data,2);
-		free(cpeC);
-		multifree((double *)cpeM->data,2);
-		free(cpeM);
-
-		free_pxm(differY);
-
-		free_pxm(beforeC);
-		free_pxm(beforeM);
-		free_pxm(beforeY);
+		TRACE_END(levelScope, "level", "level", level);
+		checkpointLevel(config, 2, seqId, 43, checkpointPlanes, 7, checkpointMatrices, 3);
 	}
 
+	printDesignSwapHistogram(stdout, "levels 86->128");
+
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	// Level by level design from 128->255
 	printf("Part 3 of function");
 
 
-	for (unsigned int seqId = 1; seqId <= 170; seqId++){
+	for (unsigned int seqId = getFirstSequenceId(3, checkpointPhase, checkpointSeqId, 170); seqId <= 170; seqId++){
 
 		fprintf(stdout,"\n***********************************************************************************************************");
 		fprintf(stdout, "\n \t\t\t  MATRIX size %u Processing order: 128->255 (Level %u)", config->MatrixSize, (85 + seqId));
@@ -380,95 +395,116 @@ int main(int argc, char **argv) {
 		int level = (int)currentlevel;
 		double differ = currentlevel;
 
-		struct pxm_img* beforeC =  samepattern(htC);
-		struct pxm_img* beforeM =  samepattern(htM);
-		struct pxm_img* beforeY =  samepattern(ht2Y);
+		resetLevelArena(levelArena);
+		TRACE_BEGIN(levelScope, TRACE_SCOPE_GLOBAL);
+		setTelemetryLevel(3, level);
+
+		struct pxm_img* beforeC =  samepatternInto(htC, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img* beforeM =  samepatternInto(htM, createArenaHalftone(levelArena, imageHeight, imageWidth));
+		struct pxm_img* beforeY =  samepatternInto(ht2Y, createArenaHalftone(levelArena, imageHeight, imageWidth));
 
 
 		if (currentlevel<129){
 
-			ht2Y = addDots (ht2Y,differ,2,config->MatrixSize, config->MaxLevel);
+			ht2Y = addDots (config, ht2Y,differ,2,config->MatrixSize, config->MaxLevel, cpp);
 			printf("add dots\n");
 			double count = countNum(ht2Y);
 			printf("Y dots is %f\n", count);
 
 
-			struct doubleImage *inputImageY = generateCTImage(ht2Y);
-			struct doubleImage *cpeY = calculateCpe(inputImageY, ht2Y, cpp);
+			struct doubleImage *inputImageY = generateCTImageInto(ht2Y, createArenaImage(levelArena, imageHeight, imageWidth));
+			struct doubleImage *cpeY = calculateCpeInto(config, levelArena, inputImageY, ht2Y, cpp,
+					createArenaImage(levelArena, imageHeight, imageWidth));
 
+			setTelemetryColorants("Y");
 			performCompleteDBSForScreenDesign(config, inputImage,ht2Y,cpeY,ht2Y,cpeY,
 					ht2Y, cpeY, beforeY,beforeY, beforeY, cpp, 2);
 
 			updateMatrix(ht2Y, matrixY, currentlevel, 1, beforeY);
-			writeMatrix(matrixY, config->outputMatrixYPath);
+			writeLevelMatrix(outputWriter, matrixFileY, matrixY, config->outputMatrixYPath);
 
 
 		}
 		else{
 
 			// C screen
-			htC = addDots (htC,differ,2,config->MatrixSize, config->MaxLevel);
+			htC = addDots (config, htC,differ,2,config->MatrixSize, config->MaxLevel, cpp);
 			printf("add dots\n");
 			double count2 = countNum(htC);
 			printf("C dots is %f\n", count2);
-			struct doubleImage *inputImageC = generateCTImage(htC);
-			struct doubleImage *cpeC = calculateCpe(inputImageC, htC, cpp);
-			performCompleteDBSForScreenDesign(config, inputImage,htC,cpeC,htC,cpeC,htC, cpeC,
-					beforeC,beforeC, beforeC,cpp, 2);
-			updateMatrix(htC, matrixC, currentlevel, 1, beforeC);
-			writeMatrix(matrixC, config->outputMatrixCPath);
+			struct doubleImage *inputImageC = generateCTImageInto(htC, createArenaImage(levelArena, imageHeight, imageWidth));
+			struct doubleImage *cpeC = calculateCpeInto(config, levelArena, inputImageC, htC, cpp,
+					createArenaImage(levelArena, imageHeight, imageWidth));
 
 
 			// M screen
-			htM = addDots (htM,differ,2,config->MatrixSize, config->MaxLevel);
+			htM = addDots (config, htM,differ,2,config->MatrixSize, config->MaxLevel, cpp);
 // 			printf("add dots\n");
 			double count1 = countNum(htM);
 // 			printf("M dots is %f\n", count1);
-			struct doubleImage *inputImageM = generateCTImage(htM);
-			struct doubleImage *cpeM = calculateCpe(inputImageM, htM, cpp);
-			performCompleteDBSForScreenDesign(config, inputImage,htM,cpeM,htM,cpeM,htM, cpeM,
-					beforeM,beforeM, beforeM, cpp, 2);
-			updateMatrix(htM, matrixM, currentlevel, 1, beforeM);
-			writeMatrix(matrixM, config->outputMatrixMPath);
+			struct doubleImage *inputImageM = generateCTImageInto(htM, createArenaImage(levelArena, imageHeight, imageWidth));
+			struct doubleImage *cpeM = calculateCpeInto(config, levelArena, inputImageM, htM, cpp,
+					createArenaImage(levelArena, imageHeight, imageWidth));
 
 			// Y screen
-			ht2Y = addDots (ht2Y,differ,2,config->MatrixSize, config->MaxLevel);
+			ht2Y = addDots (config, ht2Y,differ,2,config->MatrixSize, config->MaxLevel, cpp);
 // 			printf("add dots\n");
 			double count = countNum(ht2Y);
 // 			printf("Y dots is %f\n", count);
-			struct doubleImage *inputImageY = generateCTImage(ht2Y);
-			struct doubleImage *cpeY = calculateCpe(inputImageY, ht2Y, cpp);
-			performCompleteDBSForScreenDesign(config, inputImage,ht2Y,cpeY,ht2Y,cpeY,
-					ht2Y, cpeY, beforeY,beforeY, beforeY, cpp, 2);
-			updateMatrix(ht2Y, matrixY, currentlevel, 1, beforeY);
-			writeMatrix(matrixY, config->outputMatrixYPath);
+			struct doubleImage *inputImageY = generateCTImageInto(ht2Y, createArenaImage(levelArena, imageHeight, imageWidth));
+			struct doubleImage *cpeY = calculateCpeInto(config, levelArena, inputImageY, ht2Y, cpp,
+					createArenaImage(levelArena, imageHeight, imageWidth));
 
+			// The three screens only share the read-only planes, so they are designed together once they are set up.
+			struct screenDesignCall screenCalls[3] = {
+					{ inputImage, htC, cpeC, htC, cpeC, htC, cpeC, beforeC, beforeC, beforeC, cpp, 2, "C" },
+					{ inputImage, htM, cpeM, htM, cpeM, htM, cpeM, beforeM, beforeM, beforeM, cpp, 2, "M" },
+					{ inputImage, ht2Y, cpeY, ht2Y, cpeY, ht2Y, cpeY, beforeY, beforeY, beforeY, cpp, 2, "Y" } };
 
+			performIndependentDBSForScreenDesign(config, screenCalls, 3);
 
-			//FREE memories
-			multifree((double *)inputImageY->data,2);
-			free(inputImageY);
+			updateMatrix(htC, matrixC, currentlevel, 1, beforeC);
+			writeLevelMatrix(outputWriter, matrixFileC, matrixC, config->outputMatrixCPath);
 
-			multifree((double *)inputImageC->data,2);
-			free(inputImageC);
+			updateMatrix(htM, matrixM, currentlevel, 1, beforeM);
+			writeLevelMatrix(outputWriter, matrixFileM, matrixM, config->outputMatrixMPath);
 
-			multifree((double *)inputImageM->data,2);
-			free(inputImageM);
+			updateMatrix(ht2Y, matrixY, currentlevel, 1, beforeY);
+			writeLevelMatrix(outputWriter, matrixFileY, matrixY, config->outputMatrixYPath);
+		}
+
+		TRACE_END(levelScope, "level", "level", level);
+		checkpointLevel(config, 3, seqId, 170, checkpointPlanes, 7, checkpointMatrices, 3);
+	}
+
+	printDesignSwapHistogram(stdout, "levels 128->255");
 
-			multifree((double *)cpeY->data,2);
-			free(cpeY);
-			multifree((double *)cpeC->data,2);
-			free(cpeC);
-			multifree((double *)cpeM->data,2);
-			free(cpeM);
+	printf("Level arena peak usage: %zu bytes\n", getLevelArenaPeakUsage(levelArena));
+	deallocateLevelArena(levelArena);
 
-			free_pxm(beforeC);
-			free_pxm(beforeM);
-			free_pxm(beforeY);
+	// The binary matrices are complete once the writer is done with them.
+	int outputFailureCount = 0;
+	if (outputWriter != NULL) {
+		setSnapshotWriter(NULL);
+		outputFailureCount = destroyOutputWriter(outputWriter);
+	}
 
+	struct matrixFile *matrixFiles[3] = { matrixFileC, matrixFileM, matrixFileY };
+	char *outputMatrixPaths[3] = { config->outputMatrixCPath, config->outputMatrixMPath, config->outputMatrixYPath };
 
+	for (int k = 0; k < 3; k++) {
+		if (matrixFiles[k] != NULL) {
+			outputFailureCount += writeMatrix(checkpointMatrices[k], outputMatrixPaths[k]) != 0;
+			closeMatrixFile(matrixFiles[k]);
 		}
 	}
+
+	if (outputFailureCount > 0) {
+		fprintf(stderr, "%d outputs of the design could not be written\n", outputFailureCount);
+	}
+
+	closeTrace();
+	closePassTelemetry();
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -484,13 +520,12 @@ int main(int argc, char **argv) {
 	deallocateShiftedImage(cpp);
 	deallocateShiftedImage(psf);
 
-	fflush(stdout);
-	return(0);
-
-
 	printf("******************************************************************************\n ");
 	printf("Jointly level-by-level design C and M screens--Done! \n ");
 	printf("******************************************************************************\n ");
+
+	fflush(stdout);
+	return outputFailureCount > 0 ? -1 : 0;
 }
 
 
@@ -511,9 +546,14 @@ Config* getConfigurations() {
 	config->outputMatrixMPath ="../out/128MMatrix.txt";
 	config->outputMatrixYPath ="../out/128YMatrix.txt";
 
+	config->outputBinaryMatrixCPath ="../out/128CMatrix.bin";
+	config->outputBinaryMatrixMPath ="../out/128MMatrix.bin";
+	config->outputBinaryMatrixYPath ="../out/128YMatrix.bin";
+
 
 	config->scaleFactor = 3500;
 	config->hvsSpreadSize = 23;
+	config->hvsCacheDirectory = "../out";
 
 	config->enableToggle = 0;
 	config->enableSwap = 1;
@@ -527,20 +567,86 @@ Config* getConfigurations() {
 	config->maxIterationCount = 200;
 	config->minAcceptableChangeCount = 5;
 
+	config->blockOrder = DBS_BLOCK_ORDER_RASTER;
+	config->threadCount = 0;
+	config->scanKernel = DBS_SCAN_KERNEL_AUTO;
+	config->haloMode = DBS_HALO_AUTO;
+	config->convolutionMethod = DBS_CONVOLUTION_AUTO;
+	config->fftCheckSampleCount = 16;
+	config->errorCheckInterval = 10;
+	config->precisionComparison = 0;
+	config->candidateIndexMode = DBS_CANDIDATE_INDEX_AUTO;
+	config->swapCacheMode = DBS_SWAP_CACHE_AUTO;
+	config->swapWindowPercentile = 0.0;
+	config->coarseDesignFactor = 1;
+	config->dotSelectionMode = DBS_DOT_SELECTION_RASTER;
+	config->randomSeed = 0;
+	config->portfolioSeedCount = 1;
+	config->enableConcurrentColorants = 1;
+	config->outputQueueCapacity = 8;
+	config->hugePageThreshold = DBS_HUGE_PAGE_SIZE;
+	config->checkpointPath = "../out/design.ckpt";
+	config->checkpointInterval = 1;
+	config->resumeFromCheckpoint = 0;
+	config->tracePath = NULL;
+	config->telemetryPath = NULL;
+
 	config->enableVerboseDebugging = 0;
 	return config;
 }
 
-// De-allocates a matrix whose 0-index in the center. This currently is used for the human visual 
-// system, and its autocorrelation.
-void deallocateShiftedImage(struct doubleImage *image) {
+// Returns the first level of a design phase that is left to run, after the last level held by the checkpoint (phase 0
+// when starting over).
+static unsigned int getFirstSequenceId(int phase, int checkpointPhase, unsigned int checkpointSeqId, unsigned int lastSeqId) {
+
+	if (phase < checkpointPhase) {
+		return lastSeqId + 1;
+	}
+
+	return phase == checkpointPhase ? checkpointSeqId + 1 : 1;
+}
+
+// Writes the checkpoint of a finished level, every checkpointInterval levels and at the end of its design phase.
+static void checkpointLevel(Config *config, int phase, unsigned int seqId, unsigned int lastSeqId,
+		struct pxm_img **planes, int planeCount, struct doubleImage **matrices, int matrixCount) {
+
+	if (config->checkpointPath == NULL || config->checkpointInterval < 1) {
+		return;
+	}
+
+	if (seqId % config->checkpointInterval == 0 || seqId == lastSeqId) {
+		writeCheckpoint(config->checkpointPath, phase, seqId, planes, planeCount, matrices, matrixCount);
+	}
+}
+
+// Creates the binary file of a matrix, or returns NULL if it has no path.
+static struct matrixFile* openLevelMatrixFile(Config *config, char *path, struct doubleImage *matrix) {
+
+	if (path == NULL) {
+		return NULL;
+	}
+
+	return createMatrixFile(path, matrix, config->MaxLevel);
+}
+
+// Saves a matrix after a level: the changed entries of its binary file, or the whole text file without one. The writer,
+// if any, writes them later.
+static void writeLevelMatrix(struct outputWriter *writer, struct matrixFile *file, struct doubleImage *matrix, char *textPath) {
+
+	TRACE_START(outputStart);
 
-	// Deoffset the image, so that it can be freed.
-	for (int i = -image->borderSize; i <= image->borderSize; i++) {
-		image->data[i] -= image->borderSize;
+	if (writer != NULL && file != NULL) {
+		queueMatrixChanges(writer, file, matrix);
+	}
+	else if (writer != NULL) {
+		queueMatrixText(writer, matrix, textPath);
+	}
+	else if (file != NULL) {
+		syncMatrixFile(file, matrix);
+	}
+	else {
+		writeMatrix(matrix, textPath);
 	}
-	image->data -= image->borderSize;
 
-	multifree((double*) image->data, 2);
-	free(image);
+	TRACE_PHASE(TRACE_PHASE_MATRIX_OUTPUT, outputStart);
 }
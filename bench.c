@@ -0,0 +1,687 @@
+/******************************************************************
+* file: bench.c
+* Implementing: Microbenchmarks of the DBS kernels
+* Every benchmark runs on synthetic halftones drawn from a fixed seed, so that two builds time the same work. The
+* results are printed as tab separated lines (one per benchmark, kernel, size and density), to be compared with diff
+* or loaded by a spreadsheet.
+*
+* With -c, the design entry points are checked instead, and the run fails if one of the checks does.
+*
+* usage: bench [-c] [-s sizes] [-d densities] [-f filter] [-n sampleCount] [-t sampleMilliseconds]
+* e.g.   bench -s 64,128 -d 0.1,0.5 -f swap
+*******************************************************************/
+
+#include <unistd.h>
+
+#include "dbs.h"
+#include "allocate.h"
+#include "swapScan.h"
+#include "imageStorage.h"
+
+#define BENCH_MAX_SIZE_COUNT 16
+#define BENCH_MAX_SAMPLE_COUNT 101
+
+// The options of a benchmark run.
+struct benchOptions
+{
+	int sizes[BENCH_MAX_SIZE_COUNT];
+	int sizeCount;
+	double densities[BENCH_MAX_SIZE_COUNT];
+	int densityCount;
+	char *filter;
+	int sampleCount;
+	double sampleSeconds;
+	int runChecks;
+};
+
+// The planes of a benchmark: two halftones of the given density, with their cpe, and copies of them with about one
+// pixel in nine flipped, standing for the patterns of the previous level.
+struct benchPlanes
+{
+	int size;
+	double density;
+
+	struct doubleImage *inputImage;
+	struct pxm_img *halftoneC;
+	struct pxm_img *halftoneM;
+	struct pxm_img *beforeC;
+	struct pxm_img *beforeM;
+	struct doubleImage *cpeC;
+	struct doubleImage *cpeM;
+};
+
+// A benchmark: body(context, count) makes count calls of the kernel, and returns a value that depends on all of them.
+typedef double (*benchBody)(void *context, long count);
+
+// Keeps the results of the benchmarks alive.
+static volatile double benchSink;
+
+static uint64_t benchState;
+
+// xorshift64*, rather than rand(), so that the planes are the same with every C library.
+static double getBenchRandom() {
+
+	benchState ^= benchState >> 12;
+	benchState ^= benchState << 25;
+	benchState ^= benchState >> 27;
+
+	return (double) ((benchState * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static double getSeconds() {
+
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void *first, const void *second) {
+
+	double a = *(const double *) first;
+	double b = *(const double *) second;
+
+	return (a > b) - (a < b);
+}
+
+// Times body, and prints its line. The call count of a sample grows until it lasts sampleSeconds, and the median and
+// fastest of sampleCount samples are reported, per operation (a call performs operationsPerCall of them).
+// bytesPerOperation estimates the memory traffic of an operation, for the GB/s column (0 leaves it out).
+static void runBenchmark(struct benchOptions *options, char *name, char *kernel, int size, double density,
+		char *operation, double operationsPerCall, double bytesPerOperation, benchBody body, void *context) {
+
+	if (options->filter != NULL && strstr(name, options->filter) == NULL) {
+		return;
+	}
+
+	long count = 1;
+	for (;;) {
+		double start = getSeconds();
+		benchSink += body(context, count);
+		double seconds = getSeconds() - start;
+
+		if (seconds >= options->sampleSeconds || count >= (1L << 40)) {
+			break;
+		}
+
+		count = seconds > 0.0 ? (long) (count * MIN(1.2 * options->sampleSeconds / seconds, 100.0)) + 1 : count * 100;
+	}
+
+	double samples[BENCH_MAX_SAMPLE_COUNT];
+	for (int k = 0; k < options->sampleCount; k++) {
+		double start = getSeconds();
+		benchSink += body(context, count);
+		samples[k] = (getSeconds() - start) * 1e9 / (count * operationsPerCall);
+	}
+
+	qsort(samples, options->sampleCount, sizeof(double), compareDoubles);
+	double median = samples[options->sampleCount / 2];
+
+	char densityText[32] = "-";
+	if (density >= 0.0) {
+		sprintf(densityText, "%.3f", density);
+	}
+
+	char throughputText[32] = "-";
+	if (bytesPerOperation > 0.0) {
+		sprintf(throughputText, "%.3f", bytesPerOperation / median);
+	}
+
+	printf("%s\t%s\t%d\t%s\t%s\t%.0f\t%.3f\t%.3f\t%s\n", name, kernel, size, densityText, operation,
+			count * operationsPerCall, median, samples[0], throughputText);
+	fflush(stdout);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Planes
+
+static struct pxm_img* createBenchHalftone(int size) {
+
+	struct pxm_img *halftone = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
+	halftone->height = size;
+	halftone->width = size;
+	halftone->pxm_type = 'g';
+	halftone->mono = (uint8_t **) get_img(size, size, sizeof(uint8_t));
+
+	return halftone;
+}
+
+static struct benchPlanes* createBenchPlanes(struct Config *config, struct doubleImage *cpp, int size, double density) {
+
+	struct benchPlanes *planes = (struct benchPlanes *) malloc(sizeof(struct benchPlanes));
+	planes->size = size;
+	planes->density = density;
+
+	// The seed depends on the size and density only, so that every build draws the same planes.
+	benchState = 0x9E3779B97F4A7C15ULL ^ ((uint64_t) size << 32) ^ (uint64_t) (density * 1000000.0);
+
+	planes->inputImage = createImage(size, size, 0, 0);
+	planes->halftoneC = createBenchHalftone(size);
+	planes->halftoneM = createBenchHalftone(size);
+	planes->beforeC = createBenchHalftone(size);
+	planes->beforeM = createBenchHalftone(size);
+
+	for (int i = 0; i < size; i++) {
+		for (int j = 0; j < size; j++) {
+
+			planes->inputImage->data[i][j] = density;
+
+			// The C and M dots never overlap, as after separateCM.
+			double value = getBenchRandom();
+			planes->halftoneC->mono[i][j] = value < density / 2;
+			planes->halftoneM->mono[i][j] = value >= density / 2 && value < density;
+
+			planes->beforeC->mono[i][j] = planes->halftoneC->mono[i][j] ^ (getBenchRandom() < 1.0 / 9.0);
+			planes->beforeM->mono[i][j] = planes->halftoneM->mono[i][j] ^ (getBenchRandom() < 1.0 / 9.0);
+		}
+	}
+
+	planes->cpeC = calculateCpe(config, planes->inputImage, planes->halftoneC, cpp);
+	planes->cpeM = calculateCpe(config, planes->inputImage, planes->halftoneM, cpp);
+
+	return planes;
+}
+
+static void deallocateBenchPlanes(struct benchPlanes *planes) {
+
+	deallocateImage(planes->inputImage);
+	deallocateImage(planes->cpeC);
+	deallocateImage(planes->cpeM);
+
+	struct pxm_img *halftones[4] = { planes->halftoneC, planes->halftoneM, planes->beforeC, planes->beforeM };
+	for (int k = 0; k < 4; k++) {
+		free_pxm(halftones[k]);
+		free(halftones[k]);
+	}
+
+	free(planes);
+}
+
+static void copyImage(struct doubleImage *source, struct doubleImage *target) {
+
+	for (int i = 0; i < source->height; i++) {
+		memcpy(target->data[i], source->data[i], source->width * sizeof(dbsReal));
+	}
+}
+
+static void copyHalftone(struct pxm_img *source, struct pxm_img *target) {
+
+	for (int i = 0; i < source->height; i++) {
+		memcpy(target->mono[i], source->mono[i], source->width);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Bodies
+
+struct kernelContext
+{
+	struct Config *config;
+	struct benchPlanes *planes;
+	struct doubleImage *cpp;
+	uint8_t **blockStatusMatrix;
+
+	// The precomputed operands of getSwapDeltaError and updateCpe.
+	int *rowIndices;
+	int *columnIndices;
+	int *targetRowIndices;
+	int *targetColumnIndices;
+	int operandCount;
+};
+
+#define BENCH_OPERAND_COUNT 4096
+
+static double runSwapDeltaError(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	double sum = 0.0;
+
+	for (long k = 0; k < count; k++) {
+
+		int index = (int) (k % context->operandCount);
+		int i = context->rowIndices[index];
+		int j = context->columnIndices[index];
+		int targetI = context->targetRowIndices[index];
+		int targetJ = context->targetColumnIndices[index];
+
+		sum += getSwapDeltaError(planes->halftoneC, planes->cpeC, context->cpp, i, j,
+				MOD(targetI, planes->size), MOD(targetJ, planes->size), abs(targetI - i), abs(targetJ - j));
+	}
+
+	return sum;
+}
+
+static double runSwapRegion1(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	double sum = 0.0;
+	int targetI, targetJ;
+
+	for (long k = 0; k < count; k++) {
+		int index = (int) (k % context->operandCount);
+		sum += getSwapDeltaErrorInRegion_1(context->config, planes->halftoneC, planes->cpeC, planes->halftoneM, planes->cpeM,
+				context->cpp, context->rowIndices[index], context->columnIndices[index], &targetI, &targetJ);
+	}
+
+	return sum;
+}
+
+static double runSwapRegion2(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	double sum = 0.0;
+	int targetI, targetJ;
+
+	for (long k = 0; k < count; k++) {
+		int index = (int) (k % context->operandCount);
+		sum += getSwapDeltaErrorInRegion_2(context->config, planes->halftoneC, planes->cpeC, context->cpp,
+				context->rowIndices[index], context->columnIndices[index], &targetI, &targetJ);
+	}
+
+	return sum;
+}
+
+static double runSwapRegion3(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	double sum = 0.0;
+	int targetI, targetJ;
+
+	for (long k = 0; k < count; k++) {
+		int index = (int) (k % context->operandCount);
+		sum += getSwapDeltaErrorInRegion_3(context->config, planes->halftoneC, planes->cpeC, planes->halftoneM, planes->cpeM,
+				context->cpp, context->rowIndices[index], context->columnIndices[index], &targetI, &targetJ,
+				planes->beforeC, planes->beforeM);
+	}
+
+	return sum;
+}
+
+// Alternates the sign of the updates, so that cpe keeps its values however many are run.
+static double runUpdateCpe(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+
+	for (long k = 0; k < count; k++) {
+		int index = (int) ((k / 2) % context->operandCount);
+		updateCpe(context->config, planes->cpeC, context->cpp, context->blockStatusMatrix, (k & 1) ? -1.0 : 1.0,
+				context->rowIndices[index], context->columnIndices[index]);
+	}
+
+	return planes->cpeC->data[0][0];
+}
+
+static double runConvolve(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	double sum = 0.0;
+
+	for (long k = 0; k < count; k++) {
+		struct doubleImage *result = convolve(context->planes->inputImage, context->cpp);
+		sum += result->data[0][0];
+		deallocateImage(result);
+	}
+
+	return sum;
+}
+
+static double runRmsError(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	double sum = 0.0;
+
+	for (long k = 0; k < count; k++) {
+		sum += calculateRmsError(planes->inputImage, planes->halftoneC, planes->cpeC, context->cpp);
+	}
+
+	return sum;
+}
+
+// Every pass starts from the same planes. Restoring them is part of the time, but small next to the pass.
+static double runSinglePass(void *argument, long count) {
+
+	struct kernelContext *context = (struct kernelContext *) argument;
+	struct benchPlanes *planes = context->planes;
+	int size = planes->size;
+	int changeCount = 0;
+
+	struct pxm_img *halftone = createBenchHalftone(size);
+	struct doubleImage *cpe = createImage(size, size, 0, 0);
+
+	for (long k = 0; k < count; k++) {
+
+		copyHalftone(planes->halftoneC, halftone);
+		copyImage(planes->cpeC, cpe);
+		for (int i = 0; i < size; i++) {
+			memset(context->blockStatusMatrix[i], 1, size);
+		}
+
+		changeCount += runSinglePassDBS(context->config, planes->inputImage, halftone, cpe, halftone, cpe, halftone, cpe,
+				planes->beforeC, planes->beforeC, planes->beforeC, context->cpp, context->blockStatusMatrix, 2);
+	}
+
+	free_pxm(halftone);
+	free(halftone);
+	deallocateImage(cpe);
+
+	return changeCount;
+}
+
+static double runGenerateCpp(void *argument, long count) {
+
+	struct doubleImage *psf = (struct doubleImage *) argument;
+	double sum = 0.0;
+
+	for (long k = 0; k < count; k++) {
+		struct doubleImage *cpp = generateCpp(psf);
+		sum += cpp->data[0][0];
+		deallocateImage(cpp);
+	}
+
+	return sum;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Checks
+
+// Prints the line of a check, and returns whether it passed.
+static int reportCheck(char *name, int passed) {
+
+	printf("check\t%s\t%s\n", name, passed ? "ok" : "FAILED");
+	fflush(stdout);
+
+	return passed;
+}
+
+// A pass of runSinglePassDBS with the swap window of config accepts swaps, and lowers the error.
+static int checkSinglePassSwaps(struct Config *config, struct doubleImage *cpp) {
+
+	int size = 64;
+	struct benchPlanes *planes = createBenchPlanes(config, cpp, size, 0.25);
+	uint8_t **blockStatusMatrix = (uint8_t **) get_img(size, size, sizeof(uint8_t));
+
+	for (int i = 0; i < size; i++) {
+		memset(blockStatusMatrix[i], 1, size);
+	}
+
+	double error = calculateTotalError(planes->inputImage, planes->halftoneC, planes->cpeC);
+	int changeCount = runSinglePassDBS(config, planes->inputImage, planes->halftoneC, planes->cpeC, planes->halftoneC,
+			planes->cpeC, planes->halftoneC, planes->cpeC, planes->beforeC, planes->beforeC, planes->beforeC, cpp,
+			blockStatusMatrix, 2);
+	double passError = calculateTotalError(planes->inputImage, planes->halftoneC, planes->cpeC);
+
+	free_img((void **) blockStatusMatrix);
+	deallocateBenchPlanes(planes);
+
+	return reportCheck("runSinglePassDBS swaps", changeCount > 0 && passError < error);
+}
+
+// A step 2 pass on CMY planes other than the C ones, or sharing only the halftone with them, reports the error of
+// the C planes, with no full computation between the swaps to correct the tracked error.
+static int checkTrackedSwapError(struct Config *config, struct doubleImage *cpp, int isHalftoneShared) {
+
+	int size = 64;
+	struct benchPlanes *planes = createBenchPlanes(config, cpp, size, 0.25);
+	uint8_t **blockStatusMatrix = (uint8_t **) get_img(size, size, sizeof(uint8_t));
+
+	struct pxm_img *halftoneCMY = planes->halftoneC;
+	if (!isHalftoneShared) {
+		halftoneCMY = createBenchHalftone(size);
+		for (int i = 0; i < size; i++) {
+			memcpy(halftoneCMY->mono[i], planes->halftoneC->mono[i], size);
+		}
+	}
+	struct doubleImage *cpeCMY = calculateCpe(config, planes->inputImage, halftoneCMY, cpp);
+
+	for (int i = 0; i < size; i++) {
+		memset(blockStatusMatrix[i], 1, size);
+	}
+
+	struct Config passConfig = *config;
+	passConfig.errorCheckInterval = 0;
+
+	// The pass prints the RMS error it tracks.
+	char *output = NULL;
+	size_t outputSize = 0;
+	FILE *previousOutput = getDesignOutput();
+	setDesignOutput(open_memstream(&output, &outputSize));
+
+	int changeCount = runSinglePassDBS(&passConfig, planes->inputImage, halftoneCMY, cpeCMY, planes->halftoneC,
+			planes->cpeC, planes->halftoneM, planes->cpeM, planes->beforeC, planes->beforeC, planes->beforeM, cpp,
+			blockStatusMatrix, 2);
+
+	fclose(getDesignOutput());
+	setDesignOutput(previousOutput);
+
+	double trackedRmsError = -1.0;
+	char *line = strstr(output, "RMS Error = ");
+	if (line != NULL) {
+		trackedRmsError = atof(line + strlen("RMS Error = "));
+	}
+	double rmsError = sqrt(calculateTotalError(planes->inputImage, planes->halftoneC, planes->cpeC) / (size * size));
+
+	free(output);
+	deallocateImage(cpeCMY);
+	if (!isHalftoneShared) {
+		free_pxm(halftoneCMY);
+		free(halftoneCMY);
+	}
+	free_img((void **) blockStatusMatrix);
+	deallocateBenchPlanes(planes);
+
+	// The pass prints the error with 6 decimals.
+	return reportCheck(isHalftoneShared ? "step 2 tracked error, shared halftone" : "step 2 tracked error, separate planes",
+			changeCount > 0 && fabs(trackedRmsError - rmsError) < 1e-6);
+}
+
+// Runs the checks, and returns the number of failed ones.
+static int runChecks(struct Config *config, struct doubleImage *cpp) {
+
+	int failureCount = 0;
+
+	failureCount += !checkSinglePassSwaps(config, cpp);
+	failureCount += !checkTrackedSwapError(config, cpp, 0);
+	failureCount += !checkTrackedSwapError(config, cpp, 1);
+
+	return failureCount;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static char* getScanKernelName(int kernel) {
+
+	switch (kernel) {
+	case DBS_SCAN_KERNEL_AVX2: return "avx2";
+	case DBS_SCAN_KERNEL_AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
+
+static void parseIntegerList(char *text, int *values, int *count) {
+
+	*count = 0;
+	for (char *token = strtok(text, ","); token != NULL && *count < BENCH_MAX_SIZE_COUNT; token = strtok(NULL, ",")) {
+		values[(*count)++] = atoi(token);
+	}
+}
+
+static void parseRealList(char *text, double *values, int *count) {
+
+	*count = 0;
+	for (char *token = strtok(text, ","); token != NULL && *count < BENCH_MAX_SIZE_COUNT; token = strtok(NULL, ",")) {
+		values[(*count)++] = atof(token);
+	}
+}
+
+// The settings of app.c that the kernels depend on, with the typical swap size.
+static void getBenchConfiguration(struct Config *config) {
+
+	memset(config, 0, sizeof(struct Config));
+
+	config->scaleFactor = 3500;
+	config->hvsSpreadSize = 23;
+	config->enableToggle = 0;
+	config->enableSwap = 1;
+	config->gamma = 1.0;
+	config->blockHeight = 1;
+	config->blockWidth = 1;
+	config->swapSize = 41;
+	config->maxIterationCount = 1;
+	config->minAcceptableChangeCount = 0;
+	config->blockOrder = DBS_BLOCK_ORDER_RASTER;
+	config->threadCount = 1;
+	config->scanKernel = DBS_SCAN_KERNEL_SCALAR;
+	config->haloMode = DBS_HALO_OFF;
+	config->convolutionMethod = DBS_CONVOLUTION_DIRECT;
+	config->errorCheckInterval = 0;
+	config->candidateIndexMode = DBS_CANDIDATE_INDEX_OFF;
+	config->swapCacheMode = DBS_SWAP_CACHE_OFF;
+}
+
+int main(int argc, char **argv) {
+
+	struct benchOptions options = { { 64, 128, 256, 512 }, 4, { 0.05, 0.25, 0.5 }, 3, NULL, 5, 0.05, 0 };
+
+	int option;
+	while ((option = getopt(argc, argv, "cs:d:f:n:t:")) != -1) {
+		switch (option) {
+		case 'c': options.runChecks = 1; break;
+		case 's': parseIntegerList(optarg, options.sizes, &options.sizeCount); break;
+		case 'd': parseRealList(optarg, options.densities, &options.densityCount); break;
+		case 'f': options.filter = optarg; break;
+		case 'n': options.sampleCount = MAX(1, MIN(atoi(optarg), BENCH_MAX_SAMPLE_COUNT)); break;
+		case 't': options.sampleSeconds = atof(optarg) / 1000.0; break;
+		default:
+			fprintf(stderr, "usage: %s [-c] [-s sizes] [-d densities] [-f filter] [-n sampleCount] [-t sampleMilliseconds]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	struct Config config;
+	getBenchConfiguration(&config);
+
+	struct doubleImage *psf = generateHvsFunction(&config);
+	struct doubleImage *cpp = generateCpp(psf);
+
+	// The passes report themselves, which is not part of the results.
+	FILE *designOutput = fopen("/dev/null", "w");
+	setDesignOutput(designOutput);
+
+	if (options.runChecks) {
+		int failureCount = runChecks(&config, cpp);
+
+		setDesignOutput(NULL);
+		fclose(designOutput);
+		deallocateImage(cpp);
+		deallocateImage(psf);
+
+		return failureCount > 0 ? -1 : 0;
+	}
+
+	// Every kernel this processor can run.
+	int scanKernels[3] = { DBS_SCAN_KERNEL_SCALAR };
+	int scanKernelCount = 1;
+
+	if (resolveScanKernel(DBS_SCAN_KERNEL_AVX2) == DBS_SCAN_KERNEL_AVX2) {
+		scanKernels[scanKernelCount++] = DBS_SCAN_KERNEL_AVX2;
+	}
+
+	if (resolveScanKernel(DBS_SCAN_KERNEL_AUTO) == DBS_SCAN_KERNEL_AVX512) {
+		scanKernels[scanKernelCount++] = DBS_SCAN_KERNEL_AVX512;
+	}
+
+	printf("# dbs kernel benchmarks: %d samples of at least %.0f ms, dbsReal %s, swapSize %d, hvsSpreadSize %d, Cpp %d x %d\n",
+			options.sampleCount, options.sampleSeconds * 1000.0, sizeof(dbsReal) == sizeof(float) ? "float" : "double",
+			config.swapSize, config.hvsSpreadSize, 2 * cpp->borderSize + 1, 2 * cpp->borderSize + 1);
+	printf("benchmark\tkernel\tsize\tdensity\toperation\toperations\tns_per_operation\tns_per_operation_min\tgb_per_second\n");
+
+	int cppSize = 2 * cpp->borderSize + 1;
+	int cppTapCount = cppSize * cppSize;
+	runBenchmark(&options, "generateCpp", "-", cppSize, -1.0, "entry", cppTapCount, 0.0, runGenerateCpp, psf);
+
+	for (int s = 0; s < options.sizeCount; s++) {
+
+		int size = options.sizes[s];
+
+		int firstIndex, lastIndex;
+		getSwapWindowRange(&config, 0, size, &firstIndex, &lastIndex);
+		int window = lastIndex - firstIndex + 1;
+		long candidateCount = (long) window * window;
+
+		uint8_t **blockStatusMatrix = (uint8_t **) get_img(size, size, sizeof(uint8_t));
+
+		for (int d = 0; d < options.densityCount; d++) {
+
+			double density = options.densities[d];
+			struct benchPlanes *planes = createBenchPlanes(&config, cpp, size, density);
+
+			struct kernelContext context = { .config = &config, .planes = planes, .cpp = cpp,
+					.blockStatusMatrix = blockStatusMatrix, .operandCount = BENCH_OPERAND_COUNT };
+			context.rowIndices = (int *) malloc(4 * BENCH_OPERAND_COUNT * sizeof(int));
+			context.columnIndices = context.rowIndices + BENCH_OPERAND_COUNT;
+			context.targetRowIndices = context.columnIndices + BENCH_OPERAND_COUNT;
+			context.targetColumnIndices = context.targetRowIndices + BENCH_OPERAND_COUNT;
+
+			for (int k = 0; k < BENCH_OPERAND_COUNT; k++) {
+				context.rowIndices[k] = (int) (getBenchRandom() * size);
+				context.columnIndices[k] = (int) (getBenchRandom() * size);
+				context.targetRowIndices[k] = context.rowIndices[k] + firstIndex + (int) (getBenchRandom() * window);
+				context.targetColumnIndices[k] = context.columnIndices[k] + firstIndex + (int) (getBenchRandom() * window);
+			}
+
+			// A candidate of a window reads its halftone pixel, its cpe and a Cpp entry, per plane.
+			double sampleBytes = sizeof(dbsReal) + 1;
+
+			runBenchmark(&options, "getSwapDeltaError", "scalar", size, density, "candidate", 1, 2 * sizeof(dbsReal) + 2,
+					runSwapDeltaError, &context);
+
+			for (int k = 0; k < scanKernelCount; k++) {
+
+				config.scanKernel = scanKernels[k];
+				char *kernel = getScanKernelName(scanKernels[k]);
+
+				runBenchmark(&options, "getSwapDeltaErrorInRegion_1", kernel, size, density, "candidate", candidateCount,
+						2 * sampleBytes + sizeof(dbsReal), runSwapRegion1, &context);
+				runBenchmark(&options, "getSwapDeltaErrorInRegion_2", kernel, size, density, "candidate", candidateCount,
+						sampleBytes + sizeof(dbsReal), runSwapRegion2, &context);
+				runBenchmark(&options, "getSwapDeltaErrorInRegion_3", kernel, size, density, "candidate", candidateCount,
+						2 * sampleBytes + 2 + sizeof(dbsReal), runSwapRegion3, &context);
+			}
+
+			config.scanKernel = DBS_SCAN_KERNEL_SCALAR;
+
+			// An update reads and writes a cpe sample, and reads a Cpp entry, per tap.
+			runBenchmark(&options, "updateCpe", "-", size, density, "update", 1, cppTapCount * 3.0 * sizeof(dbsReal),
+					runUpdateCpe, &context);
+			runBenchmark(&options, "calculateRmsError", "-", size, density, "pixel", (double) size * size,
+					3 * sizeof(dbsReal) + 1, runRmsError, &context);
+			runBenchmark(&options, "runSinglePassDBS", "scalar", size, density, "block", (double) size * size, 0.0,
+					runSinglePass, &context);
+
+			// The convolution does not depend on the density.
+			if (d == 0) {
+				runBenchmark(&options, "convolve", "direct", size, -1.0, "pixel", (double) size * size, 0.0,
+						runConvolve, &context);
+			}
+
+			free(context.rowIndices);
+			deallocateBenchPlanes(planes);
+		}
+
+		free_img((void **) blockStatusMatrix);
+	}
+
+	setDesignOutput(NULL);
+	fclose(designOutput);
+
+	deallocateImage(cpp);
+	deallocateImage(psf);
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+/******************************************************************
+* file: bitPlane.c
+* Implementing: Bit-packed binary halftone planes
+* Pixels are packed 8 at a time from 64-bit loads: the bytes equal to 1 are flagged with carry-free byte arithmetic,
+* and one multiplication gathers the 8 flags into a byte. The candidate index keeps its planes in this form, and then
+* counts them with popcount and differences them with XOR, on 64 pixels per word.
+*******************************************************************/
+
+#include "dbs.h"
+#include "bitPlane.h"
+#include "allocate.h"
+
+#define BYTES_ONE       0x0101010101010101ULL
+#define BYTES_LOW7      0x7F7F7F7F7F7F7F7FULL
+
+// Returns 1 in each byte of word that equals 1, and 0 elsewhere.
+static uint64_t getOneBytes(uint64_t word) {
+
+	uint64_t x = word ^ BYTES_ONE;
+
+	// The high bit of each byte of x that is 0, without borrows across bytes.
+	uint64_t zeroBytes = ~(((x & BYTES_LOW7) + BYTES_LOW7) | x | BYTES_LOW7);
+
+	return zeroBytes >> 7;
+}
+
+uint64_t packPixels(const uint8_t *pixels, int count) {
+
+	uint64_t packed = 0;
+	int k = 0;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// The multiplier moves the flag of byte b to bit 56 + b, without carries.
+	for (; k + 8 <= count; k += 8) {
+
+		uint64_t word;
+		memcpy(&word, pixels + k, sizeof(word));
+		packed |= ((getOneBytes(word) * 0x0102040810204080ULL) >> 56) << k;
+	}
+#endif
+
+	for (; k < count; k++) {
+		if (pixels[k] == 1) {
+			packed |= 1ULL << k;
+		}
+	}
+
+	return packed;
+}
+
+struct bitPlane* createBitPlane(int height, int width) {
+
+	struct bitPlane *plane = (struct bitPlane *) multialloc(sizeof(struct bitPlane), 1, 1);
+	plane->height = height;
+	plane->width = width;
+	plane->wordsPerRow = (width + 63) / 64;
+	plane->words = (uint64_t **) multialloc(sizeof(uint64_t), 2, height, plane->wordsPerRow);
+
+	for (int i = 0; i < height; i++) {
+		memset(plane->words[i], 0, plane->wordsPerRow * sizeof(uint64_t));
+	}
+
+	return plane;
+}
+
+void deallocateBitPlane(struct bitPlane *plane) {
+
+	multifree((uint64_t *) plane->words, 2);
+	free(plane);
+}
+
+void packBitPlane(struct pxm_img *halftone, struct bitPlane *plane) {
+
+	for (int i = 0; i < plane->height; i++) {
+		for (int w = 0; w < plane->wordsPerRow; w++) {
+			plane->words[i][w] = packPixels(halftone->mono[i] + 64 * w, MIN(64, plane->width - 64 * w));
+		}
+	}
+}
+
+void differenceBitPlanes(struct bitPlane *first, struct bitPlane *second, struct bitPlane *result) {
+
+	for (int i = 0; i < result->height; i++) {
+		for (int w = 0; w < result->wordsPerRow; w++) {
+			result->words[i][w] = first->words[i][w] ^ second->words[i][w];
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef BIT_PLANE_H
+#define BIT_PLANE_H
+
+#include <stdint.h>
+
+struct pxm_img;
+
+// A binary halftone plane packed 64 pixels per word. Bit k of words[i][w] is pixel (i, 64 x w + k), and the bits past
+// the width of the last word of a row are always 0, so that whole rows can be counted and combined word by word.
+struct bitPlane
+{
+	int height;
+	int width;
+	int wordsPerRow;
+	uint64_t **words;
+};
+
+// Packs count (<= 64) pixels of a row into a word: bit k is set when pixels[k] == 1, the convention of the halftone
+// planes.
+uint64_t packPixels(const uint8_t *pixels, int count);
+
+struct bitPlane* createBitPlane(int height, int width);
+
+void deallocateBitPlane(struct bitPlane *plane);
+
+// Packs a halftone into a plane of the same size.
+void packBitPlane(struct pxm_img *halftone, struct bitPlane *plane);
+
+// result = first XOR second, the pixels that differ. result may be one of the operands.
+void differenceBitPlanes(struct bitPlane *first, struct bitPlane *second, struct bitPlane *result);
+
+#endif
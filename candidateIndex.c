@@ -0,0 +1,94 @@
+/******************************************************************
+* file: candidateIndex.c
+* Implementing: Incrementally maintained index of the swap candidates of a halftone plane
+* The index is built once per design step from the packed planes, and then kept current one pixel at a time by the
+* accepted swaps and toggles.
+*******************************************************************/
+
+#include "dbs.h"
+#include "candidateIndex.h"
+#include "bitPlane.h"
+
+// Returns 1 if the pixel is a candidate of the index.
+static int isCandidate(struct candidateIndex *index, int rowIndex, int columnIndex) {
+
+	if (index->reference == NULL) {
+		return index->plane->mono[rowIndex][columnIndex] == 1;
+	}
+
+	return index->plane->mono[rowIndex][columnIndex] != index->reference->mono[rowIndex][columnIndex];
+}
+
+struct candidateIndex* createCandidateIndex(struct pxm_img *plane, struct pxm_img *reference) {
+
+	struct candidateIndex *index = (struct candidateIndex *) malloc(sizeof(struct candidateIndex));
+	index->plane = plane;
+	index->reference = reference;
+	index->bits = createBitPlane(plane->height, plane->width);
+	index->rowCounts = (int *) malloc(plane->height * sizeof(int));
+	index->count = 0;
+
+	packBitPlane(plane, index->bits);
+
+	if (reference != NULL) {
+		struct bitPlane *referenceBits = createBitPlane(plane->height, plane->width);
+		packBitPlane(reference, referenceBits);
+		differenceBitPlanes(index->bits, referenceBits, index->bits);
+		deallocateBitPlane(referenceBits);
+	}
+
+	for (int i = 0; i < plane->height; i++) {
+
+		index->rowCounts[i] = 0;
+		for (int w = 0; w < index->bits->wordsPerRow; w++) {
+			index->rowCounts[i] += __builtin_popcountll(index->bits->words[i][w]);
+		}
+
+		index->count += index->rowCounts[i];
+	}
+
+	return index;
+}
+
+void deallocateCandidateIndex(struct candidateIndex *index) {
+
+	deallocateBitPlane(index->bits);
+	free(index->rowCounts);
+	free(index);
+}
+
+void updateCandidateIndex(struct candidateIndex *index, int rowIndex, int columnIndex) {
+
+	uint64_t *word = &index->bits->words[rowIndex][columnIndex / 64];
+	uint64_t bit = 1ULL << (columnIndex % 64);
+
+	int wasCandidate = (*word & bit) != 0;
+	int candidate = isCandidate(index, rowIndex, columnIndex);
+
+	if (candidate != wasCandidate) {
+		*word ^= bit;
+		index->rowCounts[rowIndex] += candidate ? 1 : -1;
+		index->count += candidate ? 1 : -1;
+	}
+}
+
+uint64_t getCandidateBits(struct candidateIndex *index, int rowIndex, int firstColumnIndex, int lastColumnIndex,
+		int isComplemented) {
+
+	uint64_t *words = index->bits->words[rowIndex];
+	int wordIndex = firstColumnIndex / 64;
+	int shift = firstColumnIndex % 64;
+	int count = lastColumnIndex - firstColumnIndex + 1;
+
+	// Join the two words the columns may straddle.
+	uint64_t bits = words[wordIndex] >> shift;
+	if (shift > 0 && shift + count > 64) {
+		bits |= words[wordIndex + 1] << (64 - shift);
+	}
+
+	if (isComplemented) {
+		bits = ~bits;
+	}
+
+	return count < 64 ? bits & ((1ULL << count) - 1) : bits;
+}
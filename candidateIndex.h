@@ -0,0 +1,36 @@
+#ifndef CANDIDATE_INDEX_H
+#define CANDIDATE_INDEX_H
+
+#include <stdint.h>
+
+struct pxm_img;
+struct bitPlane;
+
+// The pixels of a halftone plane that a swap search may pick: the set pixels of the plane, or, given a reference
+// plane, the pixels where both differ. Each pixel is a bit of a packed plane, and every row keeps its number of
+// candidates, so that the searches can skip the empty rows and walk the candidates 64 columns at a time.
+struct candidateIndex
+{
+	struct pxm_img *plane;
+	struct pxm_img *reference;
+
+	struct bitPlane *bits;
+	int *rowCounts;
+	long count;
+};
+
+// Indexes the core pixels of plane (and of reference, which may be NULL).
+struct candidateIndex* createCandidateIndex(struct pxm_img *plane, struct pxm_img *reference);
+
+void deallocateCandidateIndex(struct candidateIndex *index);
+
+// Updates the index after a pixel of its plane or of its reference has changed. Updating an unchanged pixel is
+// harmless.
+void updateCandidateIndex(struct candidateIndex *index, int rowIndex, int columnIndex);
+
+// Returns the candidates among the columns [firstColumnIndex, lastColumnIndex] (at most 64 of them) of a row, where
+// bit k stands for column firstColumnIndex + k. isComplemented returns the pixels that are not candidates instead.
+uint64_t getCandidateBits(struct candidateIndex *index, int rowIndex, int firstColumnIndex, int lastColumnIndex,
+		int isComplemented);
+
+#endif
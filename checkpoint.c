@@ -0,0 +1,166 @@
+/******************************************************************
+* file: checkpoint.c
+* Implementing: Atomic checkpoints of the level by level screen design
+* A checkpoint is written to a temporary file, flushed to the disk and renamed over the previous one, so that a crash
+* at any point leaves either the old or the new checkpoint in place.
+*******************************************************************/
+
+#include <unistd.h>
+
+#include "dbs.h"
+#include "checkpoint.h"
+
+// The checksum of the bytes written or read so far.
+struct checksummedFile
+{
+	FILE *file;
+	uint64_t checksum;
+};
+
+static void updateChecksum(struct checksummedFile *file, const void *data, size_t size) {
+
+	const unsigned char *bytes = (const unsigned char *) data;
+
+	for (size_t k = 0; k < size; k++) {
+		file->checksum ^= bytes[k];
+		file->checksum *= 1099511628211ULL;
+	}
+}
+
+static int writeBytes(struct checksummedFile *file, const void *data, size_t size) {
+
+	updateChecksum(file, data, size);
+
+	return fwrite(data, 1, size, file->file) == size;
+}
+
+static int readBytes(struct checksummedFile *file, void *data, size_t size) {
+
+	if (fread(data, 1, size, file->file) != size) {
+		return 0;
+	}
+
+	updateChecksum(file, data, size);
+
+	return 1;
+}
+
+void writeCheckpoint(char *path, int phase, unsigned int seqId, struct pxm_img **planes, int planeCount,
+		struct doubleImage **matrices, int matrixCount) {
+
+	char temporaryPath[1024];
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+
+	struct checksummedFile file = { fopen(temporaryPath, "wb"), 14695981039346656037ULL };
+	if (file.file == NULL) {
+		fprintf(stderr, "cannot write the checkpoint %s\n", temporaryPath);
+		return;
+	}
+
+	int32_t header[6] = { phase, (int32_t) seqId, planeCount, matrixCount, planes[0]->height, planes[0]->width };
+	int isWritten = writeBytes(&file, DBS_CHECKPOINT_MAGIC, 8) && writeBytes(&file, header, sizeof(header));
+
+	for (int k = 0; k < planeCount; k++) {
+		for (int i = 0; i < planes[k]->height; i++) {
+			isWritten = isWritten && writeBytes(&file, planes[k]->mono[i], planes[k]->width);
+		}
+	}
+
+	// The matrices are written in double precision whatever dbsReal is.
+	for (int k = 0; k < matrixCount; k++) {
+
+		int32_t size[2] = { matrices[k]->height, matrices[k]->width };
+		isWritten = isWritten && writeBytes(&file, size, sizeof(size));
+
+		for (int i = 0; i < matrices[k]->height; i++) {
+			for (int j = 0; j < matrices[k]->width; j++) {
+
+				double value = matrices[k]->data[i][j];
+				isWritten = isWritten && writeBytes(&file, &value, sizeof(value));
+			}
+		}
+	}
+
+	uint64_t checksum = file.checksum;
+	isWritten = isWritten && fwrite(&checksum, sizeof(checksum), 1, file.file) == 1;
+
+	// The data must reach the disk before the rename makes it the checkpoint.
+	isWritten = isWritten && fflush(file.file) == 0 && fsync(fileno(file.file)) == 0;
+	isWritten = fclose(file.file) == 0 && isWritten;
+
+	if (!isWritten || rename(temporaryPath, path) != 0) {
+		fprintf(stderr, "cannot write the checkpoint %s\n", path);
+		remove(temporaryPath);
+	}
+}
+
+int hasCheckpoint(char *path) {
+
+	return access(path, R_OK) == 0;
+}
+
+// Reports a checkpoint that cannot be resumed from, and stops.
+static void failCheckpoint(char *path, char *reason) {
+
+	fprintf(stderr, "cannot resume from the checkpoint %s: %s\n", path, reason);
+	exit(-1);
+}
+
+void readCheckpoint(char *path, int *phase, unsigned int *seqId, struct pxm_img **planes, int planeCount,
+		struct doubleImage **matrices, int matrixCount) {
+
+	struct checksummedFile file = { fopen(path, "rb"), 14695981039346656037ULL };
+	if (file.file == NULL) {
+		failCheckpoint(path, "it cannot be opened");
+	}
+
+	char magic[8];
+	int32_t header[6];
+
+	if (!readBytes(&file, magic, 8) || memcmp(magic, DBS_CHECKPOINT_MAGIC, 8) != 0 || !readBytes(&file, header, sizeof(header))) {
+		failCheckpoint(path, "it is not a checkpoint");
+	}
+
+	if (header[2] != planeCount || header[3] != matrixCount || header[4] != planes[0]->height || header[5] != planes[0]->width) {
+		failCheckpoint(path, "it was written by another design");
+	}
+
+	for (int k = 0; k < planeCount; k++) {
+		for (int i = 0; i < planes[k]->height; i++) {
+			if (!readBytes(&file, planes[k]->mono[i], planes[k]->width)) {
+				failCheckpoint(path, "it is truncated");
+			}
+		}
+	}
+
+	for (int k = 0; k < matrixCount; k++) {
+
+		int32_t size[2];
+		if (!readBytes(&file, size, sizeof(size)) || size[0] != matrices[k]->height || size[1] != matrices[k]->width) {
+			failCheckpoint(path, "it was written by another design");
+		}
+
+		for (int i = 0; i < matrices[k]->height; i++) {
+			for (int j = 0; j < matrices[k]->width; j++) {
+
+				double value;
+				if (!readBytes(&file, &value, sizeof(value))) {
+					failCheckpoint(path, "it is truncated");
+				}
+				matrices[k]->data[i][j] = value;
+			}
+		}
+	}
+
+	uint64_t expectedChecksum = file.checksum;
+	uint64_t checksum;
+
+	if (fread(&checksum, sizeof(checksum), 1, file.file) != 1 || checksum != expectedChecksum) {
+		failCheckpoint(path, "its checksum does not match");
+	}
+
+	fclose(file.file);
+
+	*phase = header[0];
+	*seqId = (unsigned int) header[1];
+}
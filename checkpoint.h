@@ -0,0 +1,29 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+struct pxm_img;
+struct doubleImage;
+
+// A checkpoint of the level by level design: the last finished level (a design phase and its seqId), and the halftone
+// planes and threshold matrices it left. The planes and matrices are given in a fixed order, which the reader uses
+// again.
+//
+// The file starts with DBS_CHECKPOINT_MAGIC, the phase, the seqId, the counts and the sizes, then holds the planes one
+// byte per pixel and the matrices as doubles, and ends with a FNV-1a checksum of everything before it.
+
+#define DBS_CHECKPOINT_MAGIC "DBSCKPT1"
+
+// Writes a checkpoint next to path, and renames it over path once it is complete, so that path always holds the last
+// good checkpoint.
+void writeCheckpoint(char *path, int phase, unsigned int seqId, struct pxm_img **planes, int planeCount,
+		struct doubleImage **matrices, int matrixCount);
+
+// Returns 1 if path holds a checkpoint.
+int hasCheckpoint(char *path);
+
+// Reads a checkpoint into the given planes and matrices, which must have the sizes it was written with. A damaged or
+// mismatching checkpoint is fatal.
+void readCheckpoint(char *path, int *phase, unsigned int *seqId, struct pxm_img **planes, int planeCount,
+		struct doubleImage **matrices, int matrixCount);
+
+#endif
@@ -10,12 +10,241 @@
 #include "dbs.h"
 #include <stdint.h>
 #include "allocate.h"
+#include "threadPool.h"
+#include "swapScan.h"
+#include "halo.h"
+#include "fftConvolve.h"
+#include "hvsCache.h"
+#include "bitPlane.h"
+#include "imageStorage.h"
+#include "levelArena.h"
+#include "candidateIndex.h"
+#include "swapCache.h"
+#include "outputWriter.h"
+#include "phaseTrace.h"
+#include "passTelemetry.h"
+#include "swapWindow.h"
+#include "randomStream.h"
+
+// The planes a DBS pass works on. This is handed to the block helpers, and to the worker threads of a colored pass.
+struct passContext
+{
+	struct Config *config;
+	struct doubleImage *inputImage;
+	struct pxm_img *halftoneCMY;
+	struct doubleImage *cpeCMY;
+	struct pxm_img *halftoneC;
+	struct doubleImage *cpeC;
+	struct pxm_img *halftoneM;
+	struct doubleImage *cpeM;
+	struct pxm_img *beforeCMY;
+	struct pxm_img *beforeC;
+	struct pxm_img *beforeM;
+	struct doubleImage *cpp;
+	uint8_t **blockStatusMatrix;
+	int stepIndex;
+
+	// The error of the C plane (the sum of cpe x error image), kept up to date from the accepted changes, and the
+	// number of finished passes.
+	double trackedError;
+	int passCount;
+
+	// The blocks enabled (or queued) at the start of the current pass, only counted for the pass records.
+	int activeBlockCount;
+
+	// The float shadow of the pass when config->precisionComparison is set, NULL otherwise.
+	struct precisionShadow *shadow;
+
+	// The swap sources and targets of the step (see createSwapCandidateIndices), NULL when the indices are not used.
+	struct candidateIndex *sourceIndex;
+	struct candidateIndex *targetIndex;
+
+	// The best swap of every source, NULL when the swap cache is not used.
+	struct swapCache *swapCache;
+
+	// The distances of the swaps accepted by the current pass, NULL when they are not recorded.
+	struct swapHistogram *passSwapHistogram;
+};
+
+// The best toggle and the best swap found when evaluating a single block.
+struct blockDecision
+{
+	double toggleError;
+	int toggleRowIndex;
+	int toggleColumnIndex;
+
+	double swapError;
+	int swapRowIndex;
+	int swapColumnIndex;
+	int swapTargetRowIndex;
+	int swapTargetColumnIndex;
+};
+
+// Splits the blocks into classes whose members are far enough apart on the torus that evaluating or applying one of
+// them cannot affect any other member. The classes are stored one after the other in blockRows / blockColumns.
+struct blockColoring
+{
+	int classCount;
+	int largestClassSize;
+
+	// Class k holds the blocks [classStart[k], classStart[k + 1]), in raster order.
+	int *classStart;
+	int *blockRows;
+	int *blockColumns;
+};
+
+// Float rounded copies of the distinct cpe planes of a design step and of Cpp, which follow the decisions of the double
+// pass. They measure how often single precision storage (see DBS_SINGLE_PRECISION) would decide otherwise on the same
+// halftone, and how far the rounded cpe drifts, not the design a float build would end with.
+struct precisionShadow
+{
+	// The pass context, with its cpe planes and Cpp pointing at the shadow copies.
+	struct passContext context;
+
+	int planeCount;
+	struct doubleImage *planes[3];
+	struct doubleImage *shadowPlanes[3];
+
+	// The decisions compared in the current pass, and those where the shadow would have chosen another change.
+	int decisionCount;
+	int differentCount;
+};
+
+static struct precisionShadow* createPrecisionShadow(struct passContext *context);
+
+static void freePrecisionShadow(struct precisionShadow *shadow);
+
+static void compareShadowDecision(struct passContext *context, int i, int j, struct blockDecision *decision);
+
+static int runRasterPassDBS(struct passContext *context);
+
+static int countActiveBlocks(uint8_t **blockStatusMatrix, int rowBlockCount, int columnBlockCount);
+
+struct blockQueue;
+
+static int adaptSwapWindow(struct passContext *context, struct blockQueue *queue, int fullReach, int isConverged);
+
+static void createSwapCandidateIndices(struct passContext *context);
+
+static void updateSwapCandidateIndices(struct passContext *context, int rowIndex, int columnIndex);
+
+static double getBestSwapInBlockIndexed(struct passContext *context, int blockRowIndex, int blockColumnIndex,
+		struct blockDecision *decision);
+
+static double getBestSwapInBlockCached(struct passContext *context, int blockRowIndex, int blockColumnIndex,
+		struct blockDecision *decision);
+
+static void invalidateCachedSwaps(struct passContext *context, int rowIndex, int columnIndex);
+
+static int runColoredPassDBS(struct passContext *context, struct blockColoring *coloring, struct threadPool *pool,
+		struct blockDecision *decisions, int *enabledBlocks);
+
+static struct blockColoring* createBlockColoring(struct Config *config, struct doubleImage *cpp, int height, int width);
+
+// A binary min-heap of the blocks (numbered row by row) keyed by their last evaluated best delta error. Ties are broken
+// by queueing order, so that the blocks without a predicted gain are visited in turn.
+struct blockQueue
+{
+	int count;
+	int *blocks;
+
+	// The heap position of every block, -1 for the blocks that are not queued, its last key and when it was queued.
+	int *positions;
+	double *keys;
+	long *sequences;
+	long sequence;
+};
+
+static struct blockQueue* createBlockQueue(int blockCount);
+
+static void freeBlockQueue(struct blockQueue *queue);
+
+static int runBestFirstRoundDBS(struct passContext *context, struct blockQueue *queue);
+
+static void freeBlockColoring(struct blockColoring *coloring);
+
+// Maps the planes of a design step to their halo padded copies. The same plane is often passed for several roles
+// (e.g. halftoneCMY, halftoneC and halftoneM in step 2), so each distinct plane gets a single copy, which keeps the
+// roles aliased.
+struct paddedPlanes
+{
+	int haloSize;
+
+	int imageCount;
+	struct doubleImage *images[3];
+	struct doubleImage *paddedImages[3];
+
+	int halftoneCount;
+	struct pxm_img *halftones[6];
+	struct pxm_img *paddedHalftones[6];
+};
+
+static struct doubleImage* getPaddedImage(struct paddedPlanes *planes, struct doubleImage *image);
+
+static struct pxm_img* getPaddedHalftone(struct paddedPlanes *planes, struct pxm_img *halftone);
+
+static void releasePaddedPlanes(struct paddedPlanes *planes);
+
+static void addCppToCpe(struct doubleImage *cpe, struct doubleImage *cpp, double a0, int rowIndex, int columnIndex);
+
+static int getBestToggleInRow(struct pxm_img *halftone, struct doubleImage *cpe, uint8_t value, double a0, int i);
+
+static void toggleDotsByError(struct Config *config, struct pxm_img *halftone, uint8_t value, int count,
+		struct doubleImage *cpp);
+
+// Where the design of the current thread prints, NULL for stdout.
+static __thread FILE *designOutput = NULL;
+
+FILE* getDesignOutput() {
+
+	return designOutput != NULL ? designOutput : stdout;
+}
+
+void setDesignOutput(FILE *output) {
+
+	designOutput = output;
+}
+
+// The writer of the halftone snapshots, NULL to write them on the design thread.
+static struct outputWriter *snapshotWriter = NULL;
+
+void setSnapshotWriter(struct outputWriter *writer) {
+
+	snapshotWriter = writer;
+}
 
 // Performs a complete halftoning using DBS on the image whose initial halftone is passed.
 void performCompleteDBSForScreenDesign(struct Config *config, struct doubleImage *inputImage,struct pxm_img *halftoneCMY,struct doubleImage *cpeCMY,
 		struct pxm_img *halftoneC,struct doubleImage *cpeC, struct pxm_img *halftoneM, struct doubleImage *cpeM,
 		struct pxm_img *beforeCMY,struct pxm_img *beforeC, struct pxm_img *beforeM, struct doubleImage *cpp, int stepIndex){
 
+    TRACE_BEGIN(callScope, TRACE_SCOPE_THREAD);
+
+    // Work on halo padded copies of the planes, if the wraparound strategy asks for it and the halo fits. The precision
+    // comparison keeps the planes unpadded, so that its shadow planes share their layout.
+    struct paddedPlanes planes = { 0 };
+
+    if (config->precisionComparison) {
+    	planes.haloSize = 0;
+    }
+    else if (config->haloMode == DBS_HALO_PADDED ||
+    	(config->haloMode == DBS_HALO_AUTO && (getWrapMask(cpeC->height) < 0 || getWrapMask(cpeC->width) < 0))) {
+    	planes.haloSize = getHaloSize(config, cpp, cpeC->height, cpeC->width);
+    }
+
+    if (planes.haloSize > 0) {
+    	cpeCMY = getPaddedImage(&planes, cpeCMY);
+    	cpeC = getPaddedImage(&planes, cpeC);
+    	cpeM = getPaddedImage(&planes, cpeM);
+
+    	halftoneCMY = getPaddedHalftone(&planes, halftoneCMY);
+    	halftoneC = getPaddedHalftone(&planes, halftoneC);
+    	halftoneM = getPaddedHalftone(&planes, halftoneM);
+    	beforeCMY = getPaddedHalftone(&planes, beforeCMY);
+    	beforeC = getPaddedHalftone(&planes, beforeC);
+    	beforeM = getPaddedHalftone(&planes, beforeM);
+    }
+
     // Generate block tracking elements.
     int rowBlockCount = (int) ceil((double) cpeC->height / (double) config->blockHeight);
     int columnBlockCount = (int) ceil((double) cpeC->width / (double) config->blockWidth);
@@ -29,12 +258,85 @@ void performCompleteDBSForScreenDesign(struct Config *config, struct doubleImage
         }
     }
 
+    // The adaptive swap window narrows the swap size of the passes, which read a copy of the configuration. Everything
+    // sized by the swap reach (the halos, the block classes, the swap cache) keeps that of config->swapSize.
+    struct Config passConfig = *config;
+
+    // The error is computed in full once, and then tracked from the accepted changes.
+    struct passContext context = { .config = &passConfig, .inputImage = inputImage, .halftoneCMY = halftoneCMY,
+    		.cpeCMY = cpeCMY, .halftoneC = halftoneC, .cpeC = cpeC, .halftoneM = halftoneM, .cpeM = cpeM,
+    		.beforeCMY = beforeCMY, .beforeC = beforeC, .beforeM = beforeM, .cpp = cpp,
+    		.blockStatusMatrix = blockStatusMatrix, .stepIndex = stepIndex,
+    		.trackedError = calculateTotalError(inputImage, halftoneC, cpeC), .passCount = 0 };
+
+    if (config->enableSwap && config->candidateIndexMode != DBS_CANDIDATE_INDEX_OFF) {
+    	createSwapCandidateIndices(&context);
+    }
+
+    // A change moves the cpe planes up to the Cpp border away, which the windows of the sources see from up to the swap
+    // reach away.
+    int swapReach = getSwapReach(config, cpeC->height, cpeC->width);
+
+    if (config->enableSwap && (config->swapCacheMode == DBS_SWAP_CACHE_ON || (config->swapCacheMode == DBS_SWAP_CACHE_AUTO &&
+    	MAX(config->blockHeight, config->blockWidth) > swapReach + 1))) {
+    	context.swapCache = createSwapCache(cpeC->height, cpeC->width, swapReach + cpp->borderSize);
+    }
+
+    // The distances of the swaps accepted by each pass, and by the whole call.
+    context.passSwapHistogram = createSwapHistogram(swapReach);
+    struct swapHistogram *swapHistogram = createSwapHistogram(swapReach);
+
+    if (config->precisionComparison) {
+    	context.shadow = createPrecisionShadow(&context);
+    }
+
+    // The colored order needs its classes, a pool to evaluate them, and room for the decisions of the largest class.
+    struct blockColoring *coloring = NULL;
+    struct threadPool *pool = NULL;
+    struct blockDecision *decisions = NULL;
+    int *enabledBlocks = NULL;
+
+    // The best-first order starts with every block queued ahead of any evaluated one, so that all of them get evaluated.
+    struct blockQueue *queue = NULL;
+
+    if (config->blockOrder == DBS_BLOCK_ORDER_BEST_FIRST) {
+    	queue = createBlockQueue(rowBlockCount * columnBlockCount);
+
+    	for (int i = 0; i < rowBlockCount; i++) {
+    		for (int j = 0; j < columnBlockCount; j++) {
+    			blockStatusMatrix[i][j] = 0;
+    		}
+    	}
+    }
+
+    if (config->blockOrder == DBS_BLOCK_ORDER_COLORED) {
+    	coloring = createBlockColoring(config, cpp, cpeC->height, cpeC->width);
+    	pool = createThreadPool(config->threadCount);
+    	decisions = (struct blockDecision *) malloc(coloring->largestClassSize * sizeof(struct blockDecision));
+    	enabledBlocks = (int *) malloc(coloring->largestClassSize * sizeof(int));
+    }
+
     // Run the passes until a convergnce condition is reached.
     for (int iterationIndex = 1; iterationIndex < config->maxIterationCount; iterationIndex++) {
 
-        printf("%03d => ", iterationIndex);
-        int totalChangeCount = runSinglePassDBS(config, inputImage, halftoneCMY, cpeCMY, halftoneC, cpeC, halftoneM, cpeM,
-        		beforeCMY, beforeC, beforeM,cpp, blockStatusMatrix, stepIndex);
+        fprintf(getDesignOutput(), "%03d => ", iterationIndex);
+        int totalChangeCount;
+
+        TRACE_BEGIN(passScope, TRACE_SCOPE_THREAD);
+
+        if (isPassTelemetryEnabled()) {
+        	context.activeBlockCount = queue != NULL ? queue->count : countActiveBlocks(blockStatusMatrix, rowBlockCount, columnBlockCount);
+        }
+
+        if (coloring != NULL) {
+        	totalChangeCount = runColoredPassDBS(&context, coloring, pool, decisions, enabledBlocks);
+        }
+        else if (queue != NULL) {
+        	totalChangeCount = runBestFirstRoundDBS(&context, queue);
+        }
+        else {
+        	totalChangeCount = runRasterPassDBS(&context);
+        }
 
 
 
@@ -43,135 +345,1334 @@ void performCompleteDBSForScreenDesign(struct Config *config, struct doubleImage
 			// Write the intermediate halftone result.
 			char fileName[100];
 			sprintf(fileName, "halftone%02d.tif", iterationIndex);
-			writeHalftoneImage(halftoneC, fileName);
+
+			if (snapshotWriter != NULL) {
+				queueHalftoneImage(snapshotWriter, halftoneC, fileName);
+			}
+			else {
+				writeHalftoneImage(halftoneC, fileName);
+			}
 		}
 
-        if (totalChangeCount < config->minAcceptableChangeCount)
+        int isConverged = queue != NULL ? queue->count == 0 : totalChangeCount < config->minAcceptableChangeCount;
+
+        // A narrowed window that would end the call is widened instead.
+        if (config->enableSwap && config->swapWindowPercentile > 0.0 && adaptSwapWindow(&context, queue, swapReach, isConverged)) {
+        	isConverged = 0;
+        }
+
+        mergeSwapHistogram(swapHistogram, context.passSwapHistogram);
+        clearSwapHistogram(context.passSwapHistogram);
+
+        TRACE_END(passScope, "pass", "pass", iterationIndex);
+
+        if (isConverged)
             break;
     }
 
+    if (swapHistogram->swapCount > 0) {
+    	fprintf(getDesignOutput(), "Swap distances: 50%% within %d, 90%% within %d, 99%% within %d, longest %d\n",
+    			getSwapDistancePercentile(swapHistogram, 0.5), getSwapDistancePercentile(swapHistogram, 0.9),
+    			getSwapDistancePercentile(swapHistogram, 0.99), getSwapDistancePercentile(swapHistogram, 1.0));
+    }
+
+    recordDesignSwapHistogram(swapHistogram);
+    deallocateSwapHistogram(swapHistogram);
+    deallocateSwapHistogram(context.passSwapHistogram);
+
+    if (queue != NULL) {
+    	freeBlockQueue(queue);
+    }
+
+    if (coloring != NULL) {
+    	destroyThreadPool(pool);
+    	freeBlockColoring(coloring);
+    	free(decisions);
+    	free(enabledBlocks);
+    }
+
+    if (context.shadow != NULL) {
+    	freePrecisionShadow(context.shadow);
+    }
+
+    if (context.sourceIndex != NULL) {
+    	deallocateCandidateIndex(context.sourceIndex);
+    	deallocateCandidateIndex(context.targetIndex);
+    }
+
+    if (context.swapCache != NULL) {
+    	deallocateSwapCache(context.swapCache);
+    }
+
     multifree((char *) blockStatusMatrix, 2);
+
+    // Hand the results back to the caller's planes.
+    releasePaddedPlanes(&planes);
+
+    TRACE_END(callScope, "call", "step", stepIndex);
 }
 
-// Runs a single pass DBS over the image to improve the given halftone, and returns the total number of changes.
-int runSinglePassDBS(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftoneCMY, struct doubleImage *cpeCMY,
-		struct pxm_img *halftoneC, struct doubleImage *cpeC,struct pxm_img *halftoneM, struct doubleImage *cpeM,
-		struct pxm_img *beforeCMY, struct pxm_img *beforeC, struct pxm_img *beforeM,
-		struct doubleImage *cpp, uint8_t **blockStatusMatrix, int stepIndex) {
+// A call of performIndependentDBSForScreenDesign, and the output it printed.
+struct designTask
+{
+	struct Config *config;
+	struct screenDesignCall *call;
+	char *output;
+	size_t outputSize;
+};
 
-    time_t blockStart;
-    time_t blockEnd;
+static void performDesignTask(void *argument, int index) {
 
-    // Capture the time at the beginning of the processing.
-    time(&blockStart);
+	struct designTask *task = &((struct designTask *) argument)[index];
+	struct screenDesignCall *call = task->call;
 
-    int toggleCount = 0;
-    int swapCount = 0;
-    double deltaError = 0.0;
+	// The task may run on the calling thread, whose output is restored afterwards.
+	FILE *previousOutput = designOutput;
+	designOutput = open_memstream(&task->output, &task->outputSize);
+	setTelemetryColorants(call->colorants);
 
-    // These values match the size of the status matrix.
-    int rowBlockCount = (int) ceil((double) cpeC->height / (double) config->blockHeight);
-    int columnBlockCount = (int) ceil((double) cpeC->width / (double) config->blockWidth);
+	performCompleteDBSForScreenDesign(task->config, call->inputImage, call->halftoneCMY, call->cpeCMY, call->halftoneC,
+			call->cpeC, call->halftoneM, call->cpeM, call->beforeCMY, call->beforeC, call->beforeM, call->cpp, call->stepIndex);
 
-    // Now, process all blocks.
-    for (int i = 0; i < rowBlockCount; i++) {
-        for (int j = 0; j < columnBlockCount; j++) {
+	fclose(designOutput);
+	designOutput = previousOutput;
+}
 
-            // No need to process the block if disabled.
-            if (blockStatusMatrix[i][j] == 0) {
-                continue;
-            }
+void performJointDBSRounds(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftoneCMY,
+		struct doubleImage *cpeCMY, struct pxm_img *halftoneC, struct doubleImage *cpeC, struct pxm_img *halftoneM,
+		struct doubleImage *cpeM, struct pxm_img *halftoneY, struct doubleImage *cpeY, struct doubleImage *cpp, int roundCount) {
 
-            int toggleRowIndex = -1;
-            int toggleColumnIndex = -1;
-            double toggleError = 0.0;
+	for (int i = 0; i < roundCount; i++) {
 
-            if (config->enableToggle) {
-                toggleError = getBestToggleInBlock(config, halftoneC, cpeC, cpp, i, j, &toggleRowIndex, &toggleColumnIndex);
-            }
+		fprintf(getDesignOutput(), "Iteration %d : Jointly optimize C and Y patterns  \n", i+1);
+		setTelemetryColorants("CY");
+		performCompleteDBSForScreenDesign(config, inputImage, halftoneCMY, cpeCMY, halftoneC, cpeC, halftoneY, cpeY,
+				halftoneCMY, halftoneY, halftoneC, cpp, 1);
+
+		fprintf(getDesignOutput(), "Iteration %d :Jointly optimize M and Y patterns \n", i+1);
+		setTelemetryColorants("MY");
+		performCompleteDBSForScreenDesign(config, inputImage, halftoneCMY, cpeCMY, halftoneM, cpeM, halftoneY, cpeY,
+				halftoneCMY, halftoneY, halftoneM, cpp, 1);
+
+		fprintf(getDesignOutput(), "Iteration %d :Jointly optimize C and M patterns\n", i+1);
+		setTelemetryColorants("CM");
+		performCompleteDBSForScreenDesign(config, inputImage, halftoneCMY, cpeCMY, halftoneC, cpeC, halftoneM, cpeM,
+				halftoneCMY, halftoneM, halftoneC, cpp, 1);
+	}
+}
 
-            int swapRowIndex = -1;
-            int swapColumnIndex = -1;
-            int swapTargetRowIndex = -1;
-            int swapTargetColumnIndex = -1;
-            double swapError = 0.0;
+void performIndependentDBSForScreenDesign(struct Config *config, struct screenDesignCall *calls, int callCount) {
 
-            if (config->enableSwap) {
+	if (!config->enableConcurrentColorants || callCount < 2) {
 
-            	// Judge which swap strategy should be applied
+		for (int k = 0; k < callCount; k++) {
+			setTelemetryColorants(calls[k].colorants);
+			performCompleteDBSForScreenDesign(config, calls[k].inputImage, calls[k].halftoneCMY, calls[k].cpeCMY,
+					calls[k].halftoneC, calls[k].cpeC, calls[k].halftoneM, calls[k].cpeM,
+					calls[k].beforeCMY, calls[k].beforeC, calls[k].beforeM, calls[k].cpp, calls[k].stepIndex);
+		}
+		return;
+	}
 
-            	switch (stepIndex){
+	struct designTask *tasks = (struct designTask *) calloc(callCount, sizeof(struct designTask));
+	for (int k = 0; k < callCount; k++) {
+		tasks[k].config = config;
+		tasks[k].call = &calls[k];
+	}
 
-				case 1: swapError = getBestSwapInBlock_1(config, halftoneC, cpeC,halftoneM, cpeM, cpp,
-                		i, j, &swapRowIndex, &swapColumnIndex,&swapTargetRowIndex, &swapTargetColumnIndex); break;
+	// One thread per call. The passes of a call still use their own pool in the colored order.
+	struct threadPool *pool = createThreadPool(callCount);
+	runParallelFor(pool, callCount, performDesignTask, tasks);
+	destroyThreadPool(pool);
 
-				case 2: swapError = getBestSwapInBlock_2(config, halftoneCMY, cpeCMY, cpp, i, j,
-						&swapRowIndex, &swapColumnIndex,&swapTargetRowIndex, &swapTargetColumnIndex, beforeCMY); break;
+	for (int k = 0; k < callCount; k++) {
+		fwrite(tasks[k].output, 1, tasks[k].outputSize, getDesignOutput());
+		free(tasks[k].output);
+	}
+	fflush(getDesignOutput());
 
-				case 3: swapError = getBestSwapInBlock_3(config, halftoneC, cpeC,halftoneM, cpeM, cpp,i, j, &swapRowIndex, &swapColumnIndex,
-						&swapTargetRowIndex, &swapTargetColumnIndex,beforeC,beforeM); break;
+	free(tasks);
+}
 
-				default: printf(" uncorrect step 1 \n"); break;
-				}
+static struct doubleImage* getPaddedImage(struct paddedPlanes *planes, struct doubleImage *image) {
 
+	for (int k = 0; k < planes->imageCount; k++) {
+		if (planes->images[k] == image) {
+			return planes->paddedImages[k];
+		}
+	}
 
-            }
+	planes->images[planes->imageCount] = image;
+	planes->paddedImages[planes->imageCount] = createPaddedImage(image, planes->haloSize);
 
-			// No good result will result from either changes.
-            if (toggleError >= 0.0 && swapError >= 0.0) {
-                blockStatusMatrix[i][j] = 0;
-                continue;
-            }
+	return planes->paddedImages[planes->imageCount++];
+}
 
-            // First check the toggle. If both deltas are equal, prioritize toggle.
-            if (toggleError <= swapError && toggleError < 0.0) {
+static struct pxm_img* getPaddedHalftone(struct paddedPlanes *planes, struct pxm_img *halftone) {
 
-                toggleCount++;
-                blockStatusMatrix[i][j] = 1;
-                deltaError += toggleError;
+	for (int k = 0; k < planes->halftoneCount; k++) {
+		if (planes->halftones[k] == halftone) {
+			return planes->paddedHalftones[k];
+		}
+	}
 
-                applyToggle(config, halftoneC, cpeC, cpp, blockStatusMatrix, toggleRowIndex, toggleColumnIndex);
-                continue;
-            }
+	planes->halftones[planes->halftoneCount] = halftone;
+	planes->paddedHalftones[planes->halftoneCount] = createPaddedHalftone(halftone, planes->haloSize);
 
-			// Second check the swap.
-			if (swapError < toggleError && swapError < 0.0) {
+	return planes->paddedHalftones[planes->halftoneCount++];
+}
 
-                swapCount++;
-                blockStatusMatrix[i][j] = 1;
-                deltaError += swapError;
+static void releasePaddedPlanes(struct paddedPlanes *planes) {
 
-                switch (stepIndex){
+	for (int k = 0; k < planes->imageCount; k++) {
+		copyPaddedImageCore(planes->paddedImages[k], planes->images[k]);
+		deallocatePaddedImage(planes->paddedImages[k]);
+	}
 
-				case 1: applySwap_1(config, halftoneC, cpeC, halftoneM, cpeM,cpp, blockStatusMatrix,
-						swapRowIndex, swapColumnIndex,swapTargetRowIndex, swapTargetColumnIndex); break;
+	for (int k = 0; k < planes->halftoneCount; k++) {
+		copyPaddedHalftoneCore(planes->paddedHalftones[k], planes->halftones[k]);
+		deallocatePaddedHalftone(planes->paddedHalftones[k], planes->haloSize);
+	}
 
-				case 2: applySwap_2(config, halftoneCMY, cpeCMY, cpp, blockStatusMatrix,
-						swapRowIndex, swapColumnIndex,swapTargetRowIndex, swapTargetColumnIndex); break;
+	planes->imageCount = 0;
+	planes->halftoneCount = 0;
+}
 
-				case 3: applySwap_3(config, halftoneC, cpeC, halftoneM, cpeM,cpp, blockStatusMatrix,
-						swapRowIndex, swapColumnIndex,swapTargetRowIndex, swapTargetColumnIndex); break;
+// Evaluates the best toggle and the best swap of a block. This only reads the planes, so that it can run concurrently
+// for blocks that do not conflict.
+static void evaluateBlock(struct passContext *context, int i, int j, struct blockDecision *decision) {
 
-				default: printf(" uncorrect step 2 \n"); break;
-				}
+	TRACE_START(evaluationStart);
+	struct Config *config = context->config;
 
+	decision->toggleRowIndex = -1;
+	decision->toggleColumnIndex = -1;
+	decision->toggleError = 0.0;
 
+	if (config->enableToggle) {
+		decision->toggleError = getBestToggleInBlock(config, context->halftoneC, context->cpeC, context->cpp, i, j,
+				&decision->toggleRowIndex, &decision->toggleColumnIndex);
+	}
 
-            }
-        }
-    }
+	decision->swapRowIndex = -1;
+	decision->swapColumnIndex = -1;
+	decision->swapTargetRowIndex = -1;
+	decision->swapTargetColumnIndex = -1;
+	decision->swapError = 0.0;
+
+	if (config->enableSwap && context->sourceIndex != NULL) {
+		decision->swapError = getBestSwapInBlockIndexed(context, i, j, decision);
+	}
+	else if (config->enableSwap && context->swapCache != NULL) {
+		decision->swapError = getBestSwapInBlockCached(context, i, j, decision);
+	}
+	else if (config->enableSwap) {
+
+		// Judge which swap strategy should be applied
+
+		switch (context->stepIndex){
+
+		case 1: decision->swapError = getBestSwapInBlock_1(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM,
+				context->cpp, i, j, &decision->swapRowIndex, &decision->swapColumnIndex,
+				&decision->swapTargetRowIndex, &decision->swapTargetColumnIndex); break;
+
+		case 2: decision->swapError = getBestSwapInBlock_2(config, context->halftoneCMY, context->cpeCMY, context->cpp, i, j,
+				&decision->swapRowIndex, &decision->swapColumnIndex,
+				&decision->swapTargetRowIndex, &decision->swapTargetColumnIndex, context->beforeCMY); break;
+
+		case 3: decision->swapError = getBestSwapInBlock_3(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM,
+				context->cpp, i, j, &decision->swapRowIndex, &decision->swapColumnIndex,
+				&decision->swapTargetRowIndex, &decision->swapTargetColumnIndex, context->beforeC, context->beforeM); break;
+
+		default: fprintf(getDesignOutput(), " uncorrect step 1 \n"); break;
+		}
+	}
+
+	TRACE_PHASE(TRACE_PHASE_EVALUATE, evaluationStart);
+}
+
+// Returns the row and column distances between the source and the target of the swap of a decision, on the torus.
+static void getSwapDistances(struct passContext *context, struct blockDecision *decision, int *rowDistance, int *columnDistance) {
+
+	int height = context->cpeC->height;
+	int width = context->cpeC->width;
+
+	// The scans measure the distance inside the window, which is never longer than half of the torus.
+	*rowDistance = abs(decision->swapTargetRowIndex - decision->swapRowIndex);
+	*columnDistance = abs(decision->swapTargetColumnIndex - decision->swapColumnIndex);
+	*rowDistance = MIN(*rowDistance, height - *rowDistance);
+	*columnDistance = MIN(*columnDistance, width - *columnDistance);
+}
+
+// Returns whether a swap changes the C plane error in a way that only a full computation finds. Step 2 swaps
+// halftoneCMY and cpeCMY, which the caller may pass as the C planes, as other planes, or one of each.
+static int isTrackedErrorRecomputed(struct passContext *context) {
+
+	return context->stepIndex == 2 && (context->halftoneCMY == context->halftoneC) != (context->cpeCMY == context->cpeC);
+}
+
+// Returns the change of the C plane error that the swap of a decision will cause, evaluated before it is applied.
+// Steps 1 and 3 score the swap on the C and M planes together, so the C part is computed again on its own. Step 2
+// changes the C error by the swap error when both of its planes are the C ones, and leaves it alone when neither is.
+static double getTrackedSwapDeltaError(struct passContext *context, struct blockDecision *decision) {
+
+	if (context->stepIndex == 2) {
+		return context->halftoneCMY == context->halftoneC ? decision->swapError : 0.0;
+	}
+
+	int rowDistance, columnDistance;
+	getSwapDistances(context, decision, &rowDistance, &columnDistance);
+
+	return getSwapDeltaError(context->halftoneC, context->cpeC, context->cpp, decision->swapRowIndex,
+			decision->swapColumnIndex, decision->swapTargetRowIndex, decision->swapTargetColumnIndex, rowDistance, columnDistance);
+}
+
+// Applies the decision taken for a block, if it improves the error, or disables the block otherwise.
+static void applyBlockDecision(struct passContext *context, int i, int j, struct blockDecision *decision,
+		int *toggleCount, int *swapCount, double *deltaError) {
+
+	struct Config *config = context->config;
+	uint8_t **blockStatusMatrix = context->blockStatusMatrix;
+
+	double toggleError = decision->toggleError;
+	double swapError = decision->swapError;
+
+	if (context->shadow != NULL) {
+		compareShadowDecision(context, i, j, decision);
+	}
+
+	// No good result will result from either changes.
+	if (toggleError >= 0.0 && swapError >= 0.0) {
+		blockStatusMatrix[i][j] = 0;
+		return;
+	}
+
+	TRACE_START(applicationStart);
+
+	// First check the toggle. If both deltas are equal, prioritize toggle.
+	if (toggleError <= swapError && toggleError < 0.0) {
+
+		(*toggleCount)++;
+		blockStatusMatrix[i][j] = 1;
+		*deltaError += toggleError;
+		context->trackedError += toggleError;
+
+		applyToggle(config, context->halftoneC, context->cpeC, context->cpp, blockStatusMatrix,
+				decision->toggleRowIndex, decision->toggleColumnIndex);
+		updateSwapCandidateIndices(context, decision->toggleRowIndex, decision->toggleColumnIndex);
+		invalidateCachedSwaps(context, decision->toggleRowIndex, decision->toggleColumnIndex);
+
+		TRACE_PHASE(TRACE_PHASE_APPLY, applicationStart);
+		return;
+	}
+
+	// Second check the swap.
+	if (swapError < toggleError && swapError < 0.0) {
+
+		(*swapCount)++;
+		blockStatusMatrix[i][j] = 1;
+		*deltaError += swapError;
+		if (!isTrackedErrorRecomputed(context)) {
+			context->trackedError += getTrackedSwapDeltaError(context, decision);
+		}
+
+		// runSinglePassDBS keeps no histogram.
+		if (context->passSwapHistogram != NULL) {
+			int rowDistance, columnDistance;
+			getSwapDistances(context, decision, &rowDistance, &columnDistance);
+			addSwapDistance(context->passSwapHistogram, MAX(rowDistance, columnDistance));
+		}
+
+		switch (context->stepIndex){
+
+		case 1: applySwap_1(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM, context->cpp, blockStatusMatrix,
+				decision->swapRowIndex, decision->swapColumnIndex, decision->swapTargetRowIndex, decision->swapTargetColumnIndex); break;
+
+		case 2: applySwap_2(config, context->halftoneCMY, context->cpeCMY, context->cpp, blockStatusMatrix,
+				decision->swapRowIndex, decision->swapColumnIndex, decision->swapTargetRowIndex, decision->swapTargetColumnIndex); break;
+
+		case 3: applySwap_3(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM, context->cpp, blockStatusMatrix,
+				decision->swapRowIndex, decision->swapColumnIndex, decision->swapTargetRowIndex, decision->swapTargetColumnIndex); break;
+
+		default: fprintf(getDesignOutput(), " uncorrect step 2 \n"); break;
+		}
+
+		if (isTrackedErrorRecomputed(context)) {
+			context->trackedError = calculateTotalError(context->inputImage, context->halftoneC, context->cpeC);
+		}
+
+		updateSwapCandidateIndices(context, decision->swapRowIndex, decision->swapColumnIndex);
+		updateSwapCandidateIndices(context, decision->swapTargetRowIndex, decision->swapTargetColumnIndex);
+		invalidateCachedSwaps(context, decision->swapRowIndex, decision->swapColumnIndex);
+		invalidateCachedSwaps(context, decision->swapTargetRowIndex, decision->swapTargetColumnIndex);
+
+		TRACE_PHASE(TRACE_PHASE_APPLY, applicationStart);
+	}
+}
+
+// Returns the number of enabled blocks.
+static int countActiveBlocks(uint8_t **blockStatusMatrix, int rowBlockCount, int columnBlockCount) {
+
+	int count = 0;
+
+	for (int i = 0; i < rowBlockCount; i++) {
+		for (int j = 0; j < columnBlockCount; j++) {
+			count += blockStatusMatrix[i][j] != 0;
+		}
+	}
+
+	return count;
+}
+
+// Prints the statistics of a finished pass, and writes its record.
+static void reportPass(struct passContext *context, int toggleCount, int swapCount, double deltaError, uint64_t passStart) {
+
+    TRACE_START(reportStart);
 
     int totalChangeCount = toggleCount + swapCount;
-    double rmsError = calculateRmsError(inputImage, halftoneC, cpeC, cpp);
-    
-	// Capture the time at the end of the processing.
-	time(&blockEnd);
-	double duration = difftime(blockEnd, blockStart);
-	
-	printf("Toggles:%6d, Swaps:%6d, Total =%6d, DeltaError = %-.6f, RMS Error = %.6f, Duration = %4.2fsec\n",
+    int pixelCount = context->cpeC->height * context->cpeC->width;
+
+    // Every errorCheckInterval passes, recompute the error in full to catch the drift of the tracked one.
+    context->passCount++;
+    if (context->config->errorCheckInterval > 0 && context->passCount % context->config->errorCheckInterval == 0) {
+
+    	double totalError = calculateTotalError(context->inputImage, context->halftoneC, context->cpeC);
+    	double drift = fabs(totalError - context->trackedError);
+
+    	if (drift > DBS_ERROR_DRIFT_TOLERANCE * MAX(totalError, 1.0)) {
+    		fprintf(stderr, "Tracked error drifted by %g after %d passes, resynchronizing.\n", drift, context->passCount);
+    	}
+
+    	context->trackedError = totalError;
+    }
+
+    double rmsError = sqrt(MAX(context->trackedError, 0.0) / pixelCount);
+
+	double duration = (getTraceTime() - passStart) * 1e-9;
+
+	fprintf(getDesignOutput(), "Toggles:%6d, Swaps:%6d, Total =%6d, DeltaError = %-.6f, RMS Error = %.6f, Duration = %.4fsec\n",
 			toggleCount, swapCount, totalChangeCount, deltaError, rmsError, duration);
 
-    return totalChangeCount;
+	struct passRecord record = { context->stepIndex, context->passCount, toggleCount, swapCount, deltaError, rmsError,
+			context->activeBlockCount, 2 * getSwapReach(context->config, context->cpeC->height, context->cpeC->width) + 1, duration };
+	writePassRecord(&record);
+
+	struct precisionShadow *shadow = context->shadow;
+	if (shadow != NULL) {
+
+		struct doubleImage *shadowCpeC = shadow->context.cpeC;
+		double shadowRmsError = sqrt(MAX(calculateTotalError(context->inputImage, context->halftoneC, shadowCpeC), 0.0) / pixelCount);
+
+		fprintf(getDesignOutput(), "       Float replay: %6d of %6d decisions differ on this halftone, RMS Error from float cpe = %.6f, Difference = %.3e\n",
+				shadow->differentCount, shadow->decisionCount, shadowRmsError, shadowRmsError - rmsError);
+
+		shadow->decisionCount = 0;
+		shadow->differentCount = 0;
+	}
+
+	TRACE_PHASE(TRACE_PHASE_REPORT, reportStart);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Precision comparison
+
+// Copies an image, rounding every sample to float.
+static struct doubleImage* createFloatRoundedImage(struct doubleImage *image) {
+
+	// Keep the centered indexing of Cpp.
+	struct doubleImage *rounded = createImage(image->height, image->width, image->borderSize, 0);
+
+	for (int i = -image->borderSize; i < image->height + image->borderSize; i++) {
+		for (int j = -image->borderSize; j < image->width + image->borderSize; j++) {
+			rounded->data[i][j] = (float) image->data[i][j];
+		}
+	}
+
+	return rounded;
+}
+
+static void deallocateFloatRoundedImage(struct doubleImage *image) {
+
+	deallocateImage(image);
+}
+
+static struct doubleImage* getShadowPlane(struct precisionShadow *shadow, struct doubleImage *plane) {
+
+	for (int k = 0; k < shadow->planeCount; k++) {
+		if (shadow->planes[k] == plane) {
+			return shadow->shadowPlanes[k];
+		}
+	}
+
+	shadow->planes[shadow->planeCount] = plane;
+	shadow->shadowPlanes[shadow->planeCount] = createFloatRoundedImage(plane);
+
+	return shadow->shadowPlanes[shadow->planeCount++];
+}
+
+static struct precisionShadow* createPrecisionShadow(struct passContext *context) {
+
+	struct precisionShadow *shadow = (struct precisionShadow *) calloc(1, sizeof(struct precisionShadow));
+
+	shadow->context = *context;
+	shadow->context.cpeCMY = getShadowPlane(shadow, context->cpeCMY);
+	shadow->context.cpeC = getShadowPlane(shadow, context->cpeC);
+	shadow->context.cpeM = getShadowPlane(shadow, context->cpeM);
+	shadow->context.cpp = createFloatRoundedImage(context->cpp);
+	shadow->context.shadow = NULL;
+
+	// The cached swaps were scored on the double planes.
+	shadow->context.swapCache = NULL;
+
+	return shadow;
+}
+
+static void freePrecisionShadow(struct precisionShadow *shadow) {
+
+	for (int k = 0; k < shadow->planeCount; k++) {
+		deallocateFloatRoundedImage(shadow->shadowPlanes[k]);
+	}
+
+	deallocateFloatRoundedImage(shadow->context.cpp);
+	free(shadow);
+}
+
+// The change a decision leads to: 0 for none, 1 for a toggle and 2 for a swap, and its pixels.
+static int getDecisionChange(struct blockDecision *decision, int change[4]) {
+
+	if (decision->toggleError >= 0.0 && decision->swapError >= 0.0) {
+		return 0;
+	}
+
+	if (decision->toggleError <= decision->swapError) {
+		change[0] = decision->toggleRowIndex;
+		change[1] = decision->toggleColumnIndex;
+		return 1;
+	}
+
+	change[0] = decision->swapRowIndex;
+	change[1] = decision->swapColumnIndex;
+	change[2] = decision->swapTargetRowIndex;
+	change[3] = decision->swapTargetColumnIndex;
+	return 2;
+}
+
+// Applies a0 x Cpp at (rowIndex, columnIndex) to a shadow plane, and rounds the footprint to float as a float store
+// would.
+static void updateShadowCpe(struct passContext *shadowContext, struct doubleImage *shadowCpe, double a0,
+		int rowIndex, int columnIndex) {
+
+	struct doubleImage *cpp = shadowContext->cpp;
+
+	updateCpe(shadowContext->config, shadowCpe, cpp, shadowContext->blockStatusMatrix, a0, rowIndex, columnIndex);
+
+	for (int i = rowIndex - cpp->borderSize; i <= rowIndex + cpp->borderSize; i++) {
+		for (int j = columnIndex - cpp->borderSize; j <= columnIndex + cpp->borderSize; j++) {
+
+			dbsReal *sample = &shadowCpe->data[MOD(i, shadowCpe->height)][MOD(j, shadowCpe->width)];
+			*sample = (float) *sample;
+		}
+	}
+}
+
+// Evaluates the block on the shadow planes, counts whether it chooses another change than the double decision, and
+// replays the double decision on the shadow planes. Must run before the decision is applied.
+static void compareShadowDecision(struct passContext *context, int i, int j, struct blockDecision *decision) {
+
+	struct precisionShadow *shadow = context->shadow;
+	struct passContext *shadowContext = &shadow->context;
+
+	struct blockDecision shadowDecision;
+	evaluateBlock(shadowContext, i, j, &shadowDecision);
+
+	int change[4], shadowChange[4];
+	int changeType = getDecisionChange(decision, change);
+	int shadowChangeType = getDecisionChange(&shadowDecision, shadowChange);
+
+	shadow->decisionCount++;
+	if (changeType != shadowChangeType || (changeType != 0 && memcmp(change, shadowChange, 2 * changeType * sizeof(int)) != 0)) {
+		shadow->differentCount++;
+	}
+
+	if (changeType == 1) {
+
+		double a0 = context->halftoneC->mono[change[0]][change[1]] ? -1.0 : 1.0;
+		updateShadowCpe(shadowContext, shadowContext->cpeC, a0, change[0], change[1]);
+	}
+	else if (changeType == 2 && context->stepIndex == 2) {
+
+		double a0 = context->halftoneCMY->mono[change[0]][change[1]] ? -1.0 : 1.0;
+		updateShadowCpe(shadowContext, shadowContext->cpeCMY, a0, change[0], change[1]);
+		updateShadowCpe(shadowContext, shadowContext->cpeCMY, -a0, change[2], change[3]);
+	}
+	else if (changeType == 2) {
+
+		double a0 = context->halftoneC->mono[change[0]][change[1]] ? -1.0 : 1.0;
+		double a0M = context->halftoneM->mono[change[0]][change[1]] ? -1.0 : 1.0;
+		updateShadowCpe(shadowContext, shadowContext->cpeC, a0, change[0], change[1]);
+		updateShadowCpe(shadowContext, shadowContext->cpeM, a0M, change[0], change[1]);
+		updateShadowCpe(shadowContext, shadowContext->cpeC, -a0, change[2], change[3]);
+		updateShadowCpe(shadowContext, shadowContext->cpeM, -a0M, change[2], change[3]);
+	}
+}
+
+// Runs a single pass DBS over the image to improve the given halftone, and returns the total number of changes.
+int runSinglePassDBS(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftoneCMY, struct doubleImage *cpeCMY,
+		struct pxm_img *halftoneC, struct doubleImage *cpeC,struct pxm_img *halftoneM, struct doubleImage *cpeM,
+		struct pxm_img *beforeCMY, struct pxm_img *beforeC, struct pxm_img *beforeM,
+		struct doubleImage *cpp, uint8_t **blockStatusMatrix, int stepIndex) {
+
+    struct passContext context = { .config = config, .inputImage = inputImage, .halftoneCMY = halftoneCMY,
+    		.cpeCMY = cpeCMY, .halftoneC = halftoneC, .cpeC = cpeC, .halftoneM = halftoneM, .cpeM = cpeM,
+    		.beforeCMY = beforeCMY, .beforeC = beforeC, .beforeM = beforeM, .cpp = cpp,
+    		.blockStatusMatrix = blockStatusMatrix, .stepIndex = stepIndex,
+    		.trackedError = calculateTotalError(inputImage, halftoneC, cpeC), .passCount = 0 };
+
+    return runRasterPassDBS(&context);
+}
+
+// Runs a pass over the blocks row by row, keeping the tracked error of the context up to date.
+static int runRasterPassDBS(struct passContext *context) {
+
+    // Capture the time at the beginning of the processing.
+    uint64_t passStart = getTraceTime();
+
+    struct Config *config = context->config;
+    uint8_t **blockStatusMatrix = context->blockStatusMatrix;
+
+    int toggleCount = 0;
+    int swapCount = 0;
+    double deltaError = 0.0;
+
+    // These values match the size of the status matrix.
+    int rowBlockCount = (int) ceil((double) context->cpeC->height / (double) config->blockHeight);
+    int columnBlockCount = (int) ceil((double) context->cpeC->width / (double) config->blockWidth);
+
+    // Now, process all blocks.
+    for (int i = 0; i < rowBlockCount; i++) {
+        for (int j = 0; j < columnBlockCount; j++) {
+
+            // No need to process the block if disabled.
+            if (blockStatusMatrix[i][j] == 0) {
+                continue;
+            }
+
+            struct blockDecision decision;
+            evaluateBlock(context, i, j, &decision);
+            applyBlockDecision(context, i, j, &decision, &toggleCount, &swapCount, &deltaError);
+        }
+    }
+
+    reportPass(context, toggleCount, swapCount, deltaError, passStart);
+
+    return toggleCount + swapCount;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Swap candidate indices
+
+// Indexes the pixels the swap searches of the step look at: the sources of a block, and the targets of a window.
+// Step 1 moves a set C pixel onto a set M pixel, step 2 a changed pixel onto any pixel of the opposite value (the set
+// pixels, or their complement), and step 3 a changed C pixel onto a changed M pixel.
+static void createSwapCandidateIndices(struct passContext *context) {
+
+	switch (context->stepIndex) {
+
+	case 1:
+		context->sourceIndex = createCandidateIndex(context->halftoneC, NULL);
+		context->targetIndex = createCandidateIndex(context->halftoneM, NULL);
+		break;
+
+	case 2:
+		context->sourceIndex = createCandidateIndex(context->halftoneCMY, context->beforeCMY);
+		context->targetIndex = createCandidateIndex(context->halftoneCMY, NULL);
+		break;
+
+	case 3:
+		context->sourceIndex = createCandidateIndex(context->halftoneC, context->beforeC);
+		context->targetIndex = createCandidateIndex(context->halftoneM, context->beforeM);
+		break;
+	}
+}
+
+// Brings the indices up to date after a change of the planes at a pixel.
+static void updateSwapCandidateIndices(struct passContext *context, int rowIndex, int columnIndex) {
+
+	if (context->sourceIndex != NULL) {
+		updateCandidateIndex(context->sourceIndex, rowIndex, columnIndex);
+		updateCandidateIndex(context->targetIndex, rowIndex, columnIndex);
+	}
+}
+
+// getSwapDeltaErrorInRegion_* restricted to the indexed targets. The window is walked in the same order as the full
+// scan, so that ties resolve to the same target. Falls back to the full scan in AUTO mode when the targets are dense.
+static double getSwapDeltaErrorInRegionIndexed(struct passContext *context, int rowIndex, int columnIndex,
+		int *swapTargetRowIndex, int *swapTargetColumnIndex) {
+
+	struct Config *config = context->config;
+	struct candidateIndex *targets = context->targetIndex;
+
+	// Step 2 scores a single plane, the others the C and M planes together.
+	struct pxm_img *halftone = context->halftoneC;
+	struct doubleImage *cpe = context->cpeC;
+	struct pxm_img *secondHalftone = context->halftoneM;
+	struct doubleImage *secondCpe = context->cpeM;
+	int isComplemented = 0;
+
+	if (context->stepIndex == 2) {
+		halftone = context->halftoneCMY;
+		cpe = context->cpeCMY;
+		secondHalftone = NULL;
+		secondCpe = NULL;
+
+		// The targets of a set pixel are the pixels that are not set.
+		isComplemented = halftone->mono[rowIndex][columnIndex] == 1;
+	}
+
+	int height = cpe->height;
+	int width = cpe->width;
+
+	long targetCount = isComplemented ? (long) height * width - targets->count : targets->count;
+
+	if (config->candidateIndexMode == DBS_CANDIDATE_INDEX_AUTO && targetCount > DBS_CANDIDATE_INDEX_DENSITY * height * width) {
+
+		switch (context->stepIndex) {
+
+		case 1: return getSwapDeltaErrorInRegion_1(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM,
+				context->cpp, rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex);
+
+		case 2: return getSwapDeltaErrorInRegion_2(config, context->halftoneCMY, context->cpeCMY, context->cpp,
+				rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex);
+
+		default: return getSwapDeltaErrorInRegion_3(config, context->halftoneC, context->cpeC, context->halftoneM, context->cpeM,
+				context->cpp, rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex, context->beforeC, context->beforeM);
+		}
+	}
+
+	double minDeltaError = 0.0;
+
+	// The swap region, clipped to the torus.
+	int minRowIndex, maxRowIndex, minColumnIndex, maxColumnIndex;
+	getSwapWindowRange(config, rowIndex, height, &minRowIndex, &maxRowIndex);
+	getSwapWindowRange(config, columnIndex, width, &minColumnIndex, &maxColumnIndex);
+
+	// A padded plane holds the whole region, so its indices need no wrapping.
+	int isPadded = cpe->haloSize > 0;
+
+	for (int i = minRowIndex; i <= maxRowIndex; i++) {
+
+		int row = MOD(i, height);
+		int rowCount = isComplemented ? width - targets->rowCounts[row] : targets->rowCounts[row];
+
+		if (rowCount == 0) {
+			continue;
+		}
+
+		int targetRowIndex = isPadded ? i : row;
+		int cppRowIndex = abs(i - rowIndex);
+
+		// Take the columns 64 at a time, without crossing the edge of the torus.
+		for (int j = minColumnIndex; j <= maxColumnIndex; ) {
+
+			int column = MOD(j, width);
+			int count = MIN(MIN(maxColumnIndex - j + 1, width - column), 64);
+
+			uint64_t candidates = getCandidateBits(targets, row, column, column + count - 1, isComplemented);
+
+			for (; candidates != 0; candidates &= candidates - 1) {
+
+				int k = __builtin_ctzll(candidates);
+				int targetColumnIndex = isPadded ? j + k : column + k;
+				int cppColumnIndex = abs(j + k - columnIndex);
+
+				double deltaError = getSwapDeltaError(halftone, cpe, context->cpp, rowIndex, columnIndex,
+						targetRowIndex, targetColumnIndex, cppRowIndex, cppColumnIndex);
+
+				if (secondHalftone != NULL) {
+					deltaError += getSwapDeltaError(secondHalftone, secondCpe, context->cpp, rowIndex, columnIndex,
+							targetRowIndex, targetColumnIndex, cppRowIndex, cppColumnIndex);
+				}
+
+				if (deltaError < minDeltaError) {
+					*swapTargetRowIndex = row;
+					*swapTargetColumnIndex = column + k;
+
+					minDeltaError = deltaError;
+				}
+			}
+
+			j += count;
+		}
+	}
+
+	return minDeltaError;
+}
+
+// Returns the best swap of a source pixel, from the swap cache if its entry holds, or from a scan of its window, whose
+// result is then cached.
+static double getCachedSwapDeltaErrorInRegion(struct passContext *context, int rowIndex, int columnIndex,
+		int *swapTargetRowIndex, int *swapTargetColumnIndex) {
+
+	struct Config *config = context->config;
+	double deltaError;
+
+	if (context->swapCache != NULL &&
+		lookupSwapCache(context->swapCache, rowIndex, columnIndex, &deltaError, swapTargetRowIndex, swapTargetColumnIndex)) {
+		return deltaError;
+	}
+
+	// The scans only write the target of a negative delta.
+	int targetRowIndex = -1;
+	int targetColumnIndex = -1;
+
+	if (context->targetIndex != NULL) {
+		deltaError = getSwapDeltaErrorInRegionIndexed(context, rowIndex, columnIndex, &targetRowIndex, &targetColumnIndex);
+	}
+	else {
+
+		switch (context->stepIndex) {
+
+		case 1: deltaError = getSwapDeltaErrorInRegion_1(config, context->halftoneC, context->cpeC, context->halftoneM,
+				context->cpeM, context->cpp, rowIndex, columnIndex, &targetRowIndex, &targetColumnIndex); break;
+
+		case 2: deltaError = getSwapDeltaErrorInRegion_2(config, context->halftoneCMY, context->cpeCMY, context->cpp,
+				rowIndex, columnIndex, &targetRowIndex, &targetColumnIndex); break;
+
+		default: deltaError = getSwapDeltaErrorInRegion_3(config, context->halftoneC, context->cpeC, context->halftoneM,
+				context->cpeM, context->cpp, rowIndex, columnIndex, &targetRowIndex, &targetColumnIndex,
+				context->beforeC, context->beforeM); break;
+		}
+	}
+
+	if (context->swapCache != NULL) {
+		storeSwapCache(context->swapCache, rowIndex, columnIndex, deltaError, targetRowIndex, targetColumnIndex);
+	}
+
+	if (deltaError < 0.0) {
+		*swapTargetRowIndex = targetRowIndex;
+		*swapTargetColumnIndex = targetColumnIndex;
+	}
+
+	return deltaError;
+}
+
+// getBestSwapInBlock_* restricted to the indexed sources and targets.
+static double getBestSwapInBlockIndexed(struct passContext *context, int blockRowIndex, int blockColumnIndex,
+		struct blockDecision *decision) {
+
+	struct Config *config = context->config;
+	struct candidateIndex *sources = context->sourceIndex;
+
+    int blockStartRowIndex = blockRowIndex * config->blockHeight;
+    int blockStartColumnIndex = blockColumnIndex * config->blockWidth;
+
+    int height = MIN(blockStartRowIndex + config->blockHeight, sources->plane->height);
+    int width = MIN(blockStartColumnIndex + config->blockWidth, sources->plane->width);
+
+    double minDeltaError = 0.0;
+
+    int swapRowIndex = -1;
+    int swapColumnIndex = -1;
+
+    // Go over the sources of the block, in raster order.
+    for (int i = blockStartRowIndex; i < height; i++) {
+
+    	if (sources->rowCounts[i] == 0) {
+    		continue;
+    	}
+
+    	for (int j = blockStartColumnIndex; j < width; j += 64) {
+
+    		uint64_t candidates = getCandidateBits(sources, i, j, MIN(j + 63, width - 1), 0);
+
+    		for (; candidates != 0; candidates &= candidates - 1) {
+
+    			int columnIndex = j + __builtin_ctzll(candidates);
+
+    			double deltaError = getCachedSwapDeltaErrorInRegion(context, i, columnIndex, &swapRowIndex, &swapColumnIndex);
+    			if (deltaError < minDeltaError) {
+    				decision->swapRowIndex = i;
+    				decision->swapColumnIndex = columnIndex;
+    				decision->swapTargetRowIndex = swapRowIndex;
+    				decision->swapTargetColumnIndex = swapColumnIndex;
+
+    				minDeltaError = deltaError;
+    			}
+    		}
+    	}
+    }
+
+    return minDeltaError;
+}
+
+// getBestSwapInBlock_* with the best swap of every source taken from the swap cache when it holds.
+static double getBestSwapInBlockCached(struct passContext *context, int blockRowIndex, int blockColumnIndex,
+		struct blockDecision *decision) {
+
+	struct Config *config = context->config;
+
+	// Step 1 moves the set C pixels, step 2 the changed pixels, and step 3 the changed C pixels.
+	struct pxm_img *sources = context->stepIndex == 2 ? context->halftoneCMY : context->halftoneC;
+	struct pxm_img *before = context->stepIndex == 2 ? context->beforeCMY : context->beforeC;
+
+    int blockStartRowIndex = blockRowIndex * config->blockHeight;
+    int blockStartColumnIndex = blockColumnIndex * config->blockWidth;
+
+    int height = MIN(blockStartRowIndex + config->blockHeight, sources->height);
+    int width = MIN(blockStartColumnIndex + config->blockWidth, sources->width);
+
+    double minDeltaError = 0.0;
+
+    int swapRowIndex = -1;
+    int swapColumnIndex = -1;
+
+    // Go over Block pixels.
+    for (int i = blockStartRowIndex; i < height; i++) {
+        for (int j = blockStartColumnIndex; j < width; j++) {
+
+        	int isSource = context->stepIndex == 1 ? sources->mono[i][j] == 1 : sources->mono[i][j] != before->mono[i][j];
+        	if (!isSource) {
+        		continue;
+        	}
+
+        	double deltaError = getCachedSwapDeltaErrorInRegion(context, i, j, &swapRowIndex, &swapColumnIndex);
+        	if (deltaError < minDeltaError) {
+        		decision->swapRowIndex = i;
+        		decision->swapColumnIndex = j;
+        		decision->swapTargetRowIndex = swapRowIndex;
+        		decision->swapTargetColumnIndex = swapColumnIndex;
+
+        		minDeltaError = deltaError;
+        	}
+        }
+    }
+
+    return minDeltaError;
+}
+
+// Invalidates the cached swaps that a change of the planes at a pixel may have altered.
+static void invalidateCachedSwaps(struct passContext *context, int rowIndex, int columnIndex) {
+
+	if (context->swapCache != NULL) {
+		invalidateSwapCache(context->swapCache, rowIndex, columnIndex);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Colored (parallel) pass
+
+// Returns the shortest torus distance, in pixels, between the pixels of two blocks along one dimension, where
+// firstBlock < secondBlock.
+static int getBlockTorusDistance(int firstBlock, int secondBlock, int blockSize, int length) {
+
+	int firstStart = firstBlock * blockSize;
+	int firstEnd = MIN(firstStart + blockSize, length) - 1;
+	int secondStart = secondBlock * blockSize;
+	int secondEnd = MIN(secondStart + blockSize, length) - 1;
+
+	int forward = secondStart - firstEnd;
+	int backward = firstStart + length - secondEnd;
+
+	return MIN(forward, backward);
+}
+
+// Returns the smallest number of colors along one dimension such that any two blocks sharing a color (index modulo the
+// color count) are more than conflictDistance pixels apart on the torus.
+static int getColorCountAlongDimension(int blockCount, int blockSize, int length, int conflictDistance) {
+
+	for (int colorCount = 1; colorCount < blockCount; colorCount++) {
+
+		int isConflictFree = 1;
+
+		for (int i = 0; i < colorCount && isConflictFree; i++) {
+			for (int k = i + colorCount; k < blockCount; k += colorCount) {
+
+				// The closest pair along the torus is always either neighbors or the first and the last.
+				if (getBlockTorusDistance(k - colorCount, k, blockSize, length) <= conflictDistance ||
+					getBlockTorusDistance(i, k, blockSize, length) <= conflictDistance) {
+					isConflictFree = 0;
+					break;
+				}
+			}
+		}
+
+		if (isConflictFree) {
+			return colorCount;
+		}
+	}
+
+	return blockCount;
+}
+
+// Builds the color classes of the blocks. Evaluating a block reads the cpe and the halftones up to swapSize / 2 away
+// from it, and applying its change writes up to swapSize / 2 + cpp->borderSize away (the swap target plus the Cpp
+// footprint of both pixels). Two blocks further apart than the sum can therefore be evaluated in any order.
+static struct blockColoring* createBlockColoring(struct Config *config, struct doubleImage *cpp, int height, int width) {
+
+	int rowBlockCount = (int) ceil((double) height / (double) config->blockHeight);
+	int columnBlockCount = (int) ceil((double) width / (double) config->blockWidth);
+
+	int conflictDistance = 2 * getSwapReach(config, height, width) + cpp->borderSize;
+
+	int rowColorCount = getColorCountAlongDimension(rowBlockCount, config->blockHeight, height, conflictDistance);
+	int columnColorCount = getColorCountAlongDimension(columnBlockCount, config->blockWidth, width, conflictDistance);
+
+	struct blockColoring *coloring = (struct blockColoring *) malloc(sizeof(struct blockColoring));
+	coloring->classCount = rowColorCount * columnColorCount;
+	coloring->classStart = (int *) calloc(coloring->classCount + 1, sizeof(int));
+	coloring->blockRows = (int *) malloc(rowBlockCount * columnBlockCount * sizeof(int));
+	coloring->blockColumns = (int *) malloc(rowBlockCount * columnBlockCount * sizeof(int));
+
+	// Count the members of each class, then place them in raster order.
+	for (int i = 0; i < rowBlockCount; i++) {
+		for (int j = 0; j < columnBlockCount; j++) {
+			coloring->classStart[(i % rowColorCount) * columnColorCount + (j % columnColorCount) + 1]++;
+		}
+	}
+
+	coloring->largestClassSize = 0;
+	for (int k = 0; k < coloring->classCount; k++) {
+		coloring->largestClassSize = MAX(coloring->largestClassSize, coloring->classStart[k + 1]);
+		coloring->classStart[k + 1] += coloring->classStart[k];
+	}
+
+	int *nextSlot = (int *) malloc(coloring->classCount * sizeof(int));
+	memcpy(nextSlot, coloring->classStart, coloring->classCount * sizeof(int));
+
+	for (int i = 0; i < rowBlockCount; i++) {
+		for (int j = 0; j < columnBlockCount; j++) {
+
+			int slot = nextSlot[(i % rowColorCount) * columnColorCount + (j % columnColorCount)]++;
+			coloring->blockRows[slot] = i;
+			coloring->blockColumns[slot] = j;
+		}
+	}
+
+	free(nextSlot);
+
+	if (config->enableVerboseDebugging) {
+		fprintf(getDesignOutput(), "Block coloring: %d x %d colors, up to %d blocks per class\n", rowColorCount, columnColorCount,
+				coloring->largestClassSize);
+	}
+
+	return coloring;
+}
+
+static void freeBlockColoring(struct blockColoring *coloring) {
+
+	free(coloring->classStart);
+	free(coloring->blockRows);
+	free(coloring->blockColumns);
+	free(coloring);
+}
+
+// The work shared by the threads evaluating a color class.
+struct classEvaluation
+{
+	struct passContext *context;
+	struct blockColoring *coloring;
+	int *enabledBlocks;
+	struct blockDecision *decisions;
+};
+
+static void evaluateClassBlock(void *argument, int index) {
+
+	struct classEvaluation *evaluation = (struct classEvaluation *) argument;
+	int block = evaluation->enabledBlocks[index];
+
+	evaluateBlock(evaluation->context, evaluation->coloring->blockRows[block], evaluation->coloring->blockColumns[block],
+			&evaluation->decisions[index]);
+}
+
+// Runs a single pass over the color classes, and returns the total number of changes. The enabled blocks of a class
+// are evaluated in parallel, and their decisions are then applied in class order. As no member of a class can see the
+// changes of another one, the result is the same as visiting the blocks of each class one after the other.
+static int runColoredPassDBS(struct passContext *context, struct blockColoring *coloring, struct threadPool *pool,
+		struct blockDecision *decisions, int *enabledBlocks) {
+
+    // Capture the time at the beginning of the processing.
+    uint64_t passStart = getTraceTime();
+
+    int toggleCount = 0;
+    int swapCount = 0;
+    double deltaError = 0.0;
+
+    struct classEvaluation evaluation = { context, coloring, enabledBlocks, decisions };
+
+    for (int k = 0; k < coloring->classCount; k++) {
+
+    	// No need to process the disabled blocks.
+    	int enabledCount = 0;
+    	for (int block = coloring->classStart[k]; block < coloring->classStart[k + 1]; block++) {
+    		if (context->blockStatusMatrix[coloring->blockRows[block]][coloring->blockColumns[block]] != 0) {
+    			enabledBlocks[enabledCount++] = block;
+    		}
+    	}
+
+    	runParallelFor(pool, enabledCount, evaluateClassBlock, &evaluation);
+
+    	for (int index = 0; index < enabledCount; index++) {
+
+    		int block = enabledBlocks[index];
+    		applyBlockDecision(context, coloring->blockRows[block], coloring->blockColumns[block], &decisions[index],
+    				&toggleCount, &swapCount, &deltaError);
+    	}
+    }
+
+    reportPass(context, toggleCount, swapCount, deltaError, passStart);
+
+    return toggleCount + swapCount;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Best-first order
+
+static struct blockQueue* createBlockQueue(int blockCount) {
+
+	struct blockQueue *queue = (struct blockQueue *) malloc(sizeof(struct blockQueue));
+	queue->count = blockCount;
+	queue->blocks = (int *) malloc(blockCount * sizeof(int));
+	queue->positions = (int *) malloc(blockCount * sizeof(int));
+	queue->keys = (double *) malloc(blockCount * sizeof(double));
+	queue->sequences = (long *) malloc(blockCount * sizeof(long));
+	queue->sequence = blockCount;
+
+	// Equal keys queued in raster order are in heap order already.
+	for (int block = 0; block < blockCount; block++) {
+		queue->blocks[block] = block;
+		queue->positions[block] = block;
+		queue->keys[block] = -HUGE_VAL;
+		queue->sequences[block] = block;
+	}
+
+	return queue;
+}
+
+static void freeBlockQueue(struct blockQueue *queue) {
+
+	free(queue->blocks);
+	free(queue->positions);
+	free(queue->keys);
+	free(queue->sequences);
+	free(queue);
+}
+
+static int isBlockBefore(struct blockQueue *queue, int firstBlock, int secondBlock) {
+
+	double firstKey = queue->keys[firstBlock];
+	double secondKey = queue->keys[secondBlock];
+
+	return firstKey < secondKey || (firstKey == secondKey && queue->sequences[firstBlock] < queue->sequences[secondBlock]);
+}
+
+static void placeQueuedBlock(struct blockQueue *queue, int position, int block) {
+
+	queue->blocks[position] = block;
+	queue->positions[block] = position;
+}
+
+// Moves the block at a heap position up, or down, to its place.
+static void restoreBlockQueue(struct blockQueue *queue, int position) {
+
+	int block = queue->blocks[position];
+
+	while (position > 0 && isBlockBefore(queue, block, queue->blocks[(position - 1) / 2])) {
+		placeQueuedBlock(queue, position, queue->blocks[(position - 1) / 2]);
+		position = (position - 1) / 2;
+	}
+
+	for (;;) {
+		int child = 2 * position + 1;
+		if (child >= queue->count) {
+			break;
+		}
+		if (child + 1 < queue->count && isBlockBefore(queue, queue->blocks[child + 1], queue->blocks[child])) {
+			child++;
+		}
+		if (!isBlockBefore(queue, queue->blocks[child], block)) {
+			break;
+		}
+		placeQueuedBlock(queue, position, queue->blocks[child]);
+		position = child;
+	}
+
+	placeQueuedBlock(queue, position, block);
+}
+
+// Queues a block with the given key, or moves it to the key if it is already queued.
+static void pushBlock(struct blockQueue *queue, int block, double key) {
+
+	queue->keys[block] = key;
+
+	if (queue->positions[block] < 0) {
+		queue->sequences[block] = queue->sequence++;
+		placeQueuedBlock(queue, queue->count++, block);
+	}
+
+	restoreBlockQueue(queue, queue->positions[block]);
+}
+
+static int popBlock(struct blockQueue *queue) {
+
+	int block = queue->blocks[0];
+	queue->positions[block] = -1;
+
+	if (--queue->count > 0) {
+		placeQueuedBlock(queue, 0, queue->blocks[queue->count]);
+		restoreBlockQueue(queue, 0);
+	}
+
+	return block;
+}
+
+// Finds the blocks along one axis with a pixel within borderSize of index on the torus: count blocks from first on,
+// wrapping after the last one. The count never exceeds the block count, so that each block is visited once.
+static void getTouchedBlockRange(int index, int borderSize, int length, int blockSize, int *first, int *count) {
+
+	int blockCount = (length + blockSize - 1) / blockSize;
+	if (2 * borderSize + 1 >= length) {
+		*first = 0;
+		*count = blockCount;
+		return;
+	}
+
+	int start = MOD(index - borderSize, length);
+	int end = start + 2 * borderSize;
+	*first = start / blockSize;
+
+	if (end < length) {
+		*count = end / blockSize - *first + 1;
+	} else {
+		*count = MIN(blockCount - *first + (end - length) / blockSize + 1, blockCount);
+	}
+}
+
+// Queues again the blocks whose Cpe a changed pixel has touched, with their last key, and clears their status, which
+// only records those touches in this order. The range wraps on the torus, as the Cpe update does.
+static void queueTouchedBlocks(struct passContext *context, struct blockQueue *queue, int rowIndex, int columnIndex) {
+
+	struct Config *config = context->config;
+	int borderSize = context->cpp->borderSize;
+
+	int columnBlockCount = (int) ceil((double) context->cpeC->width / (double) config->blockWidth);
+	int rowBlockCount = (int) ceil((double) context->cpeC->height / (double) config->blockHeight);
+
+	int firstRow, rowCount, firstColumn, columnCount;
+	getTouchedBlockRange(rowIndex, borderSize, context->cpeC->height, config->blockHeight, &firstRow, &rowCount);
+	getTouchedBlockRange(columnIndex, borderSize, context->cpeC->width, config->blockWidth, &firstColumn, &columnCount);
+
+	for (int di = 0; di < rowCount; di++) {
+		int i = (firstRow + di) % rowBlockCount;
+		for (int dj = 0; dj < columnCount; dj++) {
+			int j = (firstColumn + dj) % columnBlockCount;
+
+			int block = i * columnBlockCount + j;
+			context->blockStatusMatrix[i][j] = 0;
+
+			if (queue->positions[block] < 0) {
+				pushBlock(queue, block, queue->keys[block]);
+			}
+		}
+	}
+}
+
+// Processes the most promising blocks, until as many blocks as the image holds have been evaluated, or none is left
+// to evaluate. The popped block is evaluated again, since the changes around it may have made its key stale, and
+// leaves the queue with its new key, to come back only when a change touches its footprint.
+static int runBestFirstRoundDBS(struct passContext *context, struct blockQueue *queue) {
+
+    // Capture the time at the beginning of the processing.
+    uint64_t passStart = getTraceTime();
+
+    struct Config *config = context->config;
+
+    int toggleCount = 0;
+    int swapCount = 0;
+    double deltaError = 0.0;
+
+    int columnBlockCount = (int) ceil((double) context->cpeC->width / (double) config->blockWidth);
+    int rowBlockCount = (int) ceil((double) context->cpeC->height / (double) config->blockHeight);
+
+    for (int evaluationCount = 0; evaluationCount < rowBlockCount * columnBlockCount && queue->count > 0; evaluationCount++) {
+
+    	int block = popBlock(queue);
+    	int i = block / columnBlockCount;
+    	int j = block % columnBlockCount;
+
+    	struct blockDecision decision;
+    	evaluateBlock(context, i, j, &decision);
+
+    	queue->keys[block] = MIN(decision.toggleError, decision.swapError);
+
+    	int change[4];
+    	int changeType = getDecisionChange(&decision, change);
+
+    	applyBlockDecision(context, i, j, &decision, &toggleCount, &swapCount, &deltaError);
+
+    	for (int k = 0; k < changeType; k++) {
+    		queueTouchedBlocks(context, queue, change[2 * k], change[2 * k + 1]);
+    	}
+    }
+
+    reportPass(context, toggleCount, swapCount, deltaError, passStart);
+
+    return toggleCount + swapCount;
+}
+
+// Sets the swap window of the next passes of a call from the pass that just ended. A pass that would end the call with
+// a narrowed window doubles its reach instead, up to fullReach, and enables every block again, since their last
+// evaluation missed the swaps out of the window. Any other pass narrows it to the swaps it accepted (see
+// DBS_SWAP_WINDOW_*). Returns 1 if the window was widened.
+static int adaptSwapWindow(struct passContext *context, struct blockQueue *queue, int fullReach, int isConverged) {
+
+	struct Config *config = context->config;
+	struct swapHistogram *histogram = context->passSwapHistogram;
+
+	int reach = getSwapReach(config, context->cpeC->height, context->cpeC->width);
+	int nextReach = reach;
+
+	if (isConverged) {
+		nextReach = MIN(2 * reach, fullReach);
+	}
+	else if (histogram->swapCount >= DBS_SWAP_WINDOW_MIN_SWAP_COUNT) {
+		int percentileReach = getSwapDistancePercentile(histogram, config->swapWindowPercentile) + DBS_SWAP_WINDOW_MARGIN;
+		nextReach = MIN(MAX(percentileReach, DBS_SWAP_WINDOW_MIN_REACH), reach);
+	}
+
+	if (nextReach == reach) {
+		return 0;
+	}
+
+	fprintf(getDesignOutput(), "Swap window: %d -> %d\n", 2 * reach + 1, 2 * nextReach + 1);
+	config->swapSize = 2 * nextReach + 1;
+
+	// The cached swaps were found in the previous window.
+	if (context->swapCache != NULL) {
+		clearSwapCache(context->swapCache);
+	}
+
+	if (nextReach < reach) {
+		return 0;
+	}
+
+	int rowBlockCount = (int) ceil((double) context->cpeC->height / (double) config->blockHeight);
+	int columnBlockCount = (int) ceil((double) context->cpeC->width / (double) config->blockWidth);
+
+	for (int block = 0; block < rowBlockCount * columnBlockCount; block++) {
+
+		if (queue != NULL) {
+			pushBlock(queue, block, -HUGE_VAL);
+		}
+		else {
+			context->blockStatusMatrix[block / columnBlockCount][block % columnBlockCount] = 1;
+		}
+	}
+
+	return 1;
 }
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -198,17 +1699,17 @@ void applySwap_1(struct Config* config, struct pxm_img* halftoneC, struct double
     double a0M = pixelM ? -1.0 : 1.0;
 
     // The main pixel.
-    halftoneC->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0 + pixel);
+    setHalftonePixel(halftoneC, cpeC->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0 + pixel));
     updateCpe(config, cpeC, cpp, blockStatusMatrix, a0, bestChangeRowIndex, bestChangeColumnIndex);
 
-    halftoneM->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0M + pixelM);
+    setHalftonePixel(halftoneM, cpeM->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0M + pixelM));
     updateCpe(config, cpeM, cpp, blockStatusMatrix, a0M, bestChangeRowIndex, bestChangeColumnIndex);
 
     // The target swap pixel.
-    halftoneC->mono[targetSwapRowIndex][targetSwapColumnIndex] = pixel;
+    setHalftonePixel(halftoneC, cpeC->haloSize, targetSwapRowIndex, targetSwapColumnIndex, (uint8_t) pixel);
     updateCpe(config, cpeC, cpp, blockStatusMatrix, -a0, targetSwapRowIndex, targetSwapColumnIndex);
 
-    halftoneM->mono[targetSwapRowIndex][targetSwapColumnIndex] = pixelM;
+    setHalftonePixel(halftoneM, cpeM->haloSize, targetSwapRowIndex, targetSwapColumnIndex, (uint8_t) pixelM);
     updateCpe(config, cpeM, cpp, blockStatusMatrix, -a0M, targetSwapRowIndex, targetSwapColumnIndex);
 }
 
@@ -219,24 +1720,32 @@ double getSwapDeltaErrorInRegion_1(struct Config *config, struct pxm_img *halfto
 		struct pxm_img *halftoneM, struct doubleImage *cpeM, struct doubleImage *cpp,int rowIndex, int columnIndex,
 		int *swapTargetRowIndex, int *swapTargetColumnIndex) {
 
+	if (config->scanKernel != DBS_SCAN_KERNEL_SCALAR) {
+		return scanSwapRegionVectorized(config, config->scanKernel, SWAP_SCAN_RULE_PLANE_SET,
+				halftoneC, cpeC, halftoneM, cpeM, halftoneM, NULL, cpp, rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex);
+	}
+
     int pixel = halftoneC->mono[rowIndex][columnIndex];
     double minDeltaError = 0.0;
 
-	// Integer division
-	int size = config->swapSize / 2;
-	int minRowIndex = rowIndex - size;
-	int maxRowIndex = rowIndex + size;
-	int minColumnIndex = columnIndex - size;
-	int maxColumnIndex = columnIndex + size;
+	// The swap region, clipped to the torus.
+	int minRowIndex, maxRowIndex, minColumnIndex, maxColumnIndex;
+	getSwapWindowRange(config, rowIndex, cpeC->height, &minRowIndex, &maxRowIndex);
+	getSwapWindowRange(config, columnIndex, cpeC->width, &minColumnIndex, &maxColumnIndex);
+
+	// A padded plane holds the whole region, so its indices need no wrapping.
+	int isPadded = cpeC->haloSize > 0;
+	int rowMask = getWrapMask(cpeC->height);
+	int columnMask = getWrapMask(cpeC->width);
 
 	// Find the best delta error in the swap region.
 	// The loop indices are those of the block pixels.
     for (int i = minRowIndex; i <= maxRowIndex; i++) {
-        for (int j = minColumnIndex; j <= maxColumnIndex; j++) {
+        int targetRowIndex = isPadded ? i : WRAP(i, cpeC->height, rowMask);
 
+        for (int j = minColumnIndex; j <= maxColumnIndex; j++) {
 
-			int targetRowIndex = MOD(i, cpeC->height);
-			int targetColumnIndex = MOD(j, cpeC->width);
+			int targetColumnIndex = isPadded ? j : WRAP(j, cpeC->width, columnMask);
 
 			if (halftoneM->mono[targetRowIndex][targetColumnIndex]==1){
 				int cppRowIndex = abs(i - rowIndex);
@@ -249,8 +1758,8 @@ double getSwapDeltaErrorInRegion_1(struct Config *config, struct pxm_img *halfto
 				double deltaError = deltaErrorC + deltaErrorM;
 
 				if (deltaError < minDeltaError){
-					*swapTargetRowIndex = targetRowIndex;
-					*swapTargetColumnIndex = targetColumnIndex;
+					*swapTargetRowIndex = MOD(targetRowIndex, cpeC->height);
+					*swapTargetColumnIndex = MOD(targetColumnIndex, cpeC->width);
 
 					minDeltaError = deltaError;
 				}
@@ -324,12 +1833,12 @@ void applySwap_2(struct Config* config, struct pxm_img* halftone, struct doubleI
     double a0 = pixel ? -1.0 : 1.0;
 
     // The main pixel.
-    halftone->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0 + pixel);
+    setHalftonePixel(halftone, cpe->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0 + pixel));
 
     updateCpe(config, cpe, cpp, blockStatusMatrix, a0, bestChangeRowIndex, bestChangeColumnIndex);
 
     // The target swap pixel.
-    halftone->mono[targetSwapRowIndex][targetSwapColumnIndex] = pixel;
+    setHalftonePixel(halftone, cpe->haloSize, targetSwapRowIndex, targetSwapColumnIndex, (uint8_t) pixel);
     updateCpe(config, cpe, cpp, blockStatusMatrix, -a0, targetSwapRowIndex, targetSwapColumnIndex);
 }
 
@@ -337,23 +1846,32 @@ void applySwap_2(struct Config* config, struct pxm_img* halftone, struct doubleI
 double getSwapDeltaErrorInRegion_2(struct Config *config, struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp,
     int rowIndex, int columnIndex, int *swapTargetRowIndex, int *swapTargetColumnIndex) {
 
+	if (config->scanKernel != DBS_SCAN_KERNEL_SCALAR) {
+		return scanSwapRegionVectorized(config, config->scanKernel, SWAP_SCAN_RULE_DIFFERENT_FROM_SOURCE,
+				halftone, cpe, NULL, NULL, halftone, NULL, cpp, rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex);
+	}
+
     int pixel = halftone->mono[rowIndex][columnIndex];
     double minDeltaError = 0.0;
 
-	// Integer division
-	int size = config->swapSize / 2;
-	int minRowIndex = rowIndex - size;
-	int maxRowIndex = rowIndex + size;
-	int minColumnIndex = columnIndex - size;
-	int maxColumnIndex = columnIndex + size;
+	// The swap region, clipped to the torus.
+	int minRowIndex, maxRowIndex, minColumnIndex, maxColumnIndex;
+	getSwapWindowRange(config, rowIndex, cpe->height, &minRowIndex, &maxRowIndex);
+	getSwapWindowRange(config, columnIndex, cpe->width, &minColumnIndex, &maxColumnIndex);
+
+	// A padded plane holds the whole region, so its indices need no wrapping.
+	int isPadded = cpe->haloSize > 0;
+	int rowMask = getWrapMask(cpe->height);
+	int columnMask = getWrapMask(cpe->width);
 
 	// Find the best delta error in the swap region.
 	// The loop indices are those of the block pixels.
     for (int i = minRowIndex; i <= maxRowIndex; i++) {
+        int targetRowIndex = isPadded ? i : WRAP(i, cpe->height, rowMask);
+
         for (int j = minColumnIndex; j <= maxColumnIndex; j++) {
 
-			int targetRowIndex = MOD(i, cpe->height);
-			int targetColumnIndex = MOD(j, cpe->width);
+			int targetColumnIndex = isPadded ? j : WRAP(j, cpe->width, columnMask);
 
         	// No need to work with pixels of the same value as the anchor.
             if (halftone->mono[targetRowIndex][targetColumnIndex] == pixel) continue;
@@ -368,8 +1886,8 @@ double getSwapDeltaErrorInRegion_2(struct Config *config, struct pxm_img *halfto
 
 			if (deltaError < minDeltaError) {
 
-                *swapTargetRowIndex = targetRowIndex;
-                *swapTargetColumnIndex = targetColumnIndex;
+                *swapTargetRowIndex = MOD(targetRowIndex, cpe->height);
+                *swapTargetColumnIndex = MOD(targetColumnIndex, cpe->width);
 
                 minDeltaError = deltaError;
             }
@@ -444,17 +1962,17 @@ void applySwap_3(struct Config* config, struct pxm_img* halftoneC, struct double
     double a0M = pixelM ? -1.0 : 1.0;
 
     // The main pixel.
-    halftoneC->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0 + pixel);
+    setHalftonePixel(halftoneC, cpeC->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0 + pixel));
     updateCpe(config, cpeC, cpp, blockStatusMatrix, a0, bestChangeRowIndex, bestChangeColumnIndex);
 
-    halftoneM->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0M + pixelM);
+    setHalftonePixel(halftoneM, cpeM->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0M + pixelM));
     updateCpe(config, cpeM, cpp, blockStatusMatrix, a0M, bestChangeRowIndex, bestChangeColumnIndex);
 
     // The target swap pixel.
-    halftoneC->mono[targetSwapRowIndex][targetSwapColumnIndex] = pixel;
+    setHalftonePixel(halftoneC, cpeC->haloSize, targetSwapRowIndex, targetSwapColumnIndex, (uint8_t) pixel);
     updateCpe(config, cpeC, cpp, blockStatusMatrix, -a0, targetSwapRowIndex, targetSwapColumnIndex);
 
-    halftoneM->mono[targetSwapRowIndex][targetSwapColumnIndex] = pixelM;
+    setHalftonePixel(halftoneM, cpeM->haloSize, targetSwapRowIndex, targetSwapColumnIndex, (uint8_t) pixelM);
     updateCpe(config, cpeM, cpp, blockStatusMatrix, -a0M, targetSwapRowIndex, targetSwapColumnIndex);
 }
 
@@ -465,24 +1983,32 @@ double getSwapDeltaErrorInRegion_3(struct Config *config, struct pxm_img *halfto
 		struct pxm_img *halftoneM, struct doubleImage *cpeM, struct doubleImage *cpp,int rowIndex, int columnIndex,
 		int *swapTargetRowIndex, int *swapTargetColumnIndex, struct pxm_img *beforeC, struct pxm_img *beforeM ) {
 
+	if (config->scanKernel != DBS_SCAN_KERNEL_SCALAR) {
+		return scanSwapRegionVectorized(config, config->scanKernel, SWAP_SCAN_RULE_DIFFERENT_FROM_BEFORE,
+				halftoneC, cpeC, halftoneM, cpeM, halftoneM, beforeM, cpp, rowIndex, columnIndex, swapTargetRowIndex, swapTargetColumnIndex);
+	}
+
     int pixel = halftoneC->mono[rowIndex][columnIndex];
     double minDeltaError = 0.0;
 
-	// Integer division
-	int size = config->swapSize / 2;
-	int minRowIndex = rowIndex - size;
-	int maxRowIndex = rowIndex + size;
-	int minColumnIndex = columnIndex - size;
-	int maxColumnIndex = columnIndex + size;
+	// The swap region, clipped to the torus.
+	int minRowIndex, maxRowIndex, minColumnIndex, maxColumnIndex;
+	getSwapWindowRange(config, rowIndex, cpeC->height, &minRowIndex, &maxRowIndex);
+	getSwapWindowRange(config, columnIndex, cpeC->width, &minColumnIndex, &maxColumnIndex);
+
+	// A padded plane holds the whole region, so its indices need no wrapping.
+	int isPadded = cpeC->haloSize > 0;
+	int rowMask = getWrapMask(cpeC->height);
+	int columnMask = getWrapMask(cpeC->width);
 
 	// Find the best delta error in the swap region.
 	// The loop indices are those of the block pixels.
     for (int i = minRowIndex; i <= maxRowIndex; i++) {
-        for (int j = minColumnIndex; j <= maxColumnIndex; j++) {
+        int targetRowIndex = isPadded ? i : WRAP(i, cpeC->height, rowMask);
 
+        for (int j = minColumnIndex; j <= maxColumnIndex; j++) {
 
-			int targetRowIndex = MOD(i, cpeC->height);
-			int targetColumnIndex = MOD(j, cpeC->width);
+			int targetColumnIndex = isPadded ? j : WRAP(j, cpeC->width, columnMask);
 
 			if (halftoneM->mono[targetRowIndex][targetColumnIndex]!=beforeM->mono[targetRowIndex][targetColumnIndex]){
 				int cppRowIndex = abs(i - rowIndex);
@@ -495,8 +2021,8 @@ double getSwapDeltaErrorInRegion_3(struct Config *config, struct pxm_img *halfto
 				double deltaError = deltaErrorC + deltaErrorM;
 
 				if (deltaError < minDeltaError){
-					*swapTargetRowIndex = targetRowIndex;
-					*swapTargetColumnIndex = targetColumnIndex;
+					*swapTargetRowIndex = MOD(targetRowIndex, cpeC->height);
+					*swapTargetColumnIndex = MOD(targetColumnIndex, cpeC->width);
 
 					minDeltaError = deltaError;
 				}
@@ -553,26 +2079,48 @@ double getBestSwapInBlock_3(struct Config *config, struct pxm_img *halftoneC, st
 
 // generate matrix
 
+// Returns the number of dots of a binary halftone. The rows are read once, so a plain byte loop beats packing them.
+static long countSetPixels(struct pxm_img *halftone) {
+
+	long count = 0;
+
+	for (int i = 0; i < halftone->height; i++) {
+		uint8_t *row = halftone->mono[i];
+		for (int j = 0; j < halftone->width; j++) {
+			count += row[j] == 1;
+		}
+	}
+
+	return count;
+}
+
+// Writes differ = 1 where the binary halftones differ and 0 elsewhere.
+static void writeDifference(struct pxm_img *halftone, struct pxm_img *before, struct pxm_img *differ) {
+
+	for (int i = 0; i < halftone->height; i++) {
+		for (int j = 0; j < halftone->width; j++) {
+			differ->mono[i][j] = (halftone->mono[i][j] == 1) != (before->mono[i][j] == 1);
+		}
+	}
+}
+
 struct pxm_img* mergePattern(struct pxm_img *differ,struct pxm_img *halftone, double ratio)
 {
-	int count = 0;
 	int count_2 = 0;
 
-	for (int i = 0; i < differ->height; i++) {
-		for (int j = 0; j < differ->width; j++){
-			if (differ->mono[i][j] == 1){
-				count ++;
-			}
-		}
-	}
-	double movDot = ceil(count*ratio);
+	double movDot = ceil(countSetPixels(differ)*ratio);
 
-	for (int i =0; i <halftone->height; i++){
-		for (int j = 0; j<halftone->width; j++){
-			if (differ->mono[i][j] == 1 && count_2<movDot){
+	// Move the first movDot dots of differ, in raster order, visiting only the words that hold dots.
+	for (int i =0; i <halftone->height && count_2<movDot; i++){
+		for (int j = 0; j<halftone->width && count_2<movDot; j += 64){
+
+			uint64_t dots = packPixels(differ->mono[i] + j, MIN(64, halftone->width - j));
+
+			for (; dots != 0 && count_2<movDot; dots &= dots - 1) {
 
-				halftone->mono[i][j] = 1;
-				differ->mono[i][j] = 0;
+				int k = j + __builtin_ctzll(dots);
+				halftone->mono[i][k] = 1;
+				differ->mono[i][k] = 0;
 
 				count_2++;
 			}
@@ -584,22 +2132,7 @@ struct pxm_img* mergePattern(struct pxm_img *differ,struct pxm_img *halftone, do
 
 struct pxm_img* combineDiffer(struct pxm_img *halftone, struct pxm_img *before, struct pxm_img *differ)
 {
-	int count = 0;
-	//double randVal;
-
-	for (int i =0; i <halftone->height; i++){
-		for (int j = 0; j<halftone->width; j++){
-			if (halftone->mono[i][j] != before->mono[i][j]){
-
-				differ->mono[i][j] = 1;
-				count++;
-			}
-			else {
-				differ->mono[i][j] = 0;
-				count++;
-			}
-		}
-	}
+	writeDifference(halftone, before, differ);
 
 	return differ;
 }
@@ -610,22 +2143,7 @@ struct pxm_img* combineDiffer(struct pxm_img *halftone, struct pxm_img *before,
 
 struct pxm_img* findDifference(struct pxm_img *halftone, struct pxm_img *before, struct pxm_img *differ)
 {
-	int count = 0;
-	//double randVal;
-
-	for (int i =0; i <halftone->height; i++){
-		for (int j = 0; j<halftone->width; j++){
-			if (halftone->mono[i][j] != before->mono[i][j]){
-
-				differ->mono[i][j] = 1;
-				count++;
-			}
-			else {
-				differ->mono[i][j] = 0;
-				count++;
-			}
-		}
-	}
+	writeDifference(halftone, before, differ);
 
 	return differ;
 }
@@ -633,7 +2151,8 @@ struct pxm_img* findDifference(struct pxm_img *halftone, struct pxm_img *before,
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct pxm_img *halftoneM, double Cratio, double Mratio){
+void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct pxm_img *halftoneM, double Cratio, double Mratio,
+		struct randomStream *random){
 	long count =0,count_1 = 0,count_2 = 0, randVal ;
 
 	for (int i = 0; i < halftoneCM->height; i++) {
@@ -645,13 +2164,12 @@ void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct px
 	}
 
 
-	srand((unsigned) time(NULL));
 	for (int i = 0; i < halftoneCM->height; i++) {
 		for (int j = 0; j < halftoneCM->width; j++)
 		{
 			if (halftoneCM->mono[i][j] == 1)
 			{
-				randVal = rand() %100;
+				randVal = getRandomBelow(random, 100);
 				if (count_1 < (count*Cratio) && count_2 < (count*Mratio)){
 					if (randVal > 50){
 						halftoneM->mono[i][j] = 1;
@@ -689,19 +2207,98 @@ void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct px
 	}
 }
 
+// Finds the candidate of row i of the highest a0 x cpe, the first one for equal values. Returns its column, or -1 if the
+// row has no pixel of the given value.
+static int getBestToggleInRow(struct pxm_img *halftone, struct doubleImage *cpe, uint8_t value, double a0, int i) {
+
+	int bestColumnIndex = -1;
+
+	for (int j = 0; j < halftone->width; j++) {
+		if (halftone->mono[i][j] == value &&
+			(bestColumnIndex < 0 || a0 * cpe->data[i][j] > a0 * cpe->data[i][bestColumnIndex])) {
+			bestColumnIndex = j;
+		}
+	}
+
+	return bestColumnIndex;
+}
+
+// Toggles count pixels of the given value (1 removes dots, 0 adds them), one at a time, each where the toggle lowers
+// the filtered error of the halftone against its own mean tone the most: the dot of the most negative cpe (in the
+// tightest cluster) or the hole of the largest cpe (in the largest void), as in void and cluster. The cpe is updated
+// after every toggle, and so is the best candidate of the rows it reaches. Pixels of the same cpe go in raster order.
+static void toggleDotsByError(struct Config *config, struct pxm_img *halftone, uint8_t value, int count,
+		struct doubleImage *cpp) {
+
+	struct doubleImage *inputImage = generateCTImage(halftone);
+	struct doubleImage *cpe = calculateCpe(config, inputImage, halftone, cpp);
+
+	// Toggling a dot off (a0 = -1) changes the error by 2 cpe + Cpp(0), and a hole on (a0 = 1) by -2 cpe + Cpp(0).
+	double a0 = value ? -1.0 : 1.0;
+
+	int *bestColumns = (int *) malloc(halftone->height * sizeof(int));
+	for (int i = 0; i < halftone->height; i++) {
+		bestColumns[i] = getBestToggleInRow(halftone, cpe, value, a0, i);
+	}
+
+	// The rows that a change reaches, once each.
+	int reach = MIN(cpp->borderSize, (halftone->height - 1) / 2);
+
+	for (int k = 0; k < count; k++) {
+
+		int bestRowIndex = -1;
+
+		for (int i = 0; i < halftone->height; i++) {
+
+			int j = bestColumns[i];
+			if (j >= 0 && (bestRowIndex < 0 ||
+				a0 * cpe->data[i][j] > a0 * cpe->data[bestRowIndex][bestColumns[bestRowIndex]])) {
+				bestRowIndex = i;
+			}
+		}
+
+		if (bestRowIndex < 0) {
+			break;
+		}
+
+		int bestColumnIndex = bestColumns[bestRowIndex];
+		halftone->mono[bestRowIndex][bestColumnIndex] = (uint8_t) !value;
+		addCppToCpe(cpe, cpp, a0, bestRowIndex, bestColumnIndex);
+
+		for (int iCpp = -reach; iCpp <= reach; iCpp++) {
+
+			int i = MOD(bestRowIndex + iCpp, halftone->height);
+			bestColumns[i] = getBestToggleInRow(halftone, cpe, value, a0, i);
+		}
+	}
+
+	free(bestColumns);
+	deallocateImage(cpe);
+	deallocateImage(inputImage);
+}
+
 // remove dots
-struct pxm_img* removeDots(struct pxm_img *halftone, unsigned int changelines, int modNum, int MatrixSize, int MaxLevel, int screenNum)
+struct pxm_img* removeDots(struct Config *config, struct pxm_img *halftone, unsigned int changelines, int modNum,
+		int MatrixSize, int MaxLevel, int screenNum, struct doubleImage *cpp)
 {
+	TRACE_START(dotsStart);
 	int count = 0;
 	//double randVal;
 
 	double movNum = floor(MatrixSize*MatrixSize/MaxLevel);
-	printf("movNum is %.5f\n", movNum);
+	fprintf(getDesignOutput(), "movNum is %.5f\n", movNum);
 
 	if (MOD(changelines , modNum) == 0){
 		movNum = movNum + screenNum;
 	}
 
+	if (config->dotSelectionMode == DBS_DOT_SELECTION_ERROR) {
+		toggleDotsByError(config, halftone, 1, (int) movNum, cpp);
+
+		TRACE_PHASE(TRACE_PHASE_DOTS, dotsStart);
+		return halftone;
+	}
+
 	for (int i =0; i <halftone->height; i++){
 		for (int j = 0; j<halftone->width; j++){
 			if (halftone->mono[i][j] == 1 && count<movNum ){
@@ -712,23 +2309,31 @@ struct pxm_img* removeDots(struct pxm_img *halftone, unsigned int changelines, i
 		}
 	}
 
-
+	TRACE_PHASE(TRACE_PHASE_DOTS, dotsStart);
 	return halftone;
 }
 // Add dots
 
-struct pxm_img* addDots(struct pxm_img *halftone, int changeline, int modNum, int MatrixSize, int MaxLevel)
+struct pxm_img* addDots(struct Config *config, struct pxm_img *halftone, int changeline, int modNum, int MatrixSize,
+		int MaxLevel, struct doubleImage *cpp)
 {
+	TRACE_START(dotsStart);
 	double count = 0;
 
 	double movNum = floor(MatrixSize*MatrixSize/MaxLevel);
-	printf("movNum is %.5f\n", movNum);
+	fprintf(getDesignOutput(), "movNum is %.5f\n", movNum);
 
 	if (MOD(changeline , modNum) == 0){
 			movNum = movNum +1;
 		}
 	//srand(randomizationSeed);
 
+	if (config->dotSelectionMode == DBS_DOT_SELECTION_ERROR) {
+		toggleDotsByError(config, halftone, 0, (int) movNum, cpp);
+
+		TRACE_PHASE(TRACE_PHASE_DOTS, dotsStart);
+		return halftone;
+	}
 
 	for (int i =0; i <halftone->height; i++){
 		for (int j = 0; j<halftone->width; j++){
@@ -739,6 +2344,7 @@ struct pxm_img* addDots(struct pxm_img *halftone, int changeline, int modNum, in
 		}
 	}
 
+	TRACE_PHASE(TRACE_PHASE_DOTS, dotsStart);
 	return halftone;
 }
 
@@ -790,41 +2396,19 @@ struct pxm_img* addDots(struct pxm_img *halftoneC, struct pxm_img *halftone, int
 
 double countNum(struct pxm_img *halftone){
 
-	double count = 0;
-	for(int i = 0; i<halftone->height; i++){
-		for(int j = 0; j<halftone->width; j++){
-			if(halftone->mono[i][j] == 1){
-				count++;
-				}
-			}
-		}
-
-	return count;
-
+	return (double) countSetPixels(halftone);
 }
 
 // generate C-T image based on the absorptance
 
 struct doubleImage* generateCTImage(struct pxm_img *halftone) {
 
+	return generateCTImageInto(halftone, createImage(halftone->height, halftone->width, 0, 0));
+}
 
-	int count = 0;
-
-	struct doubleImage *inputImage = (struct doubleImage *)multialloc(sizeof(struct doubleImage),1, 1);
-	inputImage->height = halftone->height;
-	inputImage->width = halftone->width;
-	inputImage->borderSize = 0;
-	inputImage->data = (double **) multialloc(sizeof(double), 2, inputImage->height, inputImage->width);
-
-	for(int i = 0; i<halftone->height; i++){
-		for(int j = 0; j<halftone->width; j++){
-			if(halftone->mono[i][j]==1){
-				count = count++;
-
-			}
-		}
-	}
+struct doubleImage* generateCTImageInto(struct pxm_img *halftone, struct doubleImage *inputImage) {
 
+	long count = countSetPixels(halftone);
 
 	double absorptance = (double) count/(halftone->height*halftone->width);
 	//printf("ab = %.5f \n", absorptance);
@@ -843,10 +2427,7 @@ struct doubleImage* generateCTImage(struct pxm_img *halftone) {
 
 // Allocate matrix
 struct doubleImage *AllocateMatrix(int MatrixSize){
-	struct doubleImage *matrix = (struct doubleImage *)multialloc(sizeof(struct doubleImage),1,1);
-	matrix->height = MatrixSize;
-	matrix->width = MatrixSize;
-	matrix->data = (double **)multialloc(sizeof(double),2, MatrixSize, MatrixSize);
+	struct doubleImage *matrix = createImage(MatrixSize, MatrixSize, 0, 0);
 
 	printf("Matrix (height, width) is (%d, %d)\n", matrix->height, matrix->width);
 
@@ -864,53 +2445,84 @@ struct doubleImage *AllocateMatrix(int MatrixSize){
 
 void updateMatrix(struct pxm_img *halftone, struct doubleImage *matrix, double currentlevel, double levelIndex, struct pxm_img* before){
 
+	TRACE_START(matrixStart);
+
+	// Visit only the pixels that changed since before (levelIndex 1), or the dots of the halftone, 64 at a time.
 	for(int i = 0 ; i < halftone->height; i++){
-		for (int j = 0; j< halftone->width; j++){
+		for (int j = 0; j< halftone->width; j += 64){
+
+			int count = MIN(64, halftone->width - j);
+			uint64_t pixels = packPixels(halftone->mono[i] + j, count);
 
 			if (levelIndex == 1 ){
-				if (halftone->mono[i][j] != before->mono[i][j] ){
-					matrix->data[i][j] = (double)(currentlevel );
-				}
+				pixels ^= packPixels(before->mono[i] + j, count);
 			}
-			else{
-				if (halftone->mono[i][j] == 1){
-					matrix->data[i][j] = (double)(currentlevel);
-				}
+
+			for (; pixels != 0; pixels &= pixels - 1) {
+				matrix->data[i][j + __builtin_ctzll(pixels)] = (double)(currentlevel);
 			}
 		}
 	}
+
+	TRACE_PHASE(TRACE_PHASE_MATRIX_OUTPUT, matrixStart);
 }
 
 
 // Write out Matrix
-void writeMatrix(struct doubleImage *matrix, char *outputMatrixPath){
+// Returns 0, or -1 if the matrix could not be written.
+int writeMatrix(struct doubleImage *matrix, char *outputMatrixPath){
 	char outfile[100];
 	sprintf(outfile, "%s", outputMatrixPath);
 	FILE *fp =fopen(outfile, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "cannot write the matrix file %s\n", outputMatrixPath);
+		return -1;
+	}
 	for (int i = 0; i < matrix->height; i++){
 		for (int j = 0; j < matrix->width; j++){
 			fprintf(fp, "%u\t", (unsigned int)matrix->data[i][j]);
 		}
 		fprintf(fp,"\n");
 	}
-	fclose(fp);
+	int isFailed = ferror(fp);
+	if (fclose(fp) != 0 || isFailed) {
+		fprintf(stderr, "cannot write the matrix file %s\n", outputMatrixPath);
+		return -1;
+	}
+	return 0;
 }
 
 
 //difine a same halftone pattern
 struct pxm_img* samepattern(struct pxm_img *halftone)
 {
-	struct pxm_img *samepattern = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
+	return samepatternInto(halftone, createHalftone(halftone->height, halftone->width));
+}
+
+struct pxm_img* createHalftone(int height, int width) {
+
+	struct pxm_img *halftone = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
+
+	halftone->height = height;
+	halftone->width = width;
+	halftone->pxm_type = 'g';
+	halftone->mono = (uint8_t **) get_img(width, height, sizeof(uint8_t));
+
+	return halftone;
+}
+
+double getElapsedSeconds(struct timespec *start) {
 
-	samepattern->height = halftone->height;
-	samepattern->width = halftone->width;
-	samepattern->pxm_type = 'g';
-	samepattern->mono = (uint8_t **) get_img(samepattern->width, samepattern->height, sizeof(uint8_t));
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
 
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+struct pxm_img* samepatternInto(struct pxm_img *halftone, struct pxm_img *samepattern)
+{
 	for(int i = 0; i < samepattern->height; i++){
-		for (int j = 0; j < samepattern->width; j++){
-			samepattern->mono[i][j] = halftone->mono[i][j];
-		}
+		memcpy(samepattern->mono[i], halftone->mono[i], samepattern->width * sizeof(uint8_t));
 	}
 	return samepattern;
 }
@@ -956,6 +2568,45 @@ void neighboringLevels(double currentlevel, struct doubleImage *matrix, double *
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+// Returns the mask that wraps an index onto [0, length) with WRAP, which is length - 1 for a power of two and -1
+// (use MOD) otherwise.
+int getWrapMask(int length) {
+
+	return ((length & (length - 1)) == 0) ? length - 1 : -1;
+}
+
+// Returns how far from its source a swap target can be, along either dimension (0 when swapping is disabled).
+int getSwapReach(struct Config *config, int height, int width) {
+
+	if (!config->enableSwap) {
+		return 0;
+	}
+
+	int firstRow, lastRow, firstColumn, lastColumn;
+	getSwapWindowRange(config, 0, height, &firstRow, &lastRow);
+	getSwapWindowRange(config, 0, width, &firstColumn, &lastColumn);
+
+	return MAX(MAX(-firstRow, lastRow), MAX(-firstColumn, lastColumn));
+}
+
+// Returns the first and the last (unwrapped) index of the swap region around centerIndex, along a dimension of the given
+// length. A region wider than the torus would score some pixels twice, once from each side and with different Cpp
+// terms, so it is clipped to length positions around the center instead.
+void getSwapWindowRange(struct Config *config, int centerIndex, int length, int *firstIndex, int *lastIndex) {
+
+	// Integer division
+	int size = config->swapSize / 2;
+
+	if (2 * size + 1 > length) {
+		*firstIndex = centerIndex - length / 2;
+		*lastIndex = *firstIndex + length - 1;
+	}
+	else {
+		*firstIndex = centerIndex - size;
+		*lastIndex = centerIndex + size;
+	}
+}
+
 // Evaluates and returns the delta error caused by swapping a source pixel with a target pixel.
 double getSwapDeltaError(struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp,
 	int sourceRowIndex, int sourceColumnIndex, int targetRowIndex, int targetColumnIndex, int cppRowIndex, int cppColumnIndex) {
@@ -992,7 +2643,7 @@ void applyToggle(struct Config* config, struct pxm_img* halftone, struct doubleI
     int pixel = halftone->mono[bestChangeRowIndex][bestChangeColumnIndex];
     double a0 = pixel ? -1.0 : 1.0;
 
-    halftone->mono[bestChangeRowIndex][bestChangeColumnIndex] = (uint8_t) (a0 + pixel);
+    setHalftonePixel(halftone, cpe->haloSize, bestChangeRowIndex, bestChangeColumnIndex, (uint8_t) (a0 + pixel));
 
     updateCpe(config, cpe, cpp, blockStatusMatrix, a0, bestChangeRowIndex, bestChangeColumnIndex);
 }
@@ -1050,19 +2701,33 @@ double getBestToggleInBlock(struct Config *config, struct pxm_img *halftone, str
 
 
 
+// Subtracts a0 x Cpp, centered at rowIndex, columnIndex, from the Cpe matrix, wrapping around its edges.
+static void addCppToCpe(struct doubleImage *cpe, struct doubleImage *cpp, double a0, int rowIndex, int columnIndex) {
+
+    if (cpe->haloSize > 0) {
+    	updatePaddedCpe(cpe, cpp, a0, rowIndex, columnIndex);
+    }
+    else {
+    	int rowMask = getWrapMask(cpe->height);
+    	int columnMask = getWrapMask(cpe->width);
+
+		for (int iCpp = -cpp->borderSize; iCpp <= cpp->borderSize; iCpp++) {
+			for (int jCpp = -cpp->borderSize; jCpp <= cpp->borderSize; jCpp++) {
+
+				int cpeRowIndex = WRAP(rowIndex + iCpp, cpe->height, rowMask);
+				int cpeColumnIndex = WRAP(columnIndex + jCpp, cpe->width, columnMask);
+				cpe->data[cpeRowIndex][cpeColumnIndex] -= a0 * cpp->data[iCpp][jCpp];
+			}
+		}
+    }
+}
+
 // Updates the Cpe matrix by adding/subtracting Cpp centered at the desired rowIndex, columnIndex, and then enables
 // any block that may have been disabled.
 void updateCpe(struct Config *config, struct doubleImage *cpe, struct doubleImage *cpp, uint8_t **blockStatusMatrix,
 			   double a0, int rowIndex, int columnIndex) {
 
-    for (int iCpp = -cpp->borderSize; iCpp <= cpp->borderSize; iCpp++) {
-        for (int jCpp = -cpp->borderSize; jCpp <= cpp->borderSize; jCpp++) {
-
-            int cpeRowIndex = MOD(rowIndex + iCpp, cpe->height);
-            int cpeColumnIndex = MOD(columnIndex + jCpp, cpe->width);
-			cpe->data[cpeRowIndex][cpeColumnIndex] -= a0 * cpp->data[iCpp][jCpp];
-        }
-    }
+    addCppToCpe(cpe, cpp, a0, rowIndex, columnIndex);
 
     // Enable blocks that have been touched by this change.
 	int maxRowBlockCount = cpe->height / config->blockHeight;
@@ -1086,8 +2751,8 @@ void updateCpe(struct Config *config, struct doubleImage *cpe, struct doubleImag
 }
 
 // Reads the image from the given path (.pxm and .tif), if present, allocates and returns a pxm image, which is an integer image.
-// If the image does not exit, we generate a random image.
-struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputImage, double maxGrayValue, unsigned int randomizationSeed) {
+// If the image does not exit, we generate a random image from the given stream.
+struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputImage, double maxGrayValue, struct randomStream *random) {
     
     struct pxm_img *halftone = (struct pxm_img*) multialloc(sizeof(struct pxm_img), 1, 1);
 
@@ -1109,14 +2774,11 @@ struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputIma
         return halftone;
     }
 
-    // Setup the randomization seed.
-    srand(randomizationSeed);
-
     // If image path is not provided create and return a random halftone.	
     for (int i = 0; i < halftone->height; i++) {
         for (int j = 0; j < halftone->width; j++) {
 
-            double randomNumber = (double) rand() / (double) RAND_MAX;
+            double randomNumber = getRandomUniform(random);
             double absorptance = inputImage->data[i][j];
 
             if (randomNumber <= absorptance)
@@ -1129,8 +2791,8 @@ struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputIma
     return halftone;
 }
 
-// Save halftone image to disk.
-void writeHalftoneImage(struct pxm_img *halftone, char *imagePath) {
+// Save halftone image to disk. Returns 0, or -1 if it could not be written.
+int writeHalftoneImage(struct pxm_img *halftone, char *imagePath) {
     FILE * file;
     TIFF_img tiffImage;
 
@@ -1164,16 +2826,20 @@ void writeHalftoneImage(struct pxm_img *halftone, char *imagePath) {
         file = fopen(imagePath, "w");
         if (file == NULL) {
             fprintf(stderr, "\nCan't write to file - %s\n", imagePath);
+            free_pxm(targetHalftone);
+            return -1;
         }
 
+        int status = 0;
         if (write_pxm(file, targetHalftone)) {
             fprintf(stderr, "\nCan't write pbm to file-%s\n", imagePath);
+            status = -1;
         }
 
         free_pxm(targetHalftone);
 
         fclose(file);
-        return;
+        return status;
     }
 
     // If tiff is required, we will need to convert.
@@ -1194,31 +2860,76 @@ void writeHalftoneImage(struct pxm_img *halftone, char *imagePath) {
     }
 
     /* Write out halftone image */
+    int status = 0;
     if (write_TIFF(imagePath, &tiffImage)) {
         fprintf(stderr, "error writing TIFF file %s\n", imagePath);
-        exit(1);
+        status = -1;
     }
 
     free_pxm(targetHalftone);
     free_TIFF(&tiffImage);
+
+    return status;
+}
+
+// Convolves the error image with Cpp into cpe, with the method chosen by the configuration.
+static void convolveErrorImage(struct Config *config, struct doubleImage *errorImage, struct doubleImage *cpp, struct doubleImage *cpe) {
+
+    if (chooseConvolutionMethod(config, errorImage, cpp) == DBS_CONVOLUTION_FFT) {
+
+    	convolveFftInto(errorImage, cpp, cpe);
+
+    	// Fall back to the direct convolution if the sampled pixels disagree with the FFT result.
+    	if (config->fftCheckSampleCount > 0) {
+
+    		double error = checkConvolutionAccuracy(errorImage, cpp, cpe, config->fftCheckSampleCount);
+    		if (error > DBS_FFT_TOLERANCE) {
+
+    			fprintf(stderr, "FFT convolution failed the accuracy check (relative error %g), using the direct convolution.\n", error);
+    			convolveInto(errorImage, cpp, cpe);
+    		}
+    	}
+    } else {
+    	convolveInto(errorImage, cpp, cpe);
+    }
 }
 
 // Calculate the filtered error between the input image and the halftone.
-struct doubleImage* calculateCpe(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage* cpp) {
+struct doubleImage* calculateCpe(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage* cpp) {
 
+    TRACE_START(cpeStart);
     struct doubleImage *errorImage = calculateErrorImage(inputImage, halftone);
+    struct doubleImage *cpe = createImage(inputImage->height, inputImage->width, 0, 0);
 
-    struct doubleImage *cpe = convolve(errorImage, cpp);
+    convolveErrorImage(config, errorImage, cpp, cpe);
 
     // Clean up.
-    multifree((double *) errorImage->data, 2);
-    free(errorImage);
+    deallocateImage(errorImage);
 
+    TRACE_PHASE(TRACE_PHASE_CPE, cpeStart);
     return cpe;
 }
 
-// Calculates the RMS error between the input image and the halftone.
-double calculateRmsError(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp) {
+struct doubleImage* calculateCpeInto(struct Config *config, struct levelArena *arena, struct doubleImage *inputImage, struct pxm_img *halftone,
+		struct doubleImage *cpp, struct doubleImage *cpe) {
+
+    TRACE_START(cpeStart);
+
+    // The error image only lives until the convolution is done.
+    struct arenaMark mark = getLevelArenaMark(arena);
+    struct doubleImage *errorImage = createArenaImage(arena, inputImage->height, inputImage->width);
+
+    calculateErrorImageInto(inputImage, halftone, errorImage);
+    convolveErrorImage(config, errorImage, cpp, cpe);
+
+    rewindLevelArena(arena, mark);
+
+    TRACE_PHASE(TRACE_PHASE_CPE, cpeStart);
+    return cpe;
+}
+
+// Calculates the total error between the input image and the halftone, i.e. the sum of cpe x error image.
+double calculateTotalError(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *cpe) {
 
 	double error = 0.0;
 
@@ -1226,60 +2937,78 @@ double calculateRmsError(struct doubleImage *inputImage, struct pxm_img *halfton
 	struct doubleImage *errorImage = calculateErrorImage(inputImage, halftone);
 
 	for (int i = 0; i < cpe->height; i++) {
+
+		dbsReal *cpeRow = IMAGE_ROW(cpe, i);
+		dbsReal *errorRow = IMAGE_ROW(errorImage, i);
+
 		for (int j = 0; j < cpe->width; j++) {
-			
-			error += cpe->data[i][j] * errorImage->data[i][j];
+			error += cpeRow[j] * errorRow[j];
 		}
 	}
 
-	double rms = sqrt(error / (cpe->height * cpe->width));
-	
-	multifree((double *) errorImage->data, 2);
-	free(errorImage);
+	deallocateImage(errorImage);
+
+	return error;
+}
+
+// Calculates the RMS error between the input image and the halftone.
+double calculateRmsError(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp) {
 
-	return rms;
+	double error = calculateTotalError(inputImage, halftone, cpe);
+
+	return sqrt(error / (cpe->height * cpe->width));
 }
 
 // Convolves the image with the passed kernel.
 struct doubleImage* convolve(struct doubleImage *image, struct doubleImage *kernel) {
 
-    struct doubleImage * cpe = (struct doubleImage *) multialloc(sizeof(struct doubleImage), 1, 1);
-    cpe->width = image->width;
-    cpe->height = image->height;
-    cpe->borderSize = 0;
-    cpe->data = (double **) multialloc(sizeof(double), 2, cpe->height, cpe->width);
+    struct doubleImage *cpe = createImage(image->height, image->width, 0, 0);
+
+    convolveInto(image, kernel, cpe);
+
+    return cpe;
+}
+
+void convolveInto(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *cpe) {
+
+    // Pad the image with its wraparound, so that the kernel can be applied without wrapping any index.
+    struct doubleImage *paddedImage = createPaddedImage(image, kernel->borderSize);
 
     // Convolve the error image with Cpp.
     for (int iCpe = 0; iCpe < cpe->height; iCpe++) {
         for (int jCpe = 0; jCpe < cpe->width; jCpe++) {
 
-            // Initialize to 0.
-            cpe->data[iCpe][jCpe] = 0.0;
+            // Accumulate in double, whatever the sample type.
+            double sum = 0.0;
 
             for (int iCpp = -kernel->borderSize; iCpp <= kernel->borderSize; iCpp++) {
-                for (int jCpp = -kernel->borderSize; jCpp <= kernel->borderSize; jCpp++) {
 
-                    int convRowIndex = MOD(iCpe + iCpp, cpe->height);
-                    int convColIndex = MOD(jCpe + jCpp, cpe->width);
+            	dbsReal *imageRow = IMAGE_ROW(paddedImage, iCpe + iCpp) + jCpe;
+            	dbsReal *kernelRow = IMAGE_ROW(kernel, iCpp);
 
-                    cpe->data[iCpe][jCpe] += image->data[convRowIndex][convColIndex] * kernel->data[iCpp][jCpp];
+                for (int jCpp = -kernel->borderSize; jCpp <= kernel->borderSize; jCpp++) {
+                    sum += (double) imageRow[jCpp] * kernelRow[jCpp];
                 }
             }
+
+            IMAGE_PIXEL(cpe, iCpe, jCpe) = sum;
         }
     }
 
-    return cpe;
+    deallocatePaddedImage(paddedImage);
 }
 
 // Calculates and returns the error image between the input image and the halftone passed.
 struct doubleImage* calculateErrorImage(struct doubleImage *inputImage, struct pxm_img *halftone) {
 
-    struct doubleImage *errorImage = (struct doubleImage *) multialloc(sizeof(struct doubleImage), 1, 1);
+    struct doubleImage *errorImage = createImage(inputImage->height, inputImage->width, 0, 0);
+
+    calculateErrorImageInto(inputImage, halftone, errorImage);
+
+    return errorImage;
+}
 
-    errorImage->width = inputImage->width;
-    errorImage->height = inputImage->height;
-    errorImage->borderSize = 0;
-    errorImage->data = (double **) multialloc(sizeof(double), 2, errorImage->height, errorImage->width);
+void calculateErrorImageInto(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *errorImage) {
 
     // Calculate the difference between the input image and the halftone.
     for (int i = 0; i < errorImage[0].height; i++) {
@@ -1287,27 +3016,27 @@ struct doubleImage* calculateErrorImage(struct doubleImage *inputImage, struct p
             errorImage->data[i][j] = inputImage->data[i][j] - (double) halftone->mono[i][j];
         }
     }
-
-    return errorImage;
 }
 
-// Generates and returns the auto-correlation of the HVS function.
-struct doubleImage* generateCpp(struct doubleImage *psf) {
+// De-allocates a matrix whose 0-index in the center. This currently is used for the human visual 
+// system, and its autocorrelation.
+void deallocateShiftedImage(struct doubleImage *image) {
 
-    struct doubleImage * cpp = (struct doubleImage *) multialloc(sizeof(struct doubleImage), 1, 1);
+	releaseKernelSpectra(image);
 
-    cpp->height = 1;
-    cpp->width = 1;
-    cpp->borderSize = 2 * psf->borderSize;
+	// Tables mapped from the HVS cache do not own their storage.
+	if (releaseMappedHvsTable(image)) {
+		return;
+	}
 
-    cpp->data = (double **) multialloc(sizeof(double), 2, 2 * cpp->borderSize + cpp->height, 2 * cpp->borderSize + cpp->width);
+	deallocateImage(image);
+}
 
-    /* Offset array indexing: Center the 0th, 0th index to be in the middle of the matrix. */
-    for (int i = 0; i < 2 * cpp->borderSize + cpp->width; i++) {
-        cpp->data[i] += cpp->borderSize;
-    }
+// Generates and returns the auto-correlation of the HVS function.
+struct doubleImage* generateCpp(struct doubleImage *psf) {
 
-    cpp->data += cpp->borderSize;
+    /* Offset array indexing: Center the 0th, 0th index to be in the middle of the matrix. */
+    struct doubleImage *cpp = createImage(1, 1, 2 * psf->borderSize, 0);
 
     int size = psf->borderSize;
 
@@ -1330,6 +3059,52 @@ struct doubleImage* generateCpp(struct doubleImage *psf) {
     return cpp;
 }
 
+// Same as generateCpp, computing the autocorrelation as the inverse FFT of the squared spectrum of the psf. The psf is
+// zero padded to a power of two of at least 4 x borderSize + 1, so that the circular product does not alias.
+struct doubleImage* generateCppFft(struct doubleImage *psf) {
+
+    int size = psf->borderSize;
+    int length = 1;
+    while (length < 4 * size + 1) {
+        length <<= 1;
+    }
+
+    double *re = (double *) calloc((size_t) length * length, sizeof(double));
+    double *im = (double *) calloc((size_t) length * length, sizeof(double));
+
+    for (int i = -size; i <= size; i++) {
+        for (int j = -size; j <= size; j++) {
+            re[MOD(i, length) * length + MOD(j, length)] = psf->data[i][j];
+        }
+    }
+
+    fft2d(re, im, length, length, 0);
+
+    for (int k = 0; k < length * length; k++) {
+
+        double squareRe = re[k] * re[k] - im[k] * im[k];
+        double squareIm = 2.0 * re[k] * im[k];
+        re[k] = squareRe;
+        im[k] = squareIm;
+    }
+
+    fft2d(re, im, length, length, 1);
+
+    /* Offset array indexing: Center the 0th, 0th index to be in the middle of the matrix. */
+    struct doubleImage *cpp = createImage(1, 1, 2 * size, 0);
+
+    for (int m = -2 * size; m <= 2 * size; m++) {
+        for (int n = -2 * size; n <= 2 * size; n++) {
+            cpp->data[m][n] = re[MOD(m, length) * length + MOD(n, length)];
+        }
+    }
+
+    free(re);
+    free(im);
+
+    return cpp;
+}
+
 // Generates and returns the Nasaenen Human Visual System Point Spread function.
 struct doubleImage* generateHvsFunction(Config *config) {
 
@@ -1344,23 +3119,10 @@ struct doubleImage* generateHvsFunction(Config *config) {
     fs = pi * config->scaleFactor / 180;
     k = fs / (C * log(L) + D);
 
-    psf = (struct doubleImage *) multialloc(sizeof(struct doubleImage), 1, 1);
-    psf->height = 1;
-    psf->width = 1;
-    psf->borderSize = config->hvsSpreadSize;
-    psf->borderSize = config->hvsSpreadSize;
-    psf->data = (double **) multialloc(sizeof(double), 2,
-        2 * psf->borderSize + psf->height,
-        2 * psf->borderSize + psf->width);
-
-    int size = psf->borderSize;
-
     /* Offset array indexing: Center the 0th, 0th index to be in the middle of the matrix. */
-    for (int i = 0; i < 2 * size + psf->width; i++) {
-        psf->data[i] += size;
-    }
+    psf = createImage(1, 1, config->hvsSpreadSize, 0);
 
-    psf->data += size;
+    int size = psf->borderSize;
 
     // Initialize the psf to 0. Note the negative indices.
     for (int i = -size; i <= size; i++)
@@ -1525,12 +3287,7 @@ struct doubleImage* readTiffImage(char* imagePath) {
     }
 
     // Convert tif to double image.
-    struct doubleImage *image = (struct doubleImage*) multialloc(sizeof(struct doubleImage), 1, 3);
-    
-    image->height = image_tif.height;
-    image->width = image_tif.width;
-
-    image->data = (double **) multialloc(sizeof(double), 2, image->height, image->width);
+    struct doubleImage *image = createImage(image_tif.height, image_tif.width, 0, 0);
 
     for (int i = 0; i < image->height; i++) {
         for (int j = 0; j < image->width; j++) {
@@ -1563,11 +3320,7 @@ struct doubleImage* readPxmImage(char* imagePath) {
     }    
 
     // Convert to double image.
-    struct doubleImage *image = (struct doubleImage*) multialloc(sizeof(struct doubleImage), 1, 3);
-    
-    image->height = image_pxm.height;
-    image->width = image_pxm.width;
-    image->data = (double **) multialloc(sizeof(double), 2, image->height, image->width);
+    struct doubleImage *image = createImage(image_pxm.height, image_pxm.width, 0, 0);
 
     for (int i = 0; i < image->height; i++) {
         for (int j = 0; j < image->width; j++) {
@@ -1597,7 +3350,7 @@ void saveBasedImageToText(struct doubleImage *image, char *filePath) {
 }
 
 // Saves the image passed in a text file, to be opened in MATLAB.
-void saveImageToText(double **data, int height, int width, char *filePath) {
+void saveImageToText(dbsReal **data, int height, int width, char *filePath) {
 
 	FILE *fid = fopen(filePath, "wb");
 
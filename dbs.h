@@ -7,6 +7,7 @@
 #include <signal.h>
 #include <errno.h>
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "tiff.h"
@@ -17,6 +18,19 @@
 #define MAX(x, y)       (((x) < (y)) ? (y) : (x))
 #define MIN(x, y)       (((x) < (y)) ? (x) : (y))
 
+// The sample type of struct doubleImage. Building with -DDBS_SINGLE_PRECISION stores cpe, Cpp, the input images and
+// the threshold matrices as float, which halves the memory traffic of the hot loops. Sums and deltas are still
+// formed in double. Config->precisionComparison estimates the effect of the rounding from a double build.
+#ifdef DBS_SINGLE_PRECISION
+typedef float dbsReal;
+#else
+typedef double dbsReal;
+#endif
+
+// Wraps X onto [0, Y) like MOD. MASK is Y - 1 when Y is a power of two (see getWrapMask), which replaces the two %
+// operations by a single AND, and -1 otherwise.
+#define WRAP(X, Y, MASK)    (((MASK) >= 0) ? ((X) & (MASK)) : MOD(X, Y))
+
  // Represents an image, where each data point is a double (typically represented as 64-bit.)
  // This struct is used for Cpe and cpp, as well as the error image.
 struct doubleImage
@@ -26,9 +40,91 @@ struct doubleImage
 
     // The border size around the image that will be added for convolution and halftoning operations.
     int  borderSize;
-    double **data;
+
+    // The halo kept around a padded image (see halo.h), 0 for the usual unpadded layout.
+    int  haloSize;
+
+    // The row pointers, centered like pixels.
+    dbsReal **data;
+
+    // The samples, margin included, in one 64-byte aligned block (see imageStorage.h), with rows stride samples apart.
+    // pixels points at sample (0, 0).
+    int  stride;
+    dbsReal *pixels;
 };
 
+// Stride based accessors of the samples of a doubleImage, with the centered indexing of data.
+#define IMAGE_ROW(image, i)         ((image)->pixels + (ptrdiff_t) (i) * (image)->stride)
+#define IMAGE_PIXEL(image, i, j)    (IMAGE_ROW(image, i)[j])
+
+// Block visiting orders of a DBS pass.
+// RASTER visits the blocks row by row. COLORED visits classes of blocks whose Cpp footprints cannot overlap on the torus,
+// one class after the other, so that the blocks of a class can be evaluated in parallel.
+// BEST_FIRST keeps the blocks in a priority queue keyed by their last evaluated delta error, and always processes the
+// most promising one. It stops when no block has a negative delta left, instead of on minAcceptableChangeCount.
+#define DBS_BLOCK_ORDER_RASTER      0
+#define DBS_BLOCK_ORDER_COLORED     1
+#define DBS_BLOCK_ORDER_BEST_FIRST  2
+
+// Implementations of the swap window scans in getSwapDeltaErrorInRegion_*. AUTO picks the widest one the processor
+// supports. All of them return the same target (see swapScan.h for the tie-break rule).
+#define DBS_SCAN_KERNEL_AUTO       -1
+#define DBS_SCAN_KERNEL_SCALAR      0
+#define DBS_SCAN_KERNEL_AVX2        1
+#define DBS_SCAN_KERNEL_AVX512      2
+
+// Wraparound strategies of the cpe and halftone planes inside a DBS design step.
+// OFF wraps every index with MOD. PADDED runs the step on halo padded copies of the planes (see halo.h), so the hot
+// loops index the window directly. AUTO uses a mask-based wrap when the image size is a power of two, and PADDED
+// otherwise. A size that is a power of two always uses the mask instead of MOD when the planes are not padded.
+#define DBS_HALO_OFF                0
+#define DBS_HALO_PADDED             1
+#define DBS_HALO_AUTO               2
+
+// Implementations of the circular convolution in calculateCpe. FFT multiplies spectra (see fftConvolve.h), and AUTO
+// picks whichever of the two is estimated to be cheaper for the image and kernel sizes.
+#define DBS_CONVOLUTION_DIRECT      0
+#define DBS_CONVOLUTION_FFT         1
+#define DBS_CONVOLUTION_AUTO        2
+
+// Use of the swap candidate indices (see candidateIndex.h) in the swap searches.
+// OFF scans every position of the swap windows. ON visits only the indexed candidates. AUTO visits the candidates when
+// they are fewer than DBS_CANDIDATE_INDEX_DENSITY of the pixels, and scans the window otherwise. All of them return the
+// same swap.
+#define DBS_CANDIDATE_INDEX_OFF     0
+#define DBS_CANDIDATE_INDEX_ON      1
+#define DBS_CANDIDATE_INDEX_AUTO    2
+
+#define DBS_CANDIDATE_INDEX_DENSITY 0.125
+
+// Use of the swap cache (see swapCache.h), which returns the same swaps as scanning the windows again.
+// A block is only evaluated again after a change within the Cpp border, which invalidates all of its sources unless the
+// block is longer than the swap reach, so AUTO keeps the cache for such blocks.
+#define DBS_SWAP_CACHE_OFF          0
+#define DBS_SWAP_CACHE_ON           1
+#define DBS_SWAP_CACHE_AUTO         2
+
+// The adaptive swap window (see swapWindowPercentile). A pass that accepted at least DBS_SWAP_WINDOW_MIN_SWAP_COUNT
+// swaps narrows the window of the next ones to the reach that holds the percentile of its swap distances, plus
+// DBS_SWAP_WINDOW_MARGIN, and never below DBS_SWAP_WINDOW_MIN_REACH.
+#define DBS_SWAP_WINDOW_MIN_SWAP_COUNT 16
+#define DBS_SWAP_WINDOW_MARGIN      1
+#define DBS_SWAP_WINDOW_MIN_REACH   2
+
+// The number of rounds of performJointDBSRounds in the initial joint design.
+#define DBS_INITIAL_ROUND_COUNT     10
+
+// How removeDots and addDots pick the dots of a level (see dotSelectionMode in Config).
+#define DBS_DOT_SELECTION_RASTER    0
+#define DBS_DOT_SELECTION_ERROR     1
+
+// The largest difference between the tracked error of a pass and a full recomputation, relative to the latter (or 1,
+// if larger), that goes unreported.
+#define DBS_ERROR_DRIFT_TOLERANCE   1e-9
+
+// The largest relative difference between an FFT convolution and the direct one accepted by the accuracy check.
+#define DBS_FFT_TOLERANCE           1e-9
+
 // A property bag that holds the configuration of a specific run of the DBS Mono.
 typedef struct Config
 {
@@ -58,6 +154,12 @@ typedef struct Config
 	char *outputMatrixMPath;
 	char *outputMatrixYPath;
 
+	// The binary matrices (see matrixFile.h), updated in place after every level. The text matrices are then written
+	// once, at the end of the design. A NULL path writes the text matrix after every level instead.
+	char *outputBinaryMatrixCPath;
+	char *outputBinaryMatrixMPath;
+	char *outputBinaryMatrixYPath;
+
 	// A flag to enable toggling functionality in the DBS.
 	int enableToggle;
 
@@ -76,6 +178,10 @@ typedef struct Config
 	// A value that determines the HVS filter size. The final filter size will be (height x width), where each 
 	// dimension = (4 x hvsSpreadSize + 1). Typical value = 23, which covers 99 % of the filter.
 	int hvsSpreadSize;
+
+	// The directory of the HVS cache files (see hvsCache.h), which hold the psf and Cpp per scaleFactor and
+	// hvsSpreadSize. NULL disables the cache.
+	char *hvsCacheDirectory;
 	
 	// The swap neighborhood size. The larger this value, the better the output, but the slower the performance. 
 	// This needs to be an odd value. Typical value = 41, for a fast result.
@@ -93,16 +199,147 @@ typedef struct Config
     // The minimum number of pixel changes in a DBS pass below which the algorithm will stop. This value is used for DBS convergence.
     int minAcceptableChangeCount;
 
+    // The order in which a pass visits the blocks (one of DBS_BLOCK_ORDER_*).
+    int blockOrder;
+
+    // The number of threads that evaluate a color class when blockOrder is DBS_BLOCK_ORDER_COLORED. A value < 1 uses all
+    // online processors, and 1 runs the colored order serially, which gives the same result as any other thread count.
+    int threadCount;
+
+    // The implementation of the swap window scans (one of DBS_SCAN_KERNEL_*). The design runs it as given, so an entry
+    // point maps DBS_SCAN_KERNEL_AUTO to a kernel with resolveScanKernel first.
+    int scanKernel;
+
+    // The wraparound strategy of the planes (one of DBS_HALO_*).
+    int haloMode;
+
+    // The implementation of the convolution in calculateCpe (one of DBS_CONVOLUTION_*).
+    int convolutionMethod;
+
+    // The number of pixels of every FFT convolution recomputed directly to check its accuracy. The direct convolution
+    // replaces the FFT one if the check fails. 0 disables the check.
+    int fftCheckSampleCount;
+
+    // The number of passes between two full recomputations of the error, which is otherwise tracked from the accepted
+    // changes. 0 never recomputes it.
+    int errorCheckInterval;
+
+    // A flag to evaluate every block again on float rounded copies of the cpe planes and Cpp, which follow the decisions
+    // of the double pass, and to report how many decisions single precision storage would change on the same halftone,
+    // and the RMS error the rounded cpe gives. The float design itself is not run. Meant for double builds.
+    int precisionComparison;
+
+    // The use of the swap candidate indices (one of DBS_CANDIDATE_INDEX_*).
+    int candidateIndexMode;
+
+    // The use of the swap cache (one of DBS_SWAP_CACHE_*).
+    int swapCacheMode;
+
+    // The fraction of the accepted swaps of a pass (e.g. 0.99) that the swap window of the next passes of a design call
+    // covers. The window starts at swapSize, narrows as the swaps get shorter, and doubles its reach, up to swapSize,
+    // whenever a pass would end the call. 0 keeps the window at swapSize.
+    double swapWindowPercentile;
+
+    // The fraction of the size, a power of 2 (e.g. 2 or 4), at which the split of the initial halftone between the C, M
+    // and Y patterns is designed first (see multiResolution.h), before the initial joint design refines it at full
+    // size. 1 designs it at full size only.
+    int coarseDesignFactor;
+
+    // How the dots removed or added at the start of a level are picked (one of DBS_DOT_SELECTION_*): the first ones in
+    // raster order, the default of app.c, or one at a time where the filtered error of the pattern drops the most, in
+    // the tightest cluster of dots or the largest void, which leaves the level design fewer swaps to make.
+    int dotSelectionMode;
+
+    // The seed of the random initial halftone and of the split of its dots between the C, M and Y patterns. A design
+    // draws from the stream of index 0 of its seed (see randomStream.h), and so repeats itself for the same seed.
+    unsigned int randomSeed;
+
+    // The number of random streams of randomSeed (0, 1, ...) whose initial joint designs run concurrently, as a
+    // portfolio (see initialDesign.h). The level designs start from the one of lowest error. 1 runs stream 0 alone.
+    int portfolioSeedCount;
+
+    // A flag to run the independent per-colorant designs of a level (see performIndependentDBSForScreenDesign) on
+    // separate threads. The results are the same as the serial ones.
+    int enableConcurrentColorants;
+
+    // The number of outputs (halftone snapshots and matrix updates) queued to the writer thread before the design waits
+    // for it. 0 writes them on the design thread.
+    int outputQueueCapacity;
+
+    // The smallest image storage, in bytes, advised to be backed by huge pages. 0 disables huge pages.
+    long hugePageThreshold;
+
+    // The checkpoint of the level by level design (see checkpoint.h), written every checkpointInterval levels and at
+    // the end of every design phase. A NULL path, or an interval < 1, disables the checkpoints.
+    char *checkpointPath;
+    int checkpointInterval;
+
+    // A flag to continue the design after the level of the checkpoint, if there is one, instead of starting over.
+    int resumeFromCheckpoint;
+
+    // The path of a Chrome trace of the levels, the design calls and the passes, with the time spent in each phase
+    // of the design. NULL disables tracing.
+    char *tracePath;
+
+    // The path of the records of every pass (see passTelemetry.h), a CSV file or a JSON Lines one if it ends in
+    // ".jsonl". NULL disables them.
+    char *telemetryPath;
+
 	// A flag to enable printing different information, as well as saving the results of halftoning after each iteration.
 	int enableVerboseDebugging;
 } Config;
 
-struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputImage, double maxGrayValue, unsigned int seed);
+// The random numbers of a design (see randomStream.h).
+struct randomStream;
+
+struct pxm_img* getInitialHalftone(char *imagePath, struct doubleImage *inputImage, double maxGrayValue, struct randomStream *random);
 
 void performCompleteDBSForScreenDesign(struct Config *config, struct doubleImage *inputImage,struct pxm_img *halftoneCMY,struct doubleImage *cpeCMY,
 		struct pxm_img *halftoneC,struct doubleImage *cpeC, struct pxm_img *halftoneM, struct doubleImage *cpeM,
 		struct pxm_img *beforeCMY,struct pxm_img *beforeC, struct pxm_img *beforeM, struct doubleImage *cpp, int stepIndex);
 
+// The arguments of a performCompleteDBSForScreenDesign call.
+struct screenDesignCall
+{
+	struct doubleImage *inputImage;
+	struct pxm_img *halftoneCMY;
+	struct doubleImage *cpeCMY;
+	struct pxm_img *halftoneC;
+	struct doubleImage *cpeC;
+	struct pxm_img *halftoneM;
+	struct doubleImage *cpeM;
+	struct pxm_img *beforeCMY;
+	struct pxm_img *beforeC;
+	struct pxm_img *beforeM;
+	struct doubleImage *cpp;
+	int stepIndex;
+
+	// The colorants of the call in its pass records (see passTelemetry.h), NULL to leave them empty.
+	const char *colorants;
+};
+
+// Performs calls that share no plane they write, on separate threads when config->enableConcurrentColorants is set, and
+// one after the other otherwise. The console output of every call is printed in one piece, in call order, so that it
+// reads as the serial output.
+void performIndependentDBSForScreenDesign(struct Config *config, struct screenDesignCall *calls, int callCount);
+
+// Runs roundCount rounds of the joint designs (step 1) of the C and Y, the M and Y, then the C and M patterns, as the
+// initial joint design does. halftoneCMY is the union of the three patterns, and each cpe plane that of its pattern.
+void performJointDBSRounds(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftoneCMY,
+		struct doubleImage *cpeCMY, struct pxm_img *halftoneC, struct doubleImage *cpeC, struct pxm_img *halftoneM,
+		struct doubleImage *cpeM, struct pxm_img *halftoneY, struct doubleImage *cpeY, struct doubleImage *cpp, int roundCount);
+
+// Makes the designs of the calling thread print to output, NULL for stdout.
+void setDesignOutput(FILE *output);
+
+// Returns where the designs of the calling thread print.
+FILE* getDesignOutput();
+
+// Hands the halftone snapshots of enableVerboseDebugging to a writer thread (see outputWriter.h). NULL writes them on
+// the design thread.
+struct outputWriter;
+void setSnapshotWriter(struct outputWriter *writer);
+
 
 int runSinglePassDBS(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftoneCMY, struct doubleImage *cpeCMY,
 		struct pxm_img *halftoneC, struct doubleImage *cpeC,struct pxm_img *halftoneM, struct doubleImage *cpeM,
@@ -157,11 +394,17 @@ struct pxm_img* mergePattern(struct pxm_img *differ,struct pxm_img *halftone, do
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 struct pxm_img* findDifference(struct pxm_img *halftone, struct pxm_img *before, struct pxm_img *differ);
 
-void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct pxm_img *halftoneM,double Cratio, double Mratio);
+// Splits the dots of halftoneCM at random between halftoneC and halftoneM, in the given ratios, drawing from random.
+void separateCM(struct pxm_img *halftoneCM, struct pxm_img *halftoneC, struct pxm_img *halftoneM,double Cratio, double Mratio,
+		struct randomStream *random);
 
-struct pxm_img* removeDots(struct pxm_img *halftone, unsigned int changelines,int modNum, int MatrixSize, int MaxLevel, int screenNum);
+// Removes the dots of a level from halftone, picked by config->dotSelectionMode (one of DBS_DOT_SELECTION_*).
+struct pxm_img* removeDots(struct Config *config, struct pxm_img *halftone, unsigned int changelines,int modNum, int MatrixSize,
+		int MaxLevel, int screenNum, struct doubleImage *cpp);
 
-struct pxm_img* addDots(struct pxm_img *halftone, int changeline, int modNum, int MatrixSize, int MaxLevel);
+// Adds the dots of a level to halftone, picked by config->dotSelectionMode (one of DBS_DOT_SELECTION_*).
+struct pxm_img* addDots(struct Config *config, struct pxm_img *halftone, int changeline, int modNum, int MatrixSize,
+		int MaxLevel, struct doubleImage *cpp);
 
 //struct pxm_img* addDots(struct pxm_img *halftoneC, struct pxm_img *halftone, int MatrixSize, int MaxLevel, int changeline);
 
@@ -169,14 +412,27 @@ double countNum(struct pxm_img *halftone);
 
 struct doubleImage* generateCTImage(struct pxm_img *halftone);
 
+// The "Into" variants write into an image or halftone of the right size owned by the caller (e.g. from a levelArena),
+// and return it.
+struct doubleImage* generateCTImageInto(struct pxm_img *halftone, struct doubleImage *inputImage);
+
 struct doubleImage *AllocateMatrix(int MatrixSize);
 
 void updateMatrix(struct pxm_img *halftone, struct doubleImage *matrix, double currentlevel, double levelIndex, struct pxm_img* before);
+int writeMatrix(struct doubleImage *matrix, char *outputMatrixPath);
 //void updateMatrix_2(struct pxm_img *halftone, struct doubleImage *matrix, double currentlevel, struct pxm_img* before);
 //void neighboringLevels(double currentlevel, struct doubleImage *matrix, double *levelup, double *leveldown, double *adjlevel, unsigned int MaximumLevel);
 
 struct pxm_img* samepattern(struct pxm_img *halftone);
 
+struct pxm_img* samepatternInto(struct pxm_img *halftone, struct pxm_img *samepattern);
+
+// Allocates a halftone of the given size, freed with free_pxm.
+struct pxm_img* createHalftone(int height, int width);
+
+// Returns the seconds since start, a CLOCK_MONOTONIC time.
+double getElapsedSeconds(struct timespec *start);
+
 
 
 
@@ -186,6 +442,12 @@ struct pxm_img* samepattern(struct pxm_img *halftone);
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 
+int getWrapMask(int length);
+
+int getSwapReach(struct Config *config, int height, int width);
+
+void getSwapWindowRange(struct Config *config, int centerIndex, int length, int *firstIndex, int *lastIndex);
+
 double getSwapDeltaError(struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp,
 	int sourceRowIndex, int sourceColumnIndex, int targetRowIndex, int targetColumnIndex, int cppRowIndex, int cppColumnIndex);
 
@@ -201,21 +463,35 @@ void updateCpe(struct Config *config, struct doubleImage * cpe, struct doubleIma
 
 struct doubleImage *generateCpp(struct doubleImage *psf);
 
+struct doubleImage *generateCppFft(struct doubleImage *psf);
+
 struct doubleImage* generateHvsFunction(Config *config);
 
-struct doubleImage* calculateCpe(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage* Cpp);
+struct doubleImage* calculateCpe(struct Config *config, struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage* Cpp);
+
+struct levelArena;
+
+// calculateCpe into cpe, with its error image taken from the arena and released before returning.
+struct doubleImage* calculateCpeInto(struct Config *config, struct levelArena *arena, struct doubleImage *inputImage, struct pxm_img *halftone,
+		struct doubleImage *cpp, struct doubleImage *cpe);
+
+double calculateTotalError(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *cpe);
 
 double calculateRmsError(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *cpe, struct doubleImage *cpp);
 
 struct doubleImage* convolve(struct doubleImage *image, struct doubleImage *kernel);
 
+void convolveInto(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *cpe);
+
 void normalizeImage(struct doubleImage *image);
 
 struct doubleImage* calculateErrorImage(struct doubleImage *inputImage, struct pxm_img *halftone);
 
+void calculateErrorImageInto(struct doubleImage *inputImage, struct pxm_img *halftone, struct doubleImage *errorImage);
+
 void saveBasedImageToText(struct doubleImage *image, char *filePath);
 
-void saveImageToText(double **data, int height, int width, char *filePath);
+void saveImageToText(dbsReal **data, int height, int width, char *filePath);
 
 void saveHalftoneToText(uint8_t **data, int height, int width, char *filePath);
 
@@ -225,7 +501,7 @@ struct doubleImage* readTiffImage(char* imagePath);
 
 struct doubleImage* readPxmImage(char* imagePath);
 
-void writeHalftoneImage(struct pxm_img *halftone, char *imagePath);
+int writeHalftoneImage(struct pxm_img *halftone, char *imagePath);
 
 void removeGammaCorrection(struct doubleImage *image, double gamma);
 
@@ -0,0 +1,349 @@
+/******************************************************************
+* file: fftConvolve.c
+* Implementing: FFT-based circular convolution of an image with a centered kernel
+* The DBS domain is a torus, so convolve() is a circular correlation of the image with the kernel. Wrapping the kernel
+* onto the torus turns it into a product of spectra, which costs O(log N) per pixel instead of the kernel area.
+* The conjugated spectrum of each kernel is cached per image size, so a design transforms Cpp only once.
+*******************************************************************/
+
+#include <pthread.h>
+
+#include "dbs.h"
+#include "fftConvolve.h"
+#include "imageStorage.h"
+#include "allocate.h"
+
+// Estimated cost of one butterfly per point and stage, relative to one multiply-add of the direct convolution.
+#define FFT_BUTTERFLY_COST      4.0
+
+// Cosine and sine of 2 x pi x k / length, for k in [0, length).
+struct fftTable
+{
+	int length;
+	int isPowerOfTwo;
+	double *cosine;
+	double *sine;
+};
+
+// The conjugated spectrum of a kernel wrapped onto a height x width torus.
+struct kernelSpectrum
+{
+	struct doubleImage *kernel;
+	int height;
+	int width;
+	double *re;
+	double *im;
+	struct kernelSpectrum *next;
+};
+
+static struct kernelSpectrum *spectrumCache = NULL;
+static pthread_mutex_t spectrumCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int isPowerOfTwo(int length) {
+
+	return length > 0 && (length & (length - 1)) == 0;
+}
+
+static void createFftTable(struct fftTable *table, int length) {
+
+	table->length = length;
+	table->isPowerOfTwo = isPowerOfTwo(length);
+	table->cosine = (double *) malloc(length * sizeof(double));
+	table->sine = (double *) malloc(length * sizeof(double));
+
+	for (int k = 0; k < length; k++) {
+		table->cosine[k] = cos(2.0 * M_PI * k / length);
+		table->sine[k] = sin(2.0 * M_PI * k / length);
+	}
+}
+
+static void deallocateFftTable(struct fftTable *table) {
+
+	free(table->cosine);
+	free(table->sine);
+}
+
+// Transforms a contiguous complex sequence in place. workRe and workIm hold table->length values, and are only used by
+// the direct DFT.
+static void transform(struct fftTable *table, double *re, double *im, int isInverse, double *workRe, double *workIm) {
+
+	int length = table->length;
+	double sign = isInverse ? 1.0 : -1.0;
+
+	if (!table->isPowerOfTwo) {
+
+		for (int f = 0; f < length; f++) {
+
+			double sumRe = 0.0;
+			double sumIm = 0.0;
+			int k = 0;
+
+			for (int t = 0; t < length; t++) {
+
+				double wRe = table->cosine[k];
+				double wIm = sign * table->sine[k];
+				sumRe += re[t] * wRe - im[t] * wIm;
+				sumIm += re[t] * wIm + im[t] * wRe;
+
+				k += f;
+				if (k >= length) {
+					k -= length;
+				}
+			}
+
+			workRe[f] = sumRe;
+			workIm[f] = sumIm;
+		}
+
+		memcpy(re, workRe, length * sizeof(double));
+		memcpy(im, workIm, length * sizeof(double));
+		return;
+	}
+
+	// Bit reversal permutation.
+	for (int i = 1, j = 0; i < length; i++) {
+
+		int bit = length >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+
+		if (i < j) {
+			double t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	// Radix-2 butterflies.
+	for (int span = 2; span <= length; span <<= 1) {
+
+		int half = span >> 1;
+		int step = length / span;
+
+		for (int i = 0; i < length; i += span) {
+			for (int k = 0; k < half; k++) {
+
+				double wRe = table->cosine[k * step];
+				double wIm = sign * table->sine[k * step];
+
+				double vRe = re[i + k + half] * wRe - im[i + k + half] * wIm;
+				double vIm = re[i + k + half] * wIm + im[i + k + half] * wRe;
+
+				re[i + k + half] = re[i + k] - vRe;
+				im[i + k + half] = im[i + k] - vIm;
+				re[i + k] += vRe;
+				im[i + k] += vIm;
+			}
+		}
+	}
+}
+
+void fft2d(double *re, double *im, int height, int width, int isInverse) {
+
+	struct fftTable rowTable, columnTable;
+	createFftTable(&rowTable, width);
+	createFftTable(&columnTable, height);
+
+	int longest = MAX(height, width);
+	double *workRe = (double *) malloc(longest * sizeof(double));
+	double *workIm = (double *) malloc(longest * sizeof(double));
+	double *columnRe = (double *) malloc(height * sizeof(double));
+	double *columnIm = (double *) malloc(height * sizeof(double));
+
+	for (int i = 0; i < height; i++) {
+		transform(&rowTable, re + i * width, im + i * width, isInverse, workRe, workIm);
+	}
+
+	for (int j = 0; j < width; j++) {
+
+		for (int i = 0; i < height; i++) {
+			columnRe[i] = re[i * width + j];
+			columnIm[i] = im[i * width + j];
+		}
+
+		transform(&columnTable, columnRe, columnIm, isInverse, workRe, workIm);
+
+		for (int i = 0; i < height; i++) {
+			re[i * width + j] = columnRe[i];
+			im[i * width + j] = columnIm[i];
+		}
+	}
+
+	if (isInverse) {
+
+		double scale = 1.0 / ((double) height * width);
+		for (int k = 0; k < height * width; k++) {
+			re[k] *= scale;
+			im[k] *= scale;
+		}
+	}
+
+	free(workRe);
+	free(workIm);
+	free(columnRe);
+	free(columnIm);
+	deallocateFftTable(&rowTable);
+	deallocateFftTable(&columnTable);
+}
+
+// Cost of one 1-D transform per point, in butterflies.
+static double getTransformCost(int length) {
+
+	return isPowerOfTwo(length) ? log2((double) length) : (double) length;
+}
+
+int chooseConvolutionMethod(struct Config *config, struct doubleImage *image, struct doubleImage *kernel) {
+
+	if (config->convolutionMethod != DBS_CONVOLUTION_AUTO) {
+		return config->convolutionMethod;
+	}
+
+	// Per pixel, the direct convolution costs the kernel area, and the FFT path a forward and an inverse 2-D transform
+	// (the kernel spectrum is cached).
+	double directCost = (2.0 * kernel->borderSize + 1) * (2.0 * kernel->borderSize + 1);
+	double fftCost = 2.0 * FFT_BUTTERFLY_COST * (getTransformCost(image->height) + getTransformCost(image->width));
+
+	return fftCost < directCost ? DBS_CONVOLUTION_FFT : DBS_CONVOLUTION_DIRECT;
+}
+
+// Returns the cached spectrum of the kernel for this size, computing it on first use. The caller holds the lock.
+static struct kernelSpectrum* getKernelSpectrum(struct doubleImage *kernel, int height, int width) {
+
+	for (struct kernelSpectrum *spectrum = spectrumCache; spectrum != NULL; spectrum = spectrum->next) {
+		if (spectrum->kernel == kernel && spectrum->height == height && spectrum->width == width) {
+			return spectrum;
+		}
+	}
+
+	struct kernelSpectrum *spectrum = (struct kernelSpectrum *) malloc(sizeof(struct kernelSpectrum));
+	spectrum->kernel = kernel;
+	spectrum->height = height;
+	spectrum->width = width;
+	spectrum->re = (double *) calloc((size_t) height * width, sizeof(double));
+	spectrum->im = (double *) calloc((size_t) height * width, sizeof(double));
+
+	// Wrap the kernel onto the torus. A kernel wider than the image folds onto itself, as in convolve().
+	for (int i = -kernel->borderSize; i <= kernel->borderSize; i++) {
+		for (int j = -kernel->borderSize; j <= kernel->borderSize; j++) {
+			spectrum->re[MOD(i, height) * width + MOD(j, width)] += kernel->data[i][j];
+		}
+	}
+
+	fft2d(spectrum->re, spectrum->im, height, width, 0);
+
+	// convolve() correlates the image with the kernel, which is a product with the conjugated spectrum.
+	for (int k = 0; k < height * width; k++) {
+		spectrum->im[k] = -spectrum->im[k];
+	}
+
+	spectrum->next = spectrumCache;
+	spectrumCache = spectrum;
+
+	return spectrum;
+}
+
+void prepareKernelSpectrum(struct doubleImage *kernel, int height, int width) {
+
+	pthread_mutex_lock(&spectrumCacheLock);
+	getKernelSpectrum(kernel, height, width);
+	pthread_mutex_unlock(&spectrumCacheLock);
+}
+
+void releaseKernelSpectra(struct doubleImage *kernel) {
+
+	pthread_mutex_lock(&spectrumCacheLock);
+
+	struct kernelSpectrum **link = &spectrumCache;
+	while (*link != NULL) {
+
+		struct kernelSpectrum *spectrum = *link;
+		if (spectrum->kernel == kernel) {
+			*link = spectrum->next;
+			free(spectrum->re);
+			free(spectrum->im);
+			free(spectrum);
+		} else {
+			link = &spectrum->next;
+		}
+	}
+
+	pthread_mutex_unlock(&spectrumCacheLock);
+}
+
+struct doubleImage* convolveFft(struct doubleImage *image, struct doubleImage *kernel) {
+
+	struct doubleImage *result = createImage(image->height, image->width, 0, 0);
+
+	convolveFftInto(image, kernel, result);
+
+	return result;
+}
+
+void convolveFftInto(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *result) {
+
+	int height = image->height;
+	int width = image->width;
+
+	pthread_mutex_lock(&spectrumCacheLock);
+	struct kernelSpectrum *spectrum = getKernelSpectrum(kernel, height, width);
+	pthread_mutex_unlock(&spectrumCacheLock);
+
+	double *re = (double *) malloc((size_t) height * width * sizeof(double));
+	double *im = (double *) calloc((size_t) height * width, sizeof(double));
+
+	for (int i = 0; i < height; i++) {
+		for (int j = 0; j < width; j++) {
+			re[i * width + j] = image->data[i][j];
+		}
+	}
+
+	fft2d(re, im, height, width, 0);
+
+	for (int k = 0; k < height * width; k++) {
+
+		double productRe = re[k] * spectrum->re[k] - im[k] * spectrum->im[k];
+		double productIm = re[k] * spectrum->im[k] + im[k] * spectrum->re[k];
+		re[k] = productRe;
+		im[k] = productIm;
+	}
+
+	fft2d(re, im, height, width, 1);
+
+	for (int i = 0; i < height; i++) {
+		for (int j = 0; j < width; j++) {
+			result->data[i][j] = re[i * width + j];
+		}
+	}
+
+	free(re);
+	free(im);
+}
+
+double checkConvolutionAccuracy(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *result,
+		int sampleCount) {
+
+	int pixelCount = image->height * image->width;
+	double largestError = 0.0;
+	double largestValue = 1.0;
+
+	// Spread the samples over the image with a fixed stride, without touching the rand() sequence of the design.
+	for (int s = 0; s < MIN(sampleCount, pixelCount); s++) {
+
+		int pixel = (int) (((long long) s * pixelCount / MIN(sampleCount, pixelCount) + s * 7919LL) % pixelCount);
+		int rowIndex = pixel / image->width;
+		int columnIndex = pixel % image->width;
+
+		double direct = 0.0;
+		for (int i = -kernel->borderSize; i <= kernel->borderSize; i++) {
+			for (int j = -kernel->borderSize; j <= kernel->borderSize; j++) {
+				direct += image->data[MOD(rowIndex + i, image->height)][MOD(columnIndex + j, image->width)] * kernel->data[i][j];
+			}
+		}
+
+		largestError = MAX(largestError, fabs(direct - result->data[rowIndex][columnIndex]));
+		largestValue = MAX(largestValue, fabs(direct));
+	}
+
+	return largestError / largestValue;
+}
@@ -0,0 +1,34 @@
+#ifndef FFT_CONVOLVE_H
+#define FFT_CONVOLVE_H
+
+struct Config;
+struct doubleImage;
+
+// In-place 2-D discrete Fourier transform of a height x width complex array stored row by row in re / im. The
+// inverse transform includes the 1 / (height x width) scaling. Powers of two use a radix-2 FFT, and other lengths a
+// direct DFT along that dimension.
+void fft2d(double *re, double *im, int height, int width, int isInverse);
+
+// Returns DBS_CONVOLUTION_DIRECT or DBS_CONVOLUTION_FFT, resolving DBS_CONVOLUTION_AUTO from the estimated cost of
+// both methods for this image and kernel.
+int chooseConvolutionMethod(struct Config *config, struct doubleImage *image, struct doubleImage *kernel);
+
+// Computes the same circular convolution as convolve(), through the spectrum of the kernel wrapped onto the torus.
+// The spectrum is computed once per kernel and image size, and reused by every later call.
+struct doubleImage* convolveFft(struct doubleImage *image, struct doubleImage *kernel);
+
+// convolveFft into an existing image of the same size.
+void convolveFftInto(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *result);
+
+// Computes the spectrum of the kernel for the given image size ahead of the first convolveFft call.
+void prepareKernelSpectrum(struct doubleImage *kernel, int height, int width);
+
+// Releases the spectra computed for the kernel. Must be called before the kernel is freed.
+void releaseKernelSpectra(struct doubleImage *kernel);
+
+// Recomputes sampleCount pixels of the result directly, and returns the largest absolute difference, relative to
+// the largest magnitude of the sampled direct values (or 1, if larger).
+double checkConvolutionAccuracy(struct doubleImage *image, struct doubleImage *kernel, struct doubleImage *result,
+		int sampleCount);
+
+#endif
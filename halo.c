@@ -0,0 +1,145 @@
+/******************************************************************
+* file: halo.c
+* Implementing: Ghost-border (halo) padded cpe and halftone planes
+* A padded plane keeps copies of the opposite edges of the torus around its core, so that the swap scans can read
+* the whole window with straight-line indexing instead of wrapping every index with MOD.
+* The halo is kept coherent by writing every change to the core pixel and to all of its copies.
+*******************************************************************/
+
+#include "dbs.h"
+#include "halo.h"
+#include "imageStorage.h"
+#include "allocate.h"
+
+int getHaloSize(struct Config *config, struct doubleImage *cpp, int height, int width) {
+
+	int haloSize = MAX(cpp->borderSize, getSwapReach(config, height, width));
+
+	// Every padded pixel must have a single core pixel within one period, and a footprint must not overlap itself.
+	if (haloSize > MIN(height, width) || 2 * cpp->borderSize + 1 > MIN(height, width)) {
+		return 0;
+	}
+
+	return haloSize;
+}
+
+struct doubleImage* createPaddedImage(struct doubleImage *image, int haloSize) {
+
+	// data[0][0] is the first core pixel.
+	struct doubleImage *padded = createImage(image->height, image->width, 0, haloSize);
+
+	for (int i = -haloSize; i < image->height + haloSize; i++) {
+		for (int j = -haloSize; j < image->width + haloSize; j++) {
+			padded->data[i][j] = image->data[MOD(i, image->height)][MOD(j, image->width)];
+		}
+	}
+
+	return padded;
+}
+
+struct pxm_img* createPaddedHalftone(struct pxm_img *halftone, int haloSize) {
+
+	struct pxm_img *padded = (struct pxm_img *) multialloc(sizeof(struct pxm_img), 1, 1);
+	padded->height = halftone->height;
+	padded->width = halftone->width;
+	padded->pxm_type = halftone->pxm_type;
+	padded->mono = (uint8_t **) get_img(halftone->width + 2 * haloSize, halftone->height + 2 * haloSize, sizeof(uint8_t));
+
+	for (int i = 0; i < halftone->height + 2 * haloSize; i++) {
+		padded->mono[i] += haloSize;
+	}
+	padded->mono += haloSize;
+
+	for (int i = -haloSize; i < halftone->height + haloSize; i++) {
+		for (int j = -haloSize; j < halftone->width + haloSize; j++) {
+			padded->mono[i][j] = halftone->mono[MOD(i, halftone->height)][MOD(j, halftone->width)];
+		}
+	}
+
+	return padded;
+}
+
+void copyPaddedImageCore(struct doubleImage *padded, struct doubleImage *image) {
+
+	for (int i = 0; i < image->height; i++) {
+		memcpy(image->data[i], padded->data[i], image->width * sizeof(dbsReal));
+	}
+}
+
+void copyPaddedHalftoneCore(struct pxm_img *padded, struct pxm_img *halftone) {
+
+	for (int i = 0; i < halftone->height; i++) {
+		memcpy(halftone->mono[i], padded->mono[i], halftone->width * sizeof(uint8_t));
+	}
+}
+
+void deallocatePaddedImage(struct doubleImage *image) {
+
+	deallocateImage(image);
+}
+
+void deallocatePaddedHalftone(struct pxm_img *halftone, int haloSize) {
+
+	halftone->mono -= haloSize;
+	for (int i = 0; i < halftone->height + 2 * haloSize; i++) {
+		halftone->mono[i] -= haloSize;
+	}
+
+	free_img((void **) halftone->mono);
+	free(halftone);
+}
+
+void setHalftonePixel(struct pxm_img *halftone, int haloSize, int rowIndex, int columnIndex, uint8_t value) {
+
+	if (haloSize == 0) {
+		halftone->mono[rowIndex][columnIndex] = value;
+		return;
+	}
+
+	// A core pixel has at most one copy on each side of each dimension.
+	for (int rowShift = -halftone->height; rowShift <= halftone->height; rowShift += halftone->height) {
+
+		int i = rowIndex + rowShift;
+		if (i < -haloSize || i >= halftone->height + haloSize) {
+			continue;
+		}
+
+		for (int columnShift = -halftone->width; columnShift <= halftone->width; columnShift += halftone->width) {
+
+			int j = columnIndex + columnShift;
+			if (j >= -haloSize && j < halftone->width + haloSize) {
+				halftone->mono[i][j] = value;
+			}
+		}
+	}
+}
+
+void updatePaddedCpe(struct doubleImage *cpe, struct doubleImage *cpp, double a0, int rowIndex, int columnIndex) {
+
+	int haloSize = cpe->haloSize;
+	int border = cpp->borderSize;
+
+	// Apply the footprint to each of its copies, clipped to the padded plane. Along each dimension, the copies are the
+	// footprint itself, and the footprint shifted by one period either way.
+	for (int rowShift = -cpe->height; rowShift <= cpe->height; rowShift += cpe->height) {
+
+		int firstRow = MAX(rowIndex + rowShift - border, -haloSize);
+		int lastRow = MIN(rowIndex + rowShift + border, cpe->height + haloSize - 1);
+
+		for (int columnShift = -cpe->width; columnShift <= cpe->width; columnShift += cpe->width) {
+
+			int firstColumn = MAX(columnIndex + columnShift - border, -haloSize);
+			int lastColumn = MIN(columnIndex + columnShift + border, cpe->width + haloSize - 1);
+
+			for (int i = firstRow; i <= lastRow; i++) {
+
+				dbsReal *cpeRow = cpe->data[i];
+				dbsReal *cppRow = cpp->data[i - rowIndex - rowShift] - columnIndex - columnShift;
+
+				for (int j = firstColumn; j <= lastColumn; j++) {
+					cpeRow[j] -= a0 * cppRow[j];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef HALO_H
+#define HALO_H
+
+#include <stdint.h>
+
+struct Config;
+struct doubleImage;
+struct pxm_img;
+
+// Returns the halo a padded pass needs around the cpe and halftone planes: max(cpp->borderSize, swap reach). Returns 0
+// when the halo does not fit the image (a footprint or a window that wraps onto itself), in which case the planes
+// have to stay unpadded.
+int getHaloSize(struct Config *config, struct doubleImage *cpp, int height, int width);
+
+// Allocates a copy of the image surrounded by a halo of haloSize on each side, filled from the opposite edges of the
+// torus. data[i][j] is valid for i in [-haloSize, height + haloSize), and likewise for j.
+struct doubleImage* createPaddedImage(struct doubleImage *image, int haloSize);
+
+// Same as createPaddedImage, for a halftone plane.
+struct pxm_img* createPaddedHalftone(struct pxm_img *halftone, int haloSize);
+
+// Copies the core (non halo) part of a padded image or halftone back into an unpadded one.
+void copyPaddedImageCore(struct doubleImage *padded, struct doubleImage *image);
+void copyPaddedHalftoneCore(struct pxm_img *padded, struct pxm_img *halftone);
+
+void deallocatePaddedImage(struct doubleImage *image);
+void deallocatePaddedHalftone(struct pxm_img *halftone, int haloSize);
+
+// Sets a halftone pixel, and its copies in the halo when haloSize > 0.
+void setHalftonePixel(struct pxm_img *halftone, int haloSize, int rowIndex, int columnIndex, uint8_t value);
+
+// Subtracts a0 x Cpp centered at (rowIndex, columnIndex) from a padded cpe, keeping every halo copy equal to its core
+// pixel. The footprint must not wrap onto itself (2 x cpp->borderSize + 1 <= height, width).
+void updatePaddedCpe(struct doubleImage *cpe, struct doubleImage *cpp, double a0, int rowIndex, int columnIndex);
+
+#endif
@@ -0,0 +1,256 @@
+/******************************************************************
+* file: hvsCache.c
+* Implementing: Persistent on-disk cache of the HVS psf and its autocorrelation Cpp
+* The cache file holds a fixed header followed by the (2S+1)^2 psf and the (4S+1)^2 Cpp samples (dbsReal), row by row,
+* in the byte order of the machine that wrote it. Later runs with the same parameters map the file instead of
+* recomputing it.
+* Files are written to a temporary name and renamed, so concurrent runs never see a partial file.
+*******************************************************************/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dbs.h"
+#include "hvsCache.h"
+
+#define HVS_CACHE_MAGIC         "DBSHVS\0"
+
+// The longest cache path, and the room its temporary file adds to it (".XXXXXX").
+#define HVS_CACHE_PATH_SIZE     4096
+#define HVS_CACHE_SUFFIX_SIZE   32
+
+struct hvsCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	int32_t scaleFactor;
+	int32_t hvsSpreadSize;
+	int32_t psfBorderSize;
+	int32_t cppBorderSize;
+	int32_t sampleSize;
+};
+
+// A cache file mapped into memory, shared by the images that point into it.
+struct hvsMapping
+{
+	void *address;
+	size_t length;
+	int imageCount;
+};
+
+struct mappedImage
+{
+	struct doubleImage *image;
+	dbsReal **rows;
+	struct hvsMapping *mapping;
+	struct mappedImage *next;
+};
+
+static struct mappedImage *mappedImages = NULL;
+static pthread_mutex_t mappedImagesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t getTableLength(int borderSize) {
+
+	return (size_t) (2 * borderSize + 1) * (2 * borderSize + 1);
+}
+
+// Builds a centered image whose rows point into the mapping.
+static struct doubleImage* createMappedImage(struct hvsMapping *mapping, dbsReal *values, int borderSize) {
+
+	int side = 2 * borderSize + 1;
+
+	struct doubleImage *image = (struct doubleImage *) malloc(sizeof(struct doubleImage));
+	image->height = 1;
+	image->width = 1;
+	image->borderSize = borderSize;
+	image->haloSize = 0;
+	image->stride = side;
+	image->pixels = values + (size_t) borderSize * side + borderSize;
+
+	dbsReal **rows = (dbsReal **) malloc(side * sizeof(dbsReal *));
+	for (int i = 0; i < side; i++) {
+		rows[i] = values + (size_t) i * side + borderSize;
+	}
+	image->data = rows + borderSize;
+
+	struct mappedImage *entry = (struct mappedImage *) malloc(sizeof(struct mappedImage));
+	entry->image = image;
+	entry->rows = rows;
+	entry->mapping = mapping;
+
+	pthread_mutex_lock(&mappedImagesLock);
+	mapping->imageCount++;
+	entry->next = mappedImages;
+	mappedImages = entry;
+	pthread_mutex_unlock(&mappedImagesLock);
+
+	return image;
+}
+
+// Maps the cache file, and returns 1 if it holds the tables for this configuration.
+static int loadHvsTables(struct Config *config, char *cachePath, struct doubleImage **psf, struct doubleImage **cpp) {
+
+	int file = open(cachePath, O_RDONLY);
+	if (file < 0) {
+		return 0;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || (size_t) status.st_size < sizeof(struct hvsCacheHeader)) {
+		close(file);
+		return 0;
+	}
+
+	size_t length = (size_t) status.st_size;
+	void *address = mmap(NULL, length, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+
+	if (address == MAP_FAILED) {
+		return 0;
+	}
+
+	struct hvsCacheHeader *header = (struct hvsCacheHeader *) address;
+	int psfBorderSize = config->hvsSpreadSize;
+	int cppBorderSize = 2 * config->hvsSpreadSize;
+
+	if (memcmp(header->magic, HVS_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != HVS_CACHE_VERSION
+			|| header->scaleFactor != config->scaleFactor || header->hvsSpreadSize != config->hvsSpreadSize
+			|| header->psfBorderSize != psfBorderSize || header->cppBorderSize != cppBorderSize
+			|| header->sampleSize != (int32_t) sizeof(dbsReal)
+			|| length != sizeof(struct hvsCacheHeader) + (getTableLength(psfBorderSize) + getTableLength(cppBorderSize)) * sizeof(dbsReal)) {
+
+		munmap(address, length);
+		return 0;
+	}
+
+	struct hvsMapping *mapping = (struct hvsMapping *) malloc(sizeof(struct hvsMapping));
+	mapping->address = address;
+	mapping->length = length;
+	mapping->imageCount = 0;
+
+	dbsReal *values = (dbsReal *) (header + 1);
+	*psf = createMappedImage(mapping, values, psfBorderSize);
+	*cpp = createMappedImage(mapping, values + getTableLength(psfBorderSize), cppBorderSize);
+
+	return 1;
+}
+
+static int writeTable(FILE *file, struct doubleImage *image) {
+
+	for (int i = -image->borderSize; i <= image->borderSize; i++) {
+		if (fwrite(image->data[i] - image->borderSize, sizeof(dbsReal), 2 * image->borderSize + 1, file)
+				!= (size_t) (2 * image->borderSize + 1)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Writes the tables to a temporary file next to the cache file, and renames it into place.
+static void storeHvsTables(struct Config *config, char *cachePath, struct doubleImage *psf, struct doubleImage *cpp) {
+
+	char temporaryPath[HVS_CACHE_PATH_SIZE + HVS_CACHE_SUFFIX_SIZE];
+	int length = snprintf(temporaryPath, sizeof(temporaryPath), "%s.XXXXXX", cachePath);
+
+	if (length < 0 || (size_t) length >= sizeof(temporaryPath)) {
+		fprintf(stderr, "cannot write the HVS cache file %s: the path is too long\n", cachePath);
+		return;
+	}
+
+	// The threads of a portfolio or a sweep share the process id, so the temporary name comes from mkstemp.
+	int descriptor = mkstemp(temporaryPath);
+	if (descriptor < 0) {
+		fprintf(stderr, "cannot write the HVS cache file %s\n", temporaryPath);
+		return;
+	}
+
+	// mkstemp creates the file for its owner only, while the cache may be shared.
+	FILE *file = fchmod(descriptor, 0644) == 0 ? fdopen(descriptor, "wb") : NULL;
+	if (file == NULL) {
+		fprintf(stderr, "cannot write the HVS cache file %s\n", temporaryPath);
+		close(descriptor);
+		remove(temporaryPath);
+		return;
+	}
+
+	struct hvsCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HVS_CACHE_MAGIC, sizeof(header.magic));
+	header.version = HVS_CACHE_VERSION;
+	header.scaleFactor = config->scaleFactor;
+	header.hvsSpreadSize = config->hvsSpreadSize;
+	header.psfBorderSize = psf->borderSize;
+	header.cppBorderSize = cpp->borderSize;
+	header.sampleSize = sizeof(dbsReal);
+
+	int isWritten = fwrite(&header, sizeof(header), 1, file) == 1 && writeTable(file, psf) && writeTable(file, cpp);
+
+	if (fclose(file) != 0 || !isWritten || rename(temporaryPath, cachePath) != 0) {
+		fprintf(stderr, "cannot write the HVS cache file %s\n", cachePath);
+		remove(temporaryPath);
+	}
+}
+
+void getHvsTables(struct Config *config, struct doubleImage **psf, struct doubleImage **cpp) {
+
+	char cachePath[HVS_CACHE_PATH_SIZE];
+	int isCached = config->hvsCacheDirectory != NULL;
+
+	if (isCached) {
+
+		int length = snprintf(cachePath, sizeof(cachePath), "%s/hvs-%d-%d.bin", config->hvsCacheDirectory,
+				config->scaleFactor, config->hvsSpreadSize);
+
+		// A truncated path would name another file, so the tables are generated without the cache.
+		if (length < 0 || (size_t) length >= sizeof(cachePath)) {
+			fprintf(stderr, "cannot use the HVS cache in %s: the path is too long\n", config->hvsCacheDirectory);
+			isCached = 0;
+		}
+		else if (loadHvsTables(config, cachePath, psf, cpp)) {
+			return;
+		}
+	}
+
+	*psf = generateHvsFunction(config);
+	*cpp = generateCppFft(*psf);
+
+	if (isCached) {
+		storeHvsTables(config, cachePath, *psf, *cpp);
+	}
+}
+
+int releaseMappedHvsTable(struct doubleImage *image) {
+
+	pthread_mutex_lock(&mappedImagesLock);
+
+	struct mappedImage **link = &mappedImages;
+	while (*link != NULL && (*link)->image != image) {
+		link = &(*link)->next;
+	}
+
+	struct mappedImage *entry = *link;
+	if (entry == NULL) {
+		pthread_mutex_unlock(&mappedImagesLock);
+		return 0;
+	}
+
+	*link = entry->next;
+
+	struct hvsMapping *mapping = entry->mapping;
+	if (--mapping->imageCount == 0) {
+		munmap(mapping->address, mapping->length);
+		free(mapping);
+	}
+
+	pthread_mutex_unlock(&mappedImagesLock);
+
+	free(entry->rows);
+	free(entry->image);
+	free(entry);
+
+	return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef HVS_CACHE_H
+#define HVS_CACHE_H
+
+struct Config;
+struct doubleImage;
+
+// Version of the cache file layout. Files of another version are ignored, and rewritten.
+#define HVS_CACHE_VERSION       2
+
+// Returns the psf and Cpp for config->scaleFactor and config->hvsSpreadSize. When config->hvsCacheDirectory is set,
+// the tables are memory-mapped from its cache file, or computed and written to it when the file is missing or does
+// not match. Both images keep the centered indexing of generateHvsFunction / generateCpp, and are released with
+// deallocateShiftedImage.
+void getHvsTables(struct Config *config, struct doubleImage **psf, struct doubleImage **cpp);
+
+// Unmaps an image returned by getHvsTables from the cache file, and frees it. Returns 0, without doing anything, if
+// the image is not mapped.
+int releaseMappedHvsTable(struct doubleImage *image);
+
+#endif
@@ -0,0 +1,88 @@
+/******************************************************************
+* file: imageStorage.c
+* Implementing: Contiguous, aligned storage of the double images
+* The samples of an image, margin included, live in one block whose rows are padded to a multiple of
+* DBS_IMAGE_ALIGNMENT bytes. The row pointers of data are kept over that block, so that the code indexing data[i][j]
+* keeps working while it moves to the stride based accessors of dbs.h.
+* Large blocks are aligned on huge pages, and advised to be backed by them.
+*******************************************************************/
+
+#include <sys/mman.h>
+
+#include "dbs.h"
+#include "imageStorage.h"
+
+static size_t hugePageThreshold = DBS_HUGE_PAGE_SIZE;
+
+void setHugePageThreshold(size_t threshold) {
+
+	hugePageThreshold = threshold;
+}
+
+// Returns a zeroed block of at least size bytes.
+static dbsReal* allocateSamples(size_t size) {
+
+	size_t alignment = DBS_IMAGE_ALIGNMENT;
+
+	if (hugePageThreshold > 0 && size >= hugePageThreshold) {
+		alignment = DBS_HUGE_PAGE_SIZE;
+		size = (size + DBS_HUGE_PAGE_SIZE - 1) / DBS_HUGE_PAGE_SIZE * DBS_HUGE_PAGE_SIZE;
+	}
+
+	void *block = NULL;
+	if (posix_memalign(&block, alignment, size) != 0) {
+		fprintf(stderr, "cannot allocate %zu bytes of image storage\n", size);
+		exit(-1);
+	}
+
+#ifdef MADV_HUGEPAGE
+	// Only a hint: the block stays usable with small pages.
+	if (alignment == DBS_HUGE_PAGE_SIZE) {
+		madvise(block, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	memset(block, 0, size);
+
+	return (dbsReal *) block;
+}
+
+int getImageStride(int width) {
+
+	int samplesPerLine = DBS_IMAGE_ALIGNMENT / sizeof(dbsReal);
+
+	return (width + samplesPerLine - 1) / samplesPerLine * samplesPerLine;
+}
+
+struct doubleImage* createImage(int height, int width, int borderSize, int haloSize) {
+
+	int margin = borderSize + haloSize;
+	int rowCount = height + 2 * margin;
+
+	struct doubleImage *image = (struct doubleImage *) malloc(sizeof(struct doubleImage));
+	image->height = height;
+	image->width = width;
+	image->borderSize = borderSize;
+	image->haloSize = haloSize;
+	image->stride = getImageStride(width + 2 * margin);
+
+	dbsReal *samples = allocateSamples((size_t) rowCount * image->stride * sizeof(dbsReal));
+	image->pixels = samples + (ptrdiff_t) margin * image->stride + margin;
+
+	dbsReal **rows = (dbsReal **) malloc(rowCount * sizeof(dbsReal *));
+	for (int i = 0; i < rowCount; i++) {
+		rows[i] = samples + (ptrdiff_t) i * image->stride + margin;
+	}
+	image->data = rows + margin;
+
+	return image;
+}
+
+void deallocateImage(struct doubleImage *image) {
+
+	int margin = image->borderSize + image->haloSize;
+
+	free(image->pixels - (ptrdiff_t) margin * image->stride - margin);
+	free(image->data - margin);
+	free(image);
+}
@@ -0,0 +1,30 @@
+#ifndef IMAGE_STORAGE_H
+#define IMAGE_STORAGE_H
+
+#include <stddef.h>
+
+struct doubleImage;
+
+// The alignment of the first sample of every stored row, in bytes: a cache line, and the widest vector load of the
+// swap scans.
+#define DBS_IMAGE_ALIGNMENT     64
+
+// The size of a transparent huge page, and the default smallest image storage backed by huge pages.
+#define DBS_HUGE_PAGE_SIZE      (2 * 1024 * 1024)
+
+// Creates a zeroed image of height x width samples, with a margin of borderSize + haloSize samples on every side
+// (only one of them is expected to be non-zero). The samples are stored contiguously, with rows stride samples apart,
+// and both data and pixels are centered on the first sample inside the margin, so that negative indices reach into
+// it, as for cpp and psf.
+struct doubleImage* createImage(int height, int width, int borderSize, int haloSize);
+
+// Returns the stride, in samples, of stored rows of width samples (margin included).
+int getImageStride(int width);
+
+// Frees an image created by createImage.
+void deallocateImage(struct doubleImage *image);
+
+// Sets the smallest storage, in bytes, requested to be backed by huge pages. 0 disables huge pages.
+void setHugePageThreshold(size_t threshold);
+
+#endif
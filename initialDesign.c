@@ -0,0 +1,171 @@
+/******************************************************************
+* file: initialDesign.c
+* Implementing: The initial joint design of the C, M and Y patterns, alone or as a portfolio of random streams
+* The streams of a portfolio run on a thread pool, one stream per task, each on its own halftones and cpe planes, and
+* only read the input images and Cpp they share.
+*******************************************************************/
+
+#include "dbs.h"
+#include "allocate.h"
+#include "imageStorage.h"
+#include "initialDesign.h"
+#include "multiResolution.h"
+#include "randomStream.h"
+#include "threadPool.h"
+
+struct portfolioRun
+{
+	Config config;
+	struct doubleImage *inputImage;
+	struct doubleImage *inputImage2;
+	struct doubleImage *cpp;
+
+	struct pxm_img *halftoneCMY;
+	struct pxm_img *halftoneC;
+	struct pxm_img *halftoneM;
+	struct pxm_img *halftoneY;
+
+	// The wall time of the design, and the RMS errors of the CMY, C, M and Y planes at its end.
+	double seconds;
+	double rmsErrors[4];
+
+	char *output;
+	size_t outputSize;
+};
+
+void designInitialPatterns(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct doubleImage *cpp, struct randomStream *random, struct pxm_img *halftoneCMY, struct pxm_img *halftoneC,
+		struct pxm_img *halftoneM, struct pxm_img *halftoneY, double *rmsErrors) {
+
+	struct pxm_img *halftoneCM = createHalftone(halftoneCMY->height, halftoneCMY->width);
+
+	separateCM(halftoneCMY, halftoneCM, halftoneY, 0.66666, 0.33333, random);
+	separateCM(halftoneCM, halftoneC, halftoneM, 0.5, 0.5, random);
+	free_pxm(halftoneCM);
+
+	if (config->coarseDesignFactor > 1) {
+		designCoarsePatterns(config, inputImage, inputImage2, halftoneC, halftoneM, halftoneY, config->coarseDesignFactor);
+	}
+
+	fprintf(getDesignOutput(), "The halftoneC, M, Y is %f, %f, %f\n ", countNum(halftoneC), countNum(halftoneM),
+			countNum(halftoneY));
+
+	struct doubleImage *cpeCMY = calculateCpe(config, inputImage, halftoneCMY, cpp);
+	struct doubleImage *cpeC = calculateCpe(config, inputImage2, halftoneC, cpp);
+	struct doubleImage *cpeM = calculateCpe(config, inputImage2, halftoneM, cpp);
+	struct doubleImage *cpeY = calculateCpe(config, inputImage2, halftoneY, cpp);
+
+	performJointDBSRounds(config, inputImage2, halftoneCMY, cpeCMY, halftoneC, cpeC, halftoneM, cpeM, halftoneY, cpeY, cpp,
+			DBS_INITIAL_ROUND_COUNT);
+
+	if (rmsErrors != NULL) {
+		rmsErrors[0] = calculateRmsError(inputImage, halftoneCMY, cpeCMY, cpp);
+		rmsErrors[1] = calculateRmsError(inputImage2, halftoneC, cpeC, cpp);
+		rmsErrors[2] = calculateRmsError(inputImage2, halftoneM, cpeM, cpp);
+		rmsErrors[3] = calculateRmsError(inputImage2, halftoneY, cpeY, cpp);
+	}
+
+	deallocateImage(cpeCMY);
+	deallocateImage(cpeC);
+	deallocateImage(cpeM);
+	deallocateImage(cpeY);
+}
+
+static void performPortfolioRun(void *argument, int index) {
+
+	struct portfolioRun *run = &((struct portfolioRun *) argument)[index];
+	Config *config = &run->config;
+
+	// A portfolio of a sweep run goes on printing to the output of the run once the stream is done.
+	FILE *previousOutput = getDesignOutput();
+	FILE *output = open_memstream(&run->output, &run->outputSize);
+	setDesignOutput(output);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct randomStream random;
+	initRandomStream(&random, config->randomSeed, index);
+
+	run->halftoneCMY = getInitialHalftone(config->initialHalftonePath, run->inputImage, 255.0, &random);
+	run->halftoneC = createHalftone(run->halftoneCMY->height, run->halftoneCMY->width);
+	run->halftoneM = createHalftone(run->halftoneCMY->height, run->halftoneCMY->width);
+	run->halftoneY = createHalftone(run->halftoneCMY->height, run->halftoneCMY->width);
+
+	designInitialPatterns(config, run->inputImage, run->inputImage2, run->cpp, &random, run->halftoneCMY, run->halftoneC,
+			run->halftoneM, run->halftoneY, run->rmsErrors);
+
+	run->seconds = getElapsedSeconds(&start);
+
+	setDesignOutput(previousOutput);
+	fclose(output);
+}
+
+void designInitialPortfolio(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct doubleImage *cpp, struct pxm_img *halftoneCMY, struct pxm_img *halftoneC, struct pxm_img *halftoneM,
+		struct pxm_img *halftoneY, double *rmsErrors) {
+
+	FILE *designOutput = getDesignOutput();
+	int runCount = config->portfolioSeedCount;
+	struct portfolioRun *runs = (struct portfolioRun *) calloc(runCount, sizeof(struct portfolioRun));
+
+	struct threadPool *pool = createThreadPool(0);
+
+	// Every stream takes an equal share of the processors for its colored passes, unless the count is set.
+	int threadCount = config->threadCount > 0 ? config->threadCount : MAX(getThreadPoolSize(pool) / runCount, 1);
+
+	for (int k = 0; k < runCount; k++) {
+		runs[k].config = *config;
+		runs[k].config.threadCount = threadCount;
+		runs[k].inputImage = inputImage;
+		runs[k].inputImage2 = inputImage2;
+		runs[k].cpp = cpp;
+	}
+
+	fprintf(designOutput, "Portfolio of %d random streams of seed %u, %d at a time\n", runCount, config->randomSeed,
+			MIN(getThreadPoolSize(pool), runCount));
+	fflush(designOutput);
+
+	runParallelFor(pool, runCount, performPortfolioRun, runs);
+	destroyThreadPool(pool);
+
+	int bestRun = 0;
+
+	for (int k = 0; k < runCount; k++) {
+		fprintf(designOutput, "\n------------------------------------ Random stream %d ------------------------------------\n", k);
+		fwrite(runs[k].output, 1, runs[k].outputSize, designOutput);
+		free(runs[k].output);
+
+		double *errors = runs[k].rmsErrors;
+		double *bestErrors = runs[bestRun].rmsErrors;
+		if (errors[0] + errors[1] + errors[2] + errors[3] < bestErrors[0] + bestErrors[1] + bestErrors[2] + bestErrors[3]) {
+			bestRun = k;
+		}
+	}
+
+	fprintf(designOutput, "\n%6s %9s %9s %9s %9s %9s\n", "stream", "seconds", "rmsCMY", "rmsC", "rmsM", "rmsY");
+
+	for (int k = 0; k < runCount; k++) {
+		fprintf(designOutput, "%6d %9.2f %9.6f %9.6f %9.6f %9.6f%s\n", k, runs[k].seconds, runs[k].rmsErrors[0],
+				runs[k].rmsErrors[1], runs[k].rmsErrors[2], runs[k].rmsErrors[3], k == bestRun ? "  <-" : "");
+	}
+	fflush(designOutput);
+
+	samepatternInto(runs[bestRun].halftoneCMY, halftoneCMY);
+	samepatternInto(runs[bestRun].halftoneC, halftoneC);
+	samepatternInto(runs[bestRun].halftoneM, halftoneM);
+	samepatternInto(runs[bestRun].halftoneY, halftoneY);
+
+	if (rmsErrors != NULL) {
+		memcpy(rmsErrors, runs[bestRun].rmsErrors, 4 * sizeof(double));
+	}
+
+	for (int k = 0; k < runCount; k++) {
+		free_pxm(runs[k].halftoneCMY);
+		free_pxm(runs[k].halftoneC);
+		free_pxm(runs[k].halftoneM);
+		free_pxm(runs[k].halftoneY);
+	}
+
+	free(runs);
+}
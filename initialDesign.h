@@ -0,0 +1,27 @@
+#ifndef INITIAL_DESIGN_H
+#define INITIAL_DESIGN_H
+
+struct Config;
+struct doubleImage;
+struct pxm_img;
+struct randomStream;
+
+// Runs the initial joint design on the union halftoneCMY: splits its dots between halftoneC, halftoneM and halftoneY
+// with separateCM (2/3 to C and M, 1/3 to Y, then C and M in halves), drawing from random, designs the split at
+// 1/coarseDesignFactor of the size first (see multiResolution.h), and runs DBS_INITIAL_ROUND_COUNT rounds of
+// performJointDBSRounds. Stores the RMS errors of the CMY, C, M and Y planes at its end in rmsErrors, unless it is NULL.
+void designInitialPatterns(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct doubleImage *cpp, struct randomStream *random, struct pxm_img *halftoneCMY, struct pxm_img *halftoneC,
+		struct pxm_img *halftoneM, struct pxm_img *halftoneY, double *rmsErrors);
+
+// Runs the initial joint design from the random initial halftone of every stream of the portfolio (see
+// portfolioSeedCount in dbs.h), several at a time, each on its own share of the processors, and prints the output of
+// every stream followed by a table of its runtime and final RMS errors. Stores the patterns of the stream with the
+// lowest sum of errors in halftoneCMY, halftoneC, halftoneM and halftoneY, and its errors in rmsErrors, unless it is
+// NULL. Streams of the same errors go to the lowest
+// index, and the colored block order gives the same patterns for any thread count, so the choice repeats itself.
+void designInitialPortfolio(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct doubleImage *cpp, struct pxm_img *halftoneCMY, struct pxm_img *halftoneC, struct pxm_img *halftoneM,
+		struct pxm_img *halftoneY, double *rmsErrors);
+
+#endif
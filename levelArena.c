@@ -0,0 +1,168 @@
+/******************************************************************
+* file: levelArena.c
+* Implementing: Resettable arena for the per-level temporaries of the screen design
+* Allocations are carved out of large aligned chunks, and released all together when the next level starts, instead
+* of going through malloc / free one image at a time.
+*******************************************************************/
+
+#include "dbs.h"
+#include "levelArena.h"
+#include "imageStorage.h"
+
+struct arenaChunk
+{
+	char *memory;
+	size_t capacity;
+	size_t usedSize;
+	struct arenaChunk *next;
+};
+
+static struct arenaChunk* createArenaChunk(size_t capacity) {
+
+	struct arenaChunk *chunk = (struct arenaChunk *) malloc(sizeof(struct arenaChunk));
+
+	if (posix_memalign((void **) &chunk->memory, DBS_IMAGE_ALIGNMENT, capacity) != 0) {
+		fprintf(stderr, "cannot allocate an arena chunk of %zu bytes\n", capacity);
+		exit(-1);
+	}
+
+	chunk->capacity = capacity;
+	chunk->usedSize = 0;
+	chunk->next = NULL;
+
+	return chunk;
+}
+
+static void deallocateArenaChunks(struct arenaChunk *chunk) {
+
+	while (chunk != NULL) {
+		struct arenaChunk *next = chunk->next;
+		free(chunk->memory);
+		free(chunk);
+		chunk = next;
+	}
+}
+
+struct levelArena* createLevelArena(size_t capacity) {
+
+	struct levelArena *arena = (struct levelArena *) malloc(sizeof(struct levelArena));
+
+	capacity = MAX(capacity, DBS_IMAGE_ALIGNMENT);
+	arena->firstChunk = createArenaChunk(capacity);
+	arena->currentChunk = arena->firstChunk;
+	arena->usedSize = 0;
+	arena->peakUsedSize = 0;
+	arena->capacity = capacity;
+
+	return arena;
+}
+
+void deallocateLevelArena(struct levelArena *arena) {
+
+	deallocateArenaChunks(arena->firstChunk);
+	free(arena);
+}
+
+void* allocateFromArena(struct levelArena *arena, size_t size) {
+
+	size = (size + DBS_IMAGE_ALIGNMENT - 1) / DBS_IMAGE_ALIGNMENT * DBS_IMAGE_ALIGNMENT;
+
+	// Move on to the next chunk with enough room, or add one. The chunks past the current one are empty.
+	struct arenaChunk *chunk = arena->currentChunk;
+	while (chunk->usedSize + size > chunk->capacity) {
+
+		if (chunk->next == NULL) {
+			chunk->next = createArenaChunk(MAX(size, chunk->capacity));
+			arena->capacity += chunk->next->capacity;
+		}
+
+		chunk = chunk->next;
+	}
+
+	void *block = chunk->memory + chunk->usedSize;
+	chunk->usedSize += size;
+	arena->currentChunk = chunk;
+
+	arena->usedSize += size;
+	arena->peakUsedSize = MAX(arena->peakUsedSize, arena->usedSize);
+
+	memset(block, 0, size);
+
+	return block;
+}
+
+void resetLevelArena(struct levelArena *arena) {
+
+	// A single chunk of the peak size holds any level seen so far, without the room lost at the end of each chunk.
+	if (arena->firstChunk->next != NULL) {
+		deallocateArenaChunks(arena->firstChunk);
+		arena->firstChunk = createArenaChunk(arena->peakUsedSize);
+		arena->capacity = arena->peakUsedSize;
+	}
+
+	arena->firstChunk->usedSize = 0;
+	arena->currentChunk = arena->firstChunk;
+	arena->usedSize = 0;
+}
+
+struct arenaMark getLevelArenaMark(struct levelArena *arena) {
+
+	struct arenaMark mark;
+	mark.chunk = arena->currentChunk;
+	mark.chunkUsedSize = arena->currentChunk->usedSize;
+	mark.usedSize = arena->usedSize;
+
+	return mark;
+}
+
+void rewindLevelArena(struct levelArena *arena, struct arenaMark mark) {
+
+	mark.chunk->usedSize = mark.chunkUsedSize;
+	for (struct arenaChunk *chunk = mark.chunk->next; chunk != NULL; chunk = chunk->next) {
+		chunk->usedSize = 0;
+	}
+
+	arena->currentChunk = mark.chunk;
+	arena->usedSize = mark.usedSize;
+}
+
+size_t getLevelArenaPeakUsage(struct levelArena *arena) {
+
+	return arena->peakUsedSize;
+}
+
+struct doubleImage* createArenaImage(struct levelArena *arena, int height, int width) {
+
+	struct doubleImage *image = (struct doubleImage *) allocateFromArena(arena, sizeof(struct doubleImage));
+	image->height = height;
+	image->width = width;
+	image->borderSize = 0;
+	image->haloSize = 0;
+	image->stride = getImageStride(width);
+	image->pixels = (dbsReal *) allocateFromArena(arena, (size_t) height * image->stride * sizeof(dbsReal));
+	image->data = (dbsReal **) allocateFromArena(arena, height * sizeof(dbsReal *));
+
+	for (int i = 0; i < height; i++) {
+		image->data[i] = IMAGE_ROW(image, i);
+	}
+
+	return image;
+}
+
+struct pxm_img* createArenaHalftone(struct levelArena *arena, int height, int width) {
+
+	int stride = (width + DBS_IMAGE_ALIGNMENT - 1) / DBS_IMAGE_ALIGNMENT * DBS_IMAGE_ALIGNMENT;
+
+	struct pxm_img *halftone = (struct pxm_img *) allocateFromArena(arena, sizeof(struct pxm_img));
+	halftone->height = height;
+	halftone->width = width;
+	halftone->pxm_type = 'g';
+	halftone->mono = (uint8_t **) allocateFromArena(arena, height * sizeof(uint8_t *));
+
+	uint8_t *pixels = (uint8_t *) allocateFromArena(arena, (size_t) height * stride);
+	for (int i = 0; i < height; i++) {
+		halftone->mono[i] = pixels + (size_t) i * stride;
+	}
+
+	return halftone;
+}
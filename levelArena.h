@@ -0,0 +1,56 @@
+#ifndef LEVEL_ARENA_H
+#define LEVEL_ARENA_H
+
+#include <stddef.h>
+
+struct doubleImage;
+struct pxm_img;
+struct arenaChunk;
+
+// A bump allocator for the temporaries of one design level. Everything allocated from it is released at once by
+// resetLevelArena, and must never be passed to deallocateImage or free_pxm.
+struct levelArena
+{
+	struct arenaChunk *firstChunk;
+	struct arenaChunk *currentChunk;
+
+	// The bytes handed out since the last reset, alignment included, their maximum since the arena was created, and
+	// the total size of the chunks.
+	size_t usedSize;
+	size_t peakUsedSize;
+	size_t capacity;
+};
+
+// A position of the arena, to release the allocations made after it with rewindLevelArena.
+struct arenaMark
+{
+	struct arenaChunk *chunk;
+	size_t chunkUsedSize;
+	size_t usedSize;
+};
+
+// Creates an arena with a first chunk of capacity bytes. Further chunks are added when it is full.
+struct levelArena* createLevelArena(size_t capacity);
+
+void deallocateLevelArena(struct levelArena *arena);
+
+// Returns size zeroed bytes, aligned to DBS_IMAGE_ALIGNMENT.
+void* allocateFromArena(struct levelArena *arena, size_t size);
+
+// Releases every allocation. When the last level needed several chunks, they are replaced by a single one of the peak
+// usage, so that the following levels reuse the same memory.
+void resetLevelArena(struct levelArena *arena);
+
+struct arenaMark getLevelArenaMark(struct levelArena *arena);
+
+void rewindLevelArena(struct levelArena *arena, struct arenaMark mark);
+
+// Returns the largest number of bytes the arena has held at once.
+size_t getLevelArenaPeakUsage(struct levelArena *arena);
+
+// Creates a zeroed image (without margin), or a zeroed halftone, in the arena. The image has the layout of
+// createImage.
+struct doubleImage* createArenaImage(struct levelArena *arena, int height, int width);
+struct pxm_img* createArenaHalftone(struct levelArena *arena, int height, int width);
+
+#endif
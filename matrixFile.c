@@ -0,0 +1,260 @@
+/******************************************************************
+* file: matrixFile.c
+* Implementing: Binary threshold matrices updated in place
+* A level of the design assigns a few entries of each matrix, so only the runs of entries it changed are written again
+* with pwrite, instead of formatting the whole matrix as text.
+*******************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dbs.h"
+#include "matrixFile.h"
+#include "imageStorage.h"
+
+static void putLittleEndian(unsigned char *bytes, uint64_t value, int size) {
+
+	for (int k = 0; k < size; k++) {
+		bytes[k] = (unsigned char) (value >> (8 * k));
+	}
+}
+
+static uint64_t getLittleEndian(const unsigned char *bytes, int size) {
+
+	uint64_t value = 0;
+
+	for (int k = 0; k < size; k++) {
+		value |= (uint64_t) bytes[k] << (8 * k);
+	}
+
+	return value;
+}
+
+static uint64_t getEntryWeight(struct matrixFile *file, int rowIndex, int columnIndex) {
+
+	return 2 * ((uint64_t) rowIndex * file->width + columnIndex) + 1;
+}
+
+static int writeAt(struct matrixFile *file, const void *data, size_t size, off_t offset) {
+
+	if (pwrite(file->descriptor, data, size, offset) != (ssize_t) size) {
+		fprintf(stderr, "cannot write a matrix file\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int writeChecksum(struct matrixFile *file) {
+
+	unsigned char bytes[8];
+	putLittleEndian(bytes, file->checksum, 8);
+
+	return writeAt(file, bytes, 8, DBS_MATRIX_FILE_HEADER_SIZE - 8);
+}
+
+// Writes count levels starting at an entry.
+static int writeLevels(struct matrixFile *file, long index, const uint16_t *levels, int count, unsigned char *buffer) {
+
+	for (int k = 0; k < count; k++) {
+		putLittleEndian(buffer + (size_t) k * file->entrySize, levels[k], file->entrySize);
+	}
+
+	off_t offset = DBS_MATRIX_FILE_HEADER_SIZE + (off_t) index * file->entrySize;
+	return writeAt(file, buffer, (size_t) count * file->entrySize, offset);
+}
+
+struct matrixFile* createMatrixFile(char *path, struct doubleImage *matrix, int maxLevel) {
+
+	struct matrixFile *file = (struct matrixFile *) malloc(sizeof(struct matrixFile));
+	file->descriptor = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	file->height = matrix->height;
+	file->width = matrix->width;
+	file->entrySize = maxLevel > 255 ? 2 : 1;
+	file->levels = (uint16_t *) malloc((size_t) matrix->height * matrix->width * sizeof(uint16_t));
+	file->checksum = 0;
+
+	if (file->descriptor < 0) {
+		fprintf(stderr, "cannot create the matrix file %s\n", path);
+		exit(-1);
+	}
+
+	unsigned char header[DBS_MATRIX_FILE_HEADER_SIZE] = { 0 };
+	memcpy(header, DBS_MATRIX_FILE_MAGIC, 8);
+	putLittleEndian(header + 8, file->height, 4);
+	putLittleEndian(header + 12, file->width, 4);
+	putLittleEndian(header + 16, file->entrySize, 4);
+	int status = writeAt(file, header, DBS_MATRIX_FILE_HEADER_SIZE, 0);
+
+	unsigned char *buffer = (unsigned char *) malloc((size_t) file->width * file->entrySize);
+
+	for (int i = 0; i < file->height; i++) {
+
+		uint16_t *levels = file->levels + (size_t) i * file->width;
+
+		for (int j = 0; j < file->width; j++) {
+			levels[j] = (uint16_t) (unsigned int) matrix->data[i][j];
+			file->checksum += levels[j] * getEntryWeight(file, i, j);
+		}
+
+		status |= writeLevels(file, (long) i * file->width, levels, file->width, buffer);
+	}
+
+	free(buffer);
+	status |= writeChecksum(file);
+
+	if (status != 0) {
+		fprintf(stderr, "cannot create the matrix file %s\n", path);
+		exit(-1);
+	}
+
+	return file;
+}
+
+int collectMatrixChanges(struct matrixFile *file, struct doubleImage *matrix, struct matrixChange **changes) {
+
+	int count = 0;
+	int capacity = 0;
+	*changes = NULL;
+
+	for (int i = 0; i < file->height; i++) {
+
+		uint16_t *levels = file->levels + (size_t) i * file->width;
+
+		for (int j = 0; j < file->width; j++) {
+
+			uint16_t level = (uint16_t) (unsigned int) matrix->data[i][j];
+
+			if (level != levels[j]) {
+
+				if (count == capacity) {
+					capacity = MAX(2 * capacity, 256);
+					*changes = (struct matrixChange *) realloc(*changes, capacity * sizeof(struct matrixChange));
+				}
+
+				struct matrixChange *change = *changes + count++;
+				change->index = (long) i * file->width + j;
+				change->level = level;
+				change->previousLevel = levels[j];
+
+				levels[j] = level;
+			}
+		}
+	}
+
+	return count;
+}
+
+int writeMatrixChanges(struct matrixFile *file, struct matrixChange *changes, int count) {
+
+	if (count == 0) {
+		return 0;
+	}
+
+	uint16_t *levels = (uint16_t *) malloc((size_t) file->width * sizeof(uint16_t));
+	unsigned char *buffer = (unsigned char *) malloc((size_t) file->width * file->entrySize);
+	int status = 0;
+
+	// A single write covers every run of adjacent changed entries of a row.
+	for (int first = 0; first < count;) {
+
+		long rowIndex = changes[first].index / file->width;
+		int last = first;
+
+		levels[0] = changes[first].level;
+		while (last + 1 < count && changes[last + 1].index == changes[last].index + 1
+				&& changes[last + 1].index / file->width == rowIndex) {
+			last++;
+			levels[last - first] = changes[last].level;
+		}
+
+		for (int k = first; k <= last; k++) {
+			file->checksum += (changes[k].level - (uint64_t) changes[k].previousLevel) * (2 * (uint64_t) changes[k].index + 1);
+		}
+
+		status |= writeLevels(file, changes[first].index, levels, last - first + 1, buffer);
+		first = last + 1;
+	}
+
+	free(levels);
+	free(buffer);
+
+	return status | writeChecksum(file);
+}
+
+void syncMatrixFile(struct matrixFile *file, struct doubleImage *matrix) {
+
+	struct matrixChange *changes;
+	int count = collectMatrixChanges(file, matrix, &changes);
+
+	int status = writeMatrixChanges(file, changes, count);
+	free(changes);
+
+	if (status != 0) {
+		exit(-1);
+	}
+}
+
+void closeMatrixFile(struct matrixFile *file) {
+
+	close(file->descriptor);
+	free(file->levels);
+	free(file);
+}
+
+// Reports a matrix file that cannot be read, and stops.
+static void failMatrixFile(char *path, char *reason) {
+
+	fprintf(stderr, "cannot read the matrix file %s: %s\n", path, reason);
+	exit(-1);
+}
+
+struct doubleImage* readMatrixFile(char *path) {
+
+	FILE *input = fopen(path, "rb");
+	if (input == NULL) {
+		failMatrixFile(path, "it cannot be opened");
+	}
+
+	unsigned char header[DBS_MATRIX_FILE_HEADER_SIZE];
+	if (fread(header, 1, DBS_MATRIX_FILE_HEADER_SIZE, input) != DBS_MATRIX_FILE_HEADER_SIZE ||
+		memcmp(header, DBS_MATRIX_FILE_MAGIC, 8) != 0) {
+		failMatrixFile(path, "it is not a matrix file");
+	}
+
+	int height = (int) getLittleEndian(header + 8, 4);
+	int width = (int) getLittleEndian(header + 12, 4);
+	int entrySize = (int) getLittleEndian(header + 16, 4);
+	uint64_t expectedChecksum = getLittleEndian(header + 24, 8);
+
+	if (height <= 0 || width <= 0 || (entrySize != 1 && entrySize != 2)) {
+		failMatrixFile(path, "its header is damaged");
+	}
+
+	struct doubleImage *matrix = createImage(height, width, 0, 0);
+	unsigned char *buffer = (unsigned char *) malloc((size_t) width * entrySize);
+	uint64_t checksum = 0;
+
+	for (int i = 0; i < height; i++) {
+
+		if (fread(buffer, entrySize, width, input) != (size_t) width) {
+			failMatrixFile(path, "it is truncated");
+		}
+
+		for (int j = 0; j < width; j++) {
+
+			uint64_t level = getLittleEndian(buffer + (size_t) j * entrySize, entrySize);
+			matrix->data[i][j] = (dbsReal) level;
+			checksum += level * (2 * ((uint64_t) i * width + j) + 1);
+		}
+	}
+
+	free(buffer);
+	fclose(input);
+
+	if (checksum != expectedChecksum) {
+		failMatrixFile(path, "its checksum does not match");
+	}
+
+	return matrix;
+}
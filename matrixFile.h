@@ -0,0 +1,58 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdint.h>
+
+struct doubleImage;
+
+// A threshold matrix stored in binary, and kept up to date in place as the design assigns levels. The file holds a
+// 32 byte header, DBS_MATRIX_FILE_MAGIC followed by the little endian height, width, entry size (1 or 2 bytes), a zero
+// word and the checksum, and then the levels row by row, as little endian entries of that size.
+//
+// The checksum is the sum of level[k] x (2k + 1) over the entries, modulo 2^64, so that changing an entry updates it
+// without reading the others.
+
+#define DBS_MATRIX_FILE_MAGIC "DBSMTX01"
+#define DBS_MATRIX_FILE_HEADER_SIZE 32
+
+struct matrixFile
+{
+	int descriptor;
+	int height;
+	int width;
+	int entrySize;
+
+	// The levels last collected from the matrix, and the checksum of the levels written. The levels belong to the
+	// thread collecting the changes, and the checksum to the one writing them.
+	uint16_t *levels;
+	uint64_t checksum;
+};
+
+// An entry whose level changed.
+struct matrixChange
+{
+	long index;
+	uint16_t level;
+	uint16_t previousLevel;
+};
+
+// Creates the file of a matrix whose levels go up to maxLevel, and writes the matrix in full.
+struct matrixFile* createMatrixFile(char *path, struct doubleImage *matrix, int maxLevel);
+
+// Writes the levels of the matrix that changed since the last write, and the new checksum.
+void syncMatrixFile(struct matrixFile *file, struct doubleImage *matrix);
+
+// Returns the number of entries of the matrix that changed since the last collection, and sets changes to a malloc'ed
+// array of them in raster order (NULL when there are none). Collecting and writing the changes may happen on
+// different threads, as long as the changes are written in the order they were collected.
+int collectMatrixChanges(struct matrixFile *file, struct doubleImage *matrix, struct matrixChange **changes);
+
+// Writes collected changes, and the new checksum. Returns 0, or -1 if the file could not be written.
+int writeMatrixChanges(struct matrixFile *file, struct matrixChange *changes, int count);
+
+void closeMatrixFile(struct matrixFile *file);
+
+// Reads a matrix file, and checks its checksum. A damaged file is fatal.
+struct doubleImage* readMatrixFile(char *path);
+
+#endif
@@ -0,0 +1,23 @@
+/******************************************************************
+* file: matrixToText.c
+* Implementing: Conversion of a binary threshold matrix to the text format
+* Gives the text matrix of a design that is still running, or of one whose text matrices were not written.
+*******************************************************************/
+
+#include "dbs.h"
+#include "matrixFile.h"
+#include "imageStorage.h"
+
+int main(int argc, char **argv) {
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s matrix.bin matrix.txt\n", argv[0]);
+		return -1;
+	}
+
+	struct doubleImage *matrix = readMatrixFile(argv[1]);
+	writeMatrix(matrix, argv[2]);
+	deallocateImage(matrix);
+
+	return 0;
+}
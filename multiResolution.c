@@ -0,0 +1,142 @@
+/******************************************************************
+* file: multiResolution.c
+* Implementing: Coarse to fine design of the initial C, M and Y patterns
+* Every halving of the size designs the split of the dots of each phase of the 2 x 2 lattice on its own, and writes it
+* back to the dots of the size above it.
+*******************************************************************/
+
+#include "dbs.h"
+#include "allocate.h"
+#include "imageStorage.h"
+#include "hvsCache.h"
+#include "fftConvolve.h"
+#include "multiResolution.h"
+
+struct doubleImage* downsampleImage(struct doubleImage *image, int factor) {
+
+	struct doubleImage *coarse = createImage(image->height / factor, image->width / factor, 0, 0);
+
+	for (int i = 0; i < coarse->height; i++) {
+		for (int j = 0; j < coarse->width; j++) {
+
+			double sum = 0.0;
+			for (int k = 0; k < factor; k++) {
+				for (int l = 0; l < factor; l++) {
+					sum += image->data[factor * i + k][factor * j + l];
+				}
+			}
+
+			coarse->data[i][j] = sum / (factor * factor);
+		}
+	}
+
+	return coarse;
+}
+
+// Copies the pixels of a phase of the factor x factor lattice of a halftone (rows rowPhase + factor x i, columns
+// columnPhase + factor x j) to a halftone of 1/factor of its size, or back when toLattice is set.
+static void copyLatticePhase(struct pxm_img *halftone, struct pxm_img *lattice, int factor, int rowPhase, int columnPhase,
+		int toLattice) {
+
+	for (int i = 0; i < lattice->height; i++) {
+		for (int j = 0; j < lattice->width; j++) {
+
+			uint8_t *pixel = &halftone->mono[factor * i + rowPhase][factor * j + columnPhase];
+
+			if (toLattice) {
+				lattice->mono[i][j] = *pixel;
+			}
+			else {
+				*pixel = lattice->mono[i][j];
+			}
+		}
+	}
+}
+
+void designCoarsePatterns(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct pxm_img *halftoneC, struct pxm_img *halftoneM, struct pxm_img *halftoneY, int factor) {
+
+	if (factor < 2 || (factor & (factor - 1)) != 0 || inputImage->height % factor != 0 || inputImage->width % factor != 0) {
+		fprintf(stderr, "cannot design the %dx%d patterns at 1/%d of their size\n", inputImage->height, inputImage->width, factor);
+		exit(-1);
+	}
+
+	// The model of the halved patterns sees them from half the distance, in pixels, and their swaps reach half as far.
+	struct Config coarseConfig = *config;
+	coarseConfig.scaleFactor = config->scaleFactor / 2;
+	coarseConfig.swapSize = (config->swapSize / 2) | 1;
+	coarseConfig.MatrixSize = config->MatrixSize / 2;
+
+	struct doubleImage *coarseImage = downsampleImage(inputImage, 2);
+	struct doubleImage *coarseImage2 = downsampleImage(inputImage2, 2);
+
+	int height = coarseImage->height;
+	int width = coarseImage->width;
+
+	struct doubleImage *psf;
+	struct doubleImage *cpp;
+	getHvsTables(&coarseConfig, &psf, &cpp);
+
+	if (chooseConvolutionMethod(&coarseConfig, coarseImage, cpp) == DBS_CONVOLUTION_FFT) {
+		prepareKernelSpectrum(cpp, height, width);
+	}
+
+	struct pxm_img *planes[3] = { halftoneC, halftoneM, halftoneY };
+	struct pxm_img *coarsePlanes[4];
+	for (int k = 0; k < 4; k++) {
+		coarsePlanes[k] = createHalftone(height, width);
+	}
+
+	// Every phase of the 2 x 2 lattice holds a quarter of the dots, at the density of the whole.
+	for (int phase = 0; phase < 4; phase++) {
+
+		int rowPhase = phase / 2;
+		int columnPhase = phase % 2;
+
+		for (int k = 0; k < 3; k++) {
+			copyLatticePhase(planes[k], coarsePlanes[k], 2, rowPhase, columnPhase, 1);
+		}
+
+		if (factor > 2) {
+			designCoarsePatterns(&coarseConfig, coarseImage, coarseImage2, coarsePlanes[0], coarsePlanes[1], coarsePlanes[2],
+					factor / 2);
+		}
+
+		fprintf(getDesignOutput(), "Coarse joint design of lattice phase %d at %dx%d\n", phase, height, width);
+
+		// The union of the three patterns.
+		struct pxm_img *coarseCMY = coarsePlanes[3];
+		for (int i = 0; i < height; i++) {
+			for (int j = 0; j < width; j++) {
+				coarseCMY->mono[i][j] = coarsePlanes[0]->mono[i][j] | coarsePlanes[1]->mono[i][j] | coarsePlanes[2]->mono[i][j];
+			}
+		}
+
+		struct doubleImage *cpeCMY = calculateCpe(&coarseConfig, coarseImage, coarseCMY, cpp);
+		struct doubleImage *cpeC = calculateCpe(&coarseConfig, coarseImage2, coarsePlanes[0], cpp);
+		struct doubleImage *cpeM = calculateCpe(&coarseConfig, coarseImage2, coarsePlanes[1], cpp);
+		struct doubleImage *cpeY = calculateCpe(&coarseConfig, coarseImage2, coarsePlanes[2], cpp);
+
+		performJointDBSRounds(&coarseConfig, coarseImage2, coarseCMY, cpeCMY, coarsePlanes[0], cpeC, coarsePlanes[1], cpeM,
+				coarsePlanes[2], cpeY, cpp, DBS_INITIAL_ROUND_COUNT);
+
+		for (int k = 0; k < 3; k++) {
+			copyLatticePhase(planes[k], coarsePlanes[k], 2, rowPhase, columnPhase, 0);
+		}
+
+		deallocateImage(cpeCMY);
+		deallocateImage(cpeC);
+		deallocateImage(cpeM);
+		deallocateImage(cpeY);
+	}
+
+	for (int k = 0; k < 4; k++) {
+		free_pxm(coarsePlanes[k]);
+	}
+
+	deallocateShiftedImage(cpp);
+	deallocateShiftedImage(psf);
+
+	deallocateImage(coarseImage);
+	deallocateImage(coarseImage2);
+}
@@ -0,0 +1,27 @@
+#ifndef MULTI_RESOLUTION_H
+#define MULTI_RESOLUTION_H
+
+struct Config;
+struct doubleImage;
+struct pxm_img;
+
+// Coarse to fine design of the initial C, M and Y patterns (see coarseDesignFactor in dbs.h). The initial joint design
+// only moves the colorants between the dots of halftoneCMY, whose random split leaves large scale structure that the
+// full size passes need many swaps to remove. Designing the split at a fraction of the size first removes most of it at
+// a fraction of the cost, and leaves the full size passes with fewer swaps.
+
+// Returns an image whose pixels are the means of the factor x factor blocks of image, whose size is a multiple of
+// factor. It is freed with deallocateImage.
+struct doubleImage* downsampleImage(struct doubleImage *image, int factor);
+
+// Designs the split of the dots of the initial halftone between halftoneC, halftoneM and halftoneY (e.g. that of
+// separateCM) at 1/factor of the size first. Each of the four phases of the 2 x 2 lattice of the patterns (every other
+// row and column) holds a quarter of the dots at the density of the whole, and its split is designed on its own at half
+// the size, with DBS_INITIAL_ROUND_COUNT rounds of performJointDBSRounds, after those of its own phases when factor is
+// larger than 2. Only colorants are swapped, so the union and the dot count of every pattern are kept. Each halving
+// halves the scaleFactor (the viewing distance in pixels) and the swapSize. factor is a power of 2; exits if the inputs
+// cannot be divided by it.
+void designCoarsePatterns(struct Config *config, struct doubleImage *inputImage, struct doubleImage *inputImage2,
+		struct pxm_img *halftoneC, struct pxm_img *halftoneM, struct pxm_img *halftoneY, int factor);
+
+#endif
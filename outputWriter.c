@@ -0,0 +1,272 @@
+/******************************************************************
+* file: outputWriter.c
+* Implementing: Background writer of the design outputs
+* The jobs wait in a ring buffer until the writer thread takes them in order, so that a slow disk only holds up the
+* design once the buffer is full.
+*******************************************************************/
+
+#include <pthread.h>
+
+#include "dbs.h"
+#include "outputWriter.h"
+#include "matrixFile.h"
+#include "imageStorage.h"
+
+#define OUTPUT_JOB_HALFTONE_IMAGE 0
+#define OUTPUT_JOB_MATRIX_TEXT 1
+#define OUTPUT_JOB_MATRIX_CHANGES 2
+
+struct outputJob
+{
+	int type;
+	char *path;
+
+	struct pxm_img *halftone;
+	struct doubleImage *matrix;
+
+	struct matrixFile *file;
+	struct matrixChange *changes;
+	int changeCount;
+};
+
+struct outputWriter
+{
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	pthread_cond_t jobQueued;
+	pthread_cond_t jobDone;
+
+	// The ring buffer of the queued jobs. The first one stays queued while it is being written.
+	struct outputJob *jobs;
+	int capacity;
+	int firstJobIndex;
+	int jobCount;
+
+	int failureCount;
+	int isShuttingDown;
+
+	// The next running writer, to flush them all at exit.
+	struct outputWriter *next;
+};
+
+static pthread_mutex_t runningWritersLock = PTHREAD_MUTEX_INITIALIZER;
+static struct outputWriter *runningWriters = NULL;
+static int isExitFlushRegistered = 0;
+
+// Returns 0, or -1 if the job could not be written.
+static int runOutputJob(struct outputJob *job) {
+
+	switch (job->type) {
+	case OUTPUT_JOB_HALFTONE_IMAGE:
+		return writeHalftoneImage(job->halftone, job->path);
+	case OUTPUT_JOB_MATRIX_TEXT:
+		return writeMatrix(job->matrix, job->path);
+	default:
+		return writeMatrixChanges(job->file, job->changes, job->changeCount);
+	}
+}
+
+static void releaseOutputJob(struct outputJob *job) {
+
+	if (job->halftone != NULL) {
+		free(job->halftone->mono[0]);
+		free(job->halftone->mono);
+		free(job->halftone);
+	}
+
+	if (job->matrix != NULL) {
+		deallocateImage(job->matrix);
+	}
+
+	free(job->path);
+	free(job->changes);
+}
+
+static void* runOutputWriter(void *argument) {
+
+	struct outputWriter *writer = (struct outputWriter *) argument;
+
+	pthread_mutex_lock(&writer->lock);
+
+	for (;;) {
+
+		while (writer->jobCount == 0 && !writer->isShuttingDown) {
+			pthread_cond_wait(&writer->jobQueued, &writer->lock);
+		}
+
+		if (writer->jobCount == 0) {
+			break;
+		}
+
+		// The job is written without the lock, so that the design threads can keep queueing.
+		struct outputJob *job = &writer->jobs[writer->firstJobIndex];
+		pthread_mutex_unlock(&writer->lock);
+
+		int status = runOutputJob(job);
+		releaseOutputJob(job);
+
+		pthread_mutex_lock(&writer->lock);
+
+		if (status != 0) {
+			writer->failureCount++;
+		}
+
+		writer->firstJobIndex = (writer->firstJobIndex + 1) % writer->capacity;
+		writer->jobCount--;
+		pthread_cond_broadcast(&writer->jobDone);
+	}
+
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+static void flushRunningWriters(void) {
+
+	pthread_mutex_lock(&runningWritersLock);
+
+	for (struct outputWriter *writer = runningWriters; writer != NULL; writer = writer->next) {
+		flushOutputWriter(writer);
+	}
+
+	pthread_mutex_unlock(&runningWritersLock);
+}
+
+struct outputWriter* createOutputWriter(int capacity) {
+
+	struct outputWriter *writer = (struct outputWriter *) malloc(sizeof(struct outputWriter));
+	writer->capacity = MAX(capacity, 1);
+	writer->jobs = (struct outputJob *) malloc(writer->capacity * sizeof(struct outputJob));
+	writer->firstJobIndex = 0;
+	writer->jobCount = 0;
+	writer->failureCount = 0;
+	writer->isShuttingDown = 0;
+
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->jobQueued, NULL);
+	pthread_cond_init(&writer->jobDone, NULL);
+
+	if (pthread_create(&writer->thread, NULL, runOutputWriter, writer) != 0) {
+		fprintf(stderr, "cannot start the output writer\n");
+		exit(-1);
+	}
+
+	pthread_mutex_lock(&runningWritersLock);
+
+	writer->next = runningWriters;
+	runningWriters = writer;
+
+	if (!isExitFlushRegistered) {
+		atexit(flushRunningWriters);
+		isExitFlushRegistered = 1;
+	}
+
+	pthread_mutex_unlock(&runningWritersLock);
+
+	return writer;
+}
+
+// Adds a job, once there is room for it.
+static void queueOutputJob(struct outputWriter *writer, struct outputJob *job) {
+
+	pthread_mutex_lock(&writer->lock);
+
+	while (writer->jobCount == writer->capacity) {
+		pthread_cond_wait(&writer->jobDone, &writer->lock);
+	}
+
+	writer->jobs[(writer->firstJobIndex + writer->jobCount) % writer->capacity] = *job;
+	writer->jobCount++;
+
+	pthread_cond_signal(&writer->jobQueued);
+	pthread_mutex_unlock(&writer->lock);
+}
+
+void queueHalftoneImage(struct outputWriter *writer, struct pxm_img *halftone, char *imagePath) {
+
+	struct outputJob job = { OUTPUT_JOB_HALFTONE_IMAGE, strdup(imagePath), NULL, NULL, NULL, NULL, 0 };
+
+	// Only the fields read by writeHalftoneImage are copied.
+	job.halftone = (struct pxm_img *) malloc(sizeof(struct pxm_img));
+	job.halftone->height = halftone->height;
+	job.halftone->width = halftone->width;
+	job.halftone->pxm_type = halftone->pxm_type;
+	job.halftone->mono = (uint8_t **) malloc(halftone->height * sizeof(uint8_t *));
+
+	uint8_t *pixels = (uint8_t *) malloc((size_t) halftone->height * halftone->width);
+	for (int i = 0; i < halftone->height; i++) {
+		job.halftone->mono[i] = pixels + (size_t) i * halftone->width;
+		memcpy(job.halftone->mono[i], halftone->mono[i], halftone->width);
+	}
+
+	queueOutputJob(writer, &job);
+}
+
+void queueMatrixText(struct outputWriter *writer, struct doubleImage *matrix, char *outputMatrixPath) {
+
+	struct outputJob job = { OUTPUT_JOB_MATRIX_TEXT, strdup(outputMatrixPath), NULL, NULL, NULL, NULL, 0 };
+
+	job.matrix = createImage(matrix->height, matrix->width, 0, 0);
+	for (int i = 0; i < matrix->height; i++) {
+		memcpy(job.matrix->data[i], matrix->data[i], matrix->width * sizeof(dbsReal));
+	}
+
+	queueOutputJob(writer, &job);
+}
+
+void queueMatrixChanges(struct outputWriter *writer, struct matrixFile *file, struct doubleImage *matrix) {
+
+	struct outputJob job = { OUTPUT_JOB_MATRIX_CHANGES, NULL, NULL, NULL, file, NULL, 0 };
+
+	job.changeCount = collectMatrixChanges(file, matrix, &job.changes);
+
+	if (job.changeCount > 0) {
+		queueOutputJob(writer, &job);
+	}
+}
+
+int flushOutputWriter(struct outputWriter *writer) {
+
+	pthread_mutex_lock(&writer->lock);
+
+	while (writer->jobCount > 0) {
+		pthread_cond_wait(&writer->jobDone, &writer->lock);
+	}
+
+	int failureCount = writer->failureCount;
+	pthread_mutex_unlock(&writer->lock);
+
+	return failureCount;
+}
+
+int destroyOutputWriter(struct outputWriter *writer) {
+
+	pthread_mutex_lock(&runningWritersLock);
+
+	struct outputWriter **link = &runningWriters;
+	while (*link != writer) {
+		link = &(*link)->next;
+	}
+	*link = writer->next;
+
+	pthread_mutex_unlock(&runningWritersLock);
+
+	// The thread writes the remaining jobs before it stops.
+	pthread_mutex_lock(&writer->lock);
+	writer->isShuttingDown = 1;
+	pthread_cond_signal(&writer->jobQueued);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+
+	int failureCount = writer->failureCount;
+
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->jobQueued);
+	pthread_cond_destroy(&writer->jobDone);
+	free(writer->jobs);
+	free(writer);
+
+	return failureCount;
+}
@@ -0,0 +1,36 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+struct pxm_img;
+struct doubleImage;
+struct matrixFile;
+
+// A thread that writes the outputs of the design (halftone snapshots, text matrices and the changes of binary
+// matrices) off the design threads. The queue functions copy what they need, and return without waiting for the
+// filesystem, unless capacity jobs are already queued: they then wait for the writer to catch up. They may be called
+// from several threads.
+//
+// A failed write is reported on stderr and counted, and the count is returned by flushOutputWriter. The writers that
+// are still running when the process exits are flushed first.
+struct outputWriter;
+
+// Creates a writer that holds up to capacity queued jobs (at least 1).
+struct outputWriter* createOutputWriter(int capacity);
+
+// Queues a copy of the halftone, written by writeHalftoneImage.
+void queueHalftoneImage(struct outputWriter *writer, struct pxm_img *halftone, char *imagePath);
+
+// Queues a copy of the matrix, written by writeMatrix.
+void queueMatrixText(struct outputWriter *writer, struct doubleImage *matrix, char *outputMatrixPath);
+
+// Queues the entries of the matrix that changed since it was last queued to its binary file (see
+// collectMatrixChanges). Every change of a binary file must go through the same writer.
+void queueMatrixChanges(struct outputWriter *writer, struct matrixFile *file, struct doubleImage *matrix);
+
+// Waits until every queued job is written, and returns the number of failed writes since the writer was created.
+int flushOutputWriter(struct outputWriter *writer);
+
+// Flushes the writer, stops its thread and releases it. Returns the number of failed writes.
+int destroyOutputWriter(struct outputWriter *writer);
+
+#endif
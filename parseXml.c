@@ -1,91 +1,157 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "dbs.h"
 #include "parseXml.h"
 
+static int isOption(xmlNodePtr cur, const char *name) {
+
+	return !xmlStrcmp(cur->name, (const xmlChar *) name);
+}
+
+static int getIntegerOption(xmlDocPtr doc, xmlNodePtr cur) {
+
+	xmlChar* key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
+	int value = key != NULL ? atoi((char *) key) : 0;
+	xmlFree(key);
+
+	return value;
+}
+
+static double getRealOption(xmlDocPtr doc, xmlNodePtr cur) {
+
+	xmlChar* key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
+	double value = key != NULL ? atof((char *) key) : 0.0;
+	xmlFree(key);
+
+	return value;
+}
+
+// The string stays allocated for as long as the configuration uses it.
+static char* getStringOption(xmlDocPtr doc, xmlNodePtr cur) {
+
+	xmlChar* key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
+
+	return key != NULL ? (char *) key : "";
+}
+
 void parseStory (xmlDocPtr doc,xmlNodePtr cur, struct Config * config){
-	xmlChar* key;
 	cur = cur->xmlChildrenNode;
 	while (cur !=NULL){
-		if((!xmlStrcmp(cur->name,(const xmlChar *)"infn"))){
-
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("infn: %s\n",(char *)key);
-			  			config->infn = (char *)key;
-			  			printf("config->infn: %s\n",config->infn);
-			  			/*xmlFree(key);*/
-		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"output_fname"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("output_fname: %s\n",key);
-			  			config->output_fname = (char *)key;
-			  			/*xmlFree(key);*/
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"scale_factor"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("scale_factor: %f\n",atof(key));
-			  			config->scale_factor = atoi(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"checkflag"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("checkflag: %f\n",atof(key));
-			  			config->checkflag = atoi(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"Rand_Init"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("Rand_Init: %f\n",atof(key));
-			  			config->Rand_Init = atoi(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"initHfname"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("initHfname: %s\n",key);
-			  			config->initHfname = (char *)key;
-			  			/*xmlFree(key);*/
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"tog_flag"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("tog_flag: %f\n",atof(key));
-			  			config->tog_flag = atoi(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"swap_flag"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("swap_flag: %f\n",atof(key));
-			  			config->swap_flag = atoi(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"gamma"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("gamma: %f\n",atof(key));
-			  			config->gamma = atof(key);
-			  			xmlFree(key);
-			  		}
-			  		if((!xmlStrcmp(cur->name,(const xmlChar *)"size3b"))){
-			  			key = xmlNodeListGetString(doc,cur->xmlChildrenNode,1);
-			  			printf("size3b: %f\n",atof(key));
-			  			config->size3b = atoi(key);
-			  			xmlFree(key);
-			  		}
-
+		if (cur->type != XML_ELEMENT_NODE) {
+			cur = cur->next;
+			continue;
+		}
 
+		if (isOption(cur, "inputImagePath")) {
+			config->inputImagePath = getStringOption(doc, cur);
+		}
+		else if (isOption(cur, "inputImagePath2")) {
+			config->inputImagePath2 = getStringOption(doc, cur);
+		}
+		else if (isOption(cur, "initialHalftonePath")) {
+			config->initialHalftonePath = getStringOption(doc, cur);
+		}
+		else if (isOption(cur, "randomSeed")) {
+			config->randomSeed = (unsigned int) getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "gamma")) {
+			config->gamma = getRealOption(doc, cur);
+		}
+		else if (isOption(cur, "scaleFactor")) {
+			config->scaleFactor = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "hvsSpreadSize")) {
+			config->hvsSpreadSize = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "enableToggle")) {
+			config->enableToggle = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "enableSwap")) {
+			config->enableSwap = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "swapSize")) {
+			config->swapSize = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "swapWindowPercentile")) {
+			config->swapWindowPercentile = getRealOption(doc, cur);
+		}
+		else if (isOption(cur, "blockHeight")) {
+			config->blockHeight = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "blockWidth")) {
+			config->blockWidth = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "maxIterationCount")) {
+			config->maxIterationCount = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "minAcceptableChangeCount")) {
+			config->minAcceptableChangeCount = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "blockOrder")) {
+			config->blockOrder = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "threadCount")) {
+			config->threadCount = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "scanKernel")) {
+			config->scanKernel = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "haloMode")) {
+			config->haloMode = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "convolutionMethod")) {
+			config->convolutionMethod = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "fftCheckSampleCount")) {
+			config->fftCheckSampleCount = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "errorCheckInterval")) {
+			config->errorCheckInterval = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "precisionComparison")) {
+			config->precisionComparison = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "candidateIndexMode")) {
+			config->candidateIndexMode = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "swapCacheMode")) {
+			config->swapCacheMode = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "coarseDesignFactor")) {
+			config->coarseDesignFactor = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "dotSelectionMode")) {
+			config->dotSelectionMode = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "portfolioSeedCount")) {
+			config->portfolioSeedCount = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "enableConcurrentColorants")) {
+			config->enableConcurrentColorants = getIntegerOption(doc, cur);
+		}
+		else if (isOption(cur, "hvsCacheDirectory")) {
+			config->hvsCacheDirectory = getStringOption(doc, cur);
+		}
+		else {
+			fprintf(stderr, "unknown option %s\n", (char *) cur->name);
+		}
 
 		cur = cur->next;
 	}
 	return;
 }
 
-static void parseDoc(char *docname) {
+struct Config* parseConfigurationList(char *docname, struct Config *baseConfig, int *count) {
 	xmlDocPtr doc;
 	xmlNodePtr cur;
-	xmlChar* key;
 	doc = xmlParseFile(docname);
 
+	*count = 0;
+
 	if (doc == NULL){
 		fprintf(stderr,"Document not parsed successfully. \n");
-		return;
+		return NULL;
 	}
 
 	cur = xmlDocGetRootElement(doc);
@@ -93,49 +159,34 @@ static void parseDoc(char *docname) {
 	if (cur == NULL){
 		fprintf(stderr,"empty document\n");
 		xmlFreeDoc(doc);
-		return;
+		return NULL;
 	}
 
-	/*cur=cur->xmlChildrenNode;
-	while (cur !=NULL){
-		key = xmlNodeListGetString(doc, cur,1);
-		fprintf("keyword:%s\n",key);
-		xmlFree(key);
-
-		cur=cur->next;
-
-
-	}
-*/
 	if (xmlStrcmp(cur->name,(const xmlChar*)"inputs")){
 		fprintf(stderr,"document of the wrong structure.\n");
 		xmlFreeDoc(doc);
-		return;
+		return NULL;
 	}
 
-	cur=cur->xmlChildrenNode;
-	/*while(cur !=NULL){
-		if((!xmlStrcmp(cur->name,(const xmlChar*)"list"))){
-			parseStory(doc,cur);
+	for (xmlNodePtr run = cur->xmlChildrenNode; run != NULL; run = run->next) {
+		if (isOption(run, "run")) {
+			(*count)++;
+		}
+	}
+
+	struct Config *configs = (struct Config *) malloc(MAX(*count, 1) * sizeof(struct Config));
+	int index = 0;
 
+	cur=cur->xmlChildrenNode;
+	while(cur !=NULL){
+		if (isOption(cur, "run")) {
+			configs[index] = *baseConfig;
+			parseStory(doc, cur, &configs[index]);
+			index++;
 		}
 		cur=cur->next;
-	}*/
+	}
 
 	xmlFreeDoc(doc);
-	return;
-
+	return configs;
 }
-
-/*int main(int argc, char **argv){
-	char *docname;
-
-	if(argc<=1){
-		printf("Usage: %s docname\n", argv[0]);
-		return(0);
-	}
-
-	docname = argv[1];
-	parseDoc (docname);
-	return(1);
-}*/
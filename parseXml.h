@@ -1,15 +1,12 @@
 #include <libxml/parser.h>
 
-typedef struct Config
-{
-  	int tog_flag; /* tog_flag = 1: enable toggle in DBS, else: disable toggle*/
-  	int swap_flag; /* swap_flag = 1: enable swap in DBS, else: disable swap*/
-  	double gamma; /* Gamma correction parameter. If it == 1, then correction has no affect */
-  	char * infn; /* Input image file name */
-  	char * output_fname; /* Output image file name prefix */
-  	int	scale_factor;
-  	int checkflag;
-  	char *initHfname;
-  	int Rand_Init;
-  	int size3b; /* A constant equals to 13 and used for allocating Cpe */
-} Config;
+struct Config;
+
+// Sets the options of config named by the child elements of cur, e.g. <swapSize>41</swapSize>. The element names are
+// those of the Config fields. Unknown elements are reported, and skipped.
+void parseStory (xmlDocPtr doc,xmlNodePtr cur, struct Config * config);
+
+// Reads a document whose <inputs> root holds one <run> element per configuration, and returns a malloc'ed array of
+// count copies of baseConfig, each with the options of its run set by parseStory. Returns NULL if the document cannot
+// be read.
+struct Config* parseConfigurationList(char *docname, struct Config *baseConfig, int *count);
@@ -0,0 +1,89 @@
+/******************************************************************
+* file: passTelemetry.c
+* Implementing: Per pass records of the DBS design, in CSV or JSON Lines
+* Every record is one line, written under a lock so that the lines of concurrent designs do not interleave.
+*******************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "dbs.h"
+#include "passTelemetry.h"
+
+static FILE *telemetryFile = NULL;
+static int isJsonLines = 0;
+static pthread_mutex_t telemetryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int telemetryPhase = 0;
+static int telemetryLevel = 0;
+static __thread const char *telemetryColorants = NULL;
+
+void openPassTelemetry(char *path) {
+
+	telemetryFile = fopen(path, "w");
+	if (telemetryFile == NULL) {
+		fprintf(stderr, "cannot open the telemetry file %s\n", path);
+		exit(-1);
+	}
+
+	size_t length = strlen(path);
+	isJsonLines = length >= 6 && strcmp(path + length - 6, ".jsonl") == 0;
+
+	if (!isJsonLines) {
+		fprintf(telemetryFile, "phase,level,colorants,stepIndex,pass,toggles,swaps,deltaError,rmsError,activeBlocks,swapSize,seconds\n");
+	}
+}
+
+void closePassTelemetry() {
+
+	if (telemetryFile == NULL) {
+		return;
+	}
+
+	if (fclose(telemetryFile) != 0) {
+		fprintf(stderr, "cannot write the telemetry file\n");
+	}
+	telemetryFile = NULL;
+}
+
+int isPassTelemetryEnabled() {
+
+	return telemetryFile != NULL;
+}
+
+void setTelemetryLevel(int phase, int level) {
+
+	telemetryPhase = phase;
+	telemetryLevel = level;
+}
+
+void setTelemetryColorants(const char *colorants) {
+
+	telemetryColorants = colorants;
+}
+
+void writePassRecord(struct passRecord *record) {
+
+	if (telemetryFile == NULL) {
+		return;
+	}
+
+	const char *colorants = telemetryColorants != NULL ? telemetryColorants : "";
+
+	pthread_mutex_lock(&telemetryLock);
+
+	if (isJsonLines) {
+		fprintf(telemetryFile, "{\"phase\": %d, \"level\": %d, \"colorants\": \"%s\", \"stepIndex\": %d, \"pass\": %d, "
+				"\"toggles\": %d, \"swaps\": %d, \"deltaError\": %.9g, \"rmsError\": %.9g, \"activeBlocks\": %d, "
+				"\"swapSize\": %d, \"seconds\": %.6f}\n",
+				telemetryPhase, telemetryLevel, colorants, record->stepIndex, record->passIndex, record->toggleCount,
+				record->swapCount, record->deltaError, record->rmsError, record->activeBlockCount, record->swapSize, record->seconds);
+	}
+	else {
+		fprintf(telemetryFile, "%d,%d,%s,%d,%d,%d,%d,%.9g,%.9g,%d,%d,%.6f\n",
+				telemetryPhase, telemetryLevel, colorants, record->stepIndex, record->passIndex, record->toggleCount,
+				record->swapCount, record->deltaError, record->rmsError, record->activeBlockCount, record->swapSize, record->seconds);
+	}
+
+	pthread_mutex_unlock(&telemetryLock);
+}
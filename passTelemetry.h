@@ -0,0 +1,44 @@
+#ifndef PASS_TELEMETRY_H
+#define PASS_TELEMETRY_H
+
+// Records of the DBS passes, written one per line to a CSV file, or a JSON Lines file when the path ends in ".jsonl",
+// to tune the convergence settings (maxIterationCount, minAcceptableChangeCount) from the runs. telemetrySummary.c
+// adds them up per level and design phase.
+//
+// The design phase and the level are those last set by setTelemetryLevel, for every thread. The colorants are set per
+// thread, since the calls of performIndependentDBSForScreenDesign run on threads of their own.
+
+// A finished pass. The error is the RMS error after the pass, the active blocks those still enabled (or queued, in
+// the best-first order) when it started, and the swap size that of the window it scanned (see swapWindowPercentile).
+struct passRecord
+{
+	int stepIndex;
+	int passIndex;
+	int toggleCount;
+	int swapCount;
+	double deltaError;
+	double rmsError;
+	int activeBlockCount;
+	int swapSize;
+	double seconds;
+};
+
+// Starts writing the records of the passes to path, overwriting it. Exits on failure.
+void openPassTelemetry(char *path);
+
+// Writes the pending records and closes the file, if openPassTelemetry was called.
+void closePassTelemetry();
+
+// Returns whether the records are written.
+int isPassTelemetryEnabled();
+
+// Labels the records that follow with a design phase and a level.
+void setTelemetryLevel(int phase, int level);
+
+// Labels the records of the calling thread with the colorants being designed, e.g. "CY". NULL leaves them empty.
+void setTelemetryColorants(const char *colorants);
+
+// Writes the record of a finished pass. It may be called from several threads.
+void writePassRecord(struct passRecord *record);
+
+#endif
@@ -0,0 +1,148 @@
+/******************************************************************
+* file: phaseTrace.c
+* Implementing: Phase timers of the design, and their Chrome trace
+* The events are kept in memory, and written as the JSON object format of the Trace Event specification when the
+* trace is closed. Times are taken from CLOCK_MONOTONIC.
+*******************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "dbs.h"
+#include "phaseTrace.h"
+
+static const char *phaseNames[TRACE_PHASE_COUNT] = { "evaluate", "apply", "report", "calculateCpe", "dots", "matrixOutput" };
+
+struct traceEvent
+{
+	char name[64];
+	const char *category;
+	int threadId;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t phaseNanoseconds[TRACE_PHASE_COUNT];
+};
+
+int isTraceEnabled = 0;
+
+static char *tracePath = NULL;
+static uint64_t traceStart;
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static struct traceEvent *events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+
+// The phase totals of every thread, and of the calling one.
+static _Atomic uint64_t globalPhaseNanoseconds[TRACE_PHASE_COUNT];
+static __thread uint64_t threadPhaseNanoseconds[TRACE_PHASE_COUNT];
+
+static atomic_int nextThreadId = 1;
+static __thread int traceThreadId = 0;
+
+uint64_t getTraceTime() {
+
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t) time.tv_sec * 1000000000ULL + (uint64_t) time.tv_nsec;
+}
+
+void openTrace(char *path) {
+
+	tracePath = path;
+	traceStart = getTraceTime();
+	isTraceEnabled = 1;
+}
+
+void addTracePhase(int phase, uint64_t start) {
+
+	uint64_t duration = getTraceTime() - start;
+
+	threadPhaseNanoseconds[phase] += duration;
+	atomic_fetch_add_explicit(&globalPhaseNanoseconds[phase], duration, memory_order_relaxed);
+}
+
+void beginTraceScope(struct traceScope *scope, int type) {
+
+	scope->type = type;
+	scope->start = getTraceTime();
+
+	for (int k = 0; k < TRACE_PHASE_COUNT; k++) {
+		scope->phaseNanoseconds[k] = type == TRACE_SCOPE_GLOBAL ? atomic_load(&globalPhaseNanoseconds[k]) :
+				threadPhaseNanoseconds[k];
+	}
+}
+
+void endTraceScope(struct traceScope *scope, const char *category, const char *name, int index) {
+
+	if (traceThreadId == 0) {
+		traceThreadId = atomic_fetch_add(&nextThreadId, 1);
+	}
+
+	struct traceEvent event;
+	snprintf(event.name, sizeof(event.name), "%s %d", name, index);
+	event.category = category;
+	event.threadId = traceThreadId;
+	event.start = scope->start;
+	event.duration = getTraceTime() - scope->start;
+
+	for (int k = 0; k < TRACE_PHASE_COUNT; k++) {
+		uint64_t total = scope->type == TRACE_SCOPE_GLOBAL ? atomic_load(&globalPhaseNanoseconds[k]) :
+				threadPhaseNanoseconds[k];
+		event.phaseNanoseconds[k] = total - scope->phaseNanoseconds[k];
+	}
+
+	pthread_mutex_lock(&traceLock);
+
+	if (eventCount == eventCapacity) {
+		eventCapacity = MAX(2 * eventCapacity, 1024);
+		events = (struct traceEvent *) realloc(events, eventCapacity * sizeof(struct traceEvent));
+	}
+	events[eventCount++] = event;
+
+	pthread_mutex_unlock(&traceLock);
+}
+
+void closeTrace() {
+
+	if (!isTraceEnabled) {
+		return;
+	}
+
+	isTraceEnabled = 0;
+
+	FILE *file = fopen(tracePath, "w");
+	if (file == NULL) {
+		fprintf(stderr, "cannot write the trace %s\n", tracePath);
+	}
+	else {
+		fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+		// The times of the events are in microseconds since the trace was opened, and those of the phases in
+		// milliseconds.
+		for (int e = 0; e < eventCount; e++) {
+
+			struct traceEvent *event = &events[e];
+			fprintf(file, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+					event->name, event->category, event->threadId, (event->start - traceStart) / 1000.0, event->duration / 1000.0);
+
+			for (int k = 0; k < TRACE_PHASE_COUNT; k++) {
+				fprintf(file, "%s\"%s_ms\": %.3f", k > 0 ? ", " : "", phaseNames[k], event->phaseNanoseconds[k] / 1e6);
+			}
+
+			fprintf(file, "}}%s\n", e + 1 < eventCount ? "," : "");
+		}
+
+		fprintf(file, "]}\n");
+
+		if (fclose(file) != 0) {
+			fprintf(stderr, "cannot write the trace %s\n", tracePath);
+		}
+	}
+
+	free(events);
+	events = NULL;
+	eventCount = 0;
+	eventCapacity = 0;
+}
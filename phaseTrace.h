@@ -0,0 +1,72 @@
+#ifndef PHASE_TRACE_H
+#define PHASE_TRACE_H
+
+#include <stdint.h>
+
+// Timers of the phases of a design, exported as a Chrome trace (chrome://tracing, or https://ui.perfetto.dev).
+//
+// The short, frequent phases (the block evaluations, the accepted changes and their updateCpe) only add their time
+// to per-thread totals. The passes, the calls of performCompleteDBSForScreenDesign and the levels are trace scopes:
+// each one becomes an event of the trace, whose arguments hold the time every phase took during the scope. The
+// scopes of a level add up the phases of every thread, and the others those of their own thread.
+//
+// Tracing is enabled by openTrace. Until then a timer costs a test of a global flag. Building with -DDBS_DISABLE_TRACE
+// removes the timers altogether.
+
+#define TRACE_PHASE_EVALUATE        0
+#define TRACE_PHASE_APPLY           1
+#define TRACE_PHASE_REPORT          2
+#define TRACE_PHASE_CPE             3
+#define TRACE_PHASE_DOTS            4
+#define TRACE_PHASE_MATRIX_OUTPUT   5
+#define TRACE_PHASE_COUNT           6
+
+#define TRACE_SCOPE_THREAD          0
+#define TRACE_SCOPE_GLOBAL          1
+
+extern int isTraceEnabled;
+
+// Returns the time of a monotonic clock, in nanoseconds.
+uint64_t getTraceTime();
+
+// Starts recording the events of the trace written to path by closeTrace.
+void openTrace(char *path);
+
+// Writes the trace, if openTrace was called, and stops recording.
+void closeTrace();
+
+// Adds the time elapsed since start (a getTraceTime value) to a phase.
+void addTracePhase(int phase, uint64_t start);
+
+// A scope of the trace, between beginTraceScope and endTraceScope.
+struct traceScope
+{
+	int type;
+	uint64_t start;
+	uint64_t phaseNanoseconds[TRACE_PHASE_COUNT];
+};
+
+// type is TRACE_SCOPE_THREAD, or TRACE_SCOPE_GLOBAL to add up the phases of every thread.
+void beginTraceScope(struct traceScope *scope, int type);
+
+// Records the scope as an event named "name index" of the category.
+void endTraceScope(struct traceScope *scope, const char *category, const char *name, int index);
+
+#ifndef DBS_DISABLE_TRACE
+
+#define TRACE_START(start)              uint64_t start = isTraceEnabled ? getTraceTime() : 0
+#define TRACE_PHASE(phase, start)       do { if (isTraceEnabled) addTracePhase(phase, start); } while (0)
+#define TRACE_BEGIN(scope, type)        struct traceScope scope = { 0 }; do { if (isTraceEnabled) beginTraceScope(&scope, type); } while (0)
+#define TRACE_END(scope, category, name, index) \
+	do { if (isTraceEnabled) endTraceScope(&scope, category, name, index); } while (0)
+
+#else
+
+#define TRACE_START(start)
+#define TRACE_PHASE(phase, start)       do { } while (0)
+#define TRACE_BEGIN(scope, type)
+#define TRACE_END(scope, category, name, index) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/******************************************************************
+* file: randomStream.c
+* Implementing: Counter-based random number streams
+* Every number is two rounds of the SplitMix64 finalizer over the counter and the key of the stream, which sets the
+* streams of nearby seeds and indices apart as well as the numbers of a stream.
+*******************************************************************/
+
+#include "randomStream.h"
+
+#define RANDOM_STREAM_INCREMENT 0x9e3779b97f4a7c15ULL
+
+static uint64_t mixBits(uint64_t bits) {
+
+	bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebULL;
+
+	return bits ^ (bits >> 31);
+}
+
+void initRandomStream(struct randomStream *stream, unsigned int seed, unsigned int streamIndex) {
+
+	stream->key = mixBits(((uint64_t) seed << 32 | streamIndex) + RANDOM_STREAM_INCREMENT);
+	stream->counter = 0;
+}
+
+uint64_t getRandomBits(struct randomStream *stream) {
+
+	uint64_t counter = stream->counter++;
+
+	return mixBits(mixBits(stream->key ^ counter * RANDOM_STREAM_INCREMENT) + stream->key);
+}
+
+double getRandomUniform(struct randomStream *stream) {
+
+	// The top 53 bits, the precision of a double.
+	return (getRandomBits(stream) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+unsigned int getRandomBelow(struct randomStream *stream, unsigned int bound) {
+
+	// The high half of the product maps 32 bits onto [0, bound), with a bias of at most bound / 2^32.
+	return (unsigned int) (((getRandomBits(stream) >> 32) * bound) >> 32);
+}
@@ -0,0 +1,27 @@
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <stdint.h>
+
+// The random numbers of a design. A stream is a counter, keyed by a seed and a stream index, whose n-th number is a
+// hash of n and the key, so that every design (e.g. every seed of a portfolio, see portfolioSeedCount in dbs.h) draws
+// from its own stream, on any thread, and draws the same numbers on every run and platform.
+struct randomStream
+{
+	uint64_t key;
+	uint64_t counter;
+};
+
+// Starts the stream of the given seed and index at its first number.
+void initRandomStream(struct randomStream *stream, unsigned int seed, unsigned int streamIndex);
+
+// Returns the next 64 random bits of the stream.
+uint64_t getRandomBits(struct randomStream *stream);
+
+// Returns the next random number of the stream, uniform in [0, 1).
+double getRandomUniform(struct randomStream *stream);
+
+// Returns the next random integer of the stream, uniform in [0, bound), bound > 0.
+unsigned int getRandomBelow(struct randomStream *stream, unsigned int bound);
+
+#endif
@@ -0,0 +1,91 @@
+/******************************************************************
+* file: swapCache.c
+* Implementing: Per pixel cache of the best swap of each source, invalidated around the accepted changes
+* Late passes accept few changes, so most of the sources they evaluate again have seen nothing change within their
+* reach, and take their best swap from the cache instead of scanning their window.
+*******************************************************************/
+
+#include <string.h>
+
+#include "dbs.h"
+#include "swapCache.h"
+
+struct swapCache* createSwapCache(int height, int width, int reach) {
+
+	size_t pixelCount = (size_t) height * width;
+
+	struct swapCache *cache = (struct swapCache *) malloc(sizeof(struct swapCache));
+	cache->height = height;
+	cache->width = width;
+	cache->reach = reach;
+	cache->isValid = (uint8_t *) calloc(pixelCount, sizeof(uint8_t));
+	cache->deltaErrors = (double *) malloc(pixelCount * sizeof(double));
+	cache->targetRowIndices = (int *) malloc(pixelCount * sizeof(int));
+	cache->targetColumnIndices = (int *) malloc(pixelCount * sizeof(int));
+
+	return cache;
+}
+
+void deallocateSwapCache(struct swapCache *cache) {
+
+	free(cache->isValid);
+	free(cache->deltaErrors);
+	free(cache->targetRowIndices);
+	free(cache->targetColumnIndices);
+	free(cache);
+}
+
+int lookupSwapCache(struct swapCache *cache, int rowIndex, int columnIndex, double *deltaError,
+		int *targetRowIndex, int *targetColumnIndex) {
+
+	size_t pixel = (size_t) rowIndex * cache->width + columnIndex;
+
+	if (!cache->isValid[pixel]) {
+		return 0;
+	}
+
+	*deltaError = cache->deltaErrors[pixel];
+	*targetRowIndex = cache->targetRowIndices[pixel];
+	*targetColumnIndex = cache->targetColumnIndices[pixel];
+
+	return 1;
+}
+
+void storeSwapCache(struct swapCache *cache, int rowIndex, int columnIndex, double deltaError,
+		int targetRowIndex, int targetColumnIndex) {
+
+	size_t pixel = (size_t) rowIndex * cache->width + columnIndex;
+
+	cache->isValid[pixel] = 1;
+	cache->deltaErrors[pixel] = deltaError;
+	cache->targetRowIndices[pixel] = targetRowIndex;
+	cache->targetColumnIndices[pixel] = targetColumnIndex;
+}
+
+void invalidateSwapCache(struct swapCache *cache, int rowIndex, int columnIndex) {
+
+	int height = cache->height;
+	int width = cache->width;
+
+	// The rows and the columns within reach, which cover the whole torus when the reach does.
+	int firstRow = rowIndex - cache->reach;
+	int rowCount = MIN(2 * cache->reach + 1, height);
+	int firstColumn = MOD(columnIndex - cache->reach, width);
+	int columnCount = MIN(2 * cache->reach + 1, width);
+
+	// The columns of a row in at most two runs, split at the edge of the torus.
+	int firstRunCount = MIN(columnCount, width - firstColumn);
+
+	for (int i = 0; i < rowCount; i++) {
+
+		uint8_t *row = cache->isValid + (size_t) MOD(firstRow + i, height) * width;
+
+		memset(row + firstColumn, 0, firstRunCount);
+		memset(row, 0, columnCount - firstRunCount);
+	}
+}
+
+void clearSwapCache(struct swapCache *cache) {
+
+	memset(cache->isValid, 0, (size_t) cache->height * cache->width * sizeof(uint8_t));
+}
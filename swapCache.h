@@ -0,0 +1,43 @@
+#ifndef SWAP_CACHE_H
+#define SWAP_CACHE_H
+
+#include <stdint.h>
+
+// The best swap of every source pixel, as its window scan last returned it. A scan reads the source pixel and its
+// window, on the halftone and on the cpe planes, so its result holds until a change lands within reach of the source:
+// the swap reach plus the Cpp border, on the torus. Each accepted change invalidates the entries within that reach of
+// the changed pixel, and any other entry is returned as is instead of scanning the window again.
+struct swapCache
+{
+	int height;
+	int width;
+	int reach;
+
+	// Per pixel, row by row: 1 if the entry holds, the delta error of the best swap, and its target when the delta is
+	// negative.
+	uint8_t *isValid;
+	double *deltaErrors;
+	int *targetRowIndices;
+	int *targetColumnIndices;
+};
+
+// Creates an empty cache for planes of the given size, whose entries depend on the pixels up to reach away from their
+// source.
+struct swapCache* createSwapCache(int height, int width, int reach);
+
+void deallocateSwapCache(struct swapCache *cache);
+
+// Returns 1 and the cached result of a source pixel if it holds, 0 otherwise.
+int lookupSwapCache(struct swapCache *cache, int rowIndex, int columnIndex, double *deltaError,
+		int *targetRowIndex, int *targetColumnIndex);
+
+void storeSwapCache(struct swapCache *cache, int rowIndex, int columnIndex, double deltaError,
+		int targetRowIndex, int targetColumnIndex);
+
+// Invalidates the entries of the sources within reach of a changed pixel.
+void invalidateSwapCache(struct swapCache *cache, int rowIndex, int columnIndex);
+
+// Invalidates every entry, e.g. when the swap window changes.
+void clearSwapCache(struct swapCache *cache);
+
+#endif
@@ -0,0 +1,570 @@
+/******************************************************************
+* file: swapScan.c
+* Implementing: AVX2 and AVX-512 scans of the swap window, used in place of the candidate-by-candidate
+* getSwapDeltaError loop of getSwapDeltaErrorInRegion_1/_2/_3
+* Each window row is scored a vector at a time, in one run where it is contiguous in the image (or in its halo, see
+* halo.h), or two where it wraps around the torus. The Cpp term is added under a mask of the lanes inside the Cpp
+* support, and the running minimum of every lane stays in a register for the whole window.
+*******************************************************************/
+
+#include "dbs.h"
+#include "swapScan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SWAP_SCAN_HAS_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// The widest vector used, in doubles.
+#define SWAP_SCAN_MAX_LANES     8
+
+// The swap window of a source pixel, and the source terms of getSwapDeltaError for it.
+struct scanRegion
+{
+	int rule;
+	uint8_t sourcePixel;
+
+	// 2 * cppPeak - 2 * a0 * cpe(source) and a1 = -2 * a0, per plane, as in getSwapDeltaError.
+	double constant;
+	double a1;
+	double constant2;
+	double a1_2;
+
+	// The first and the (optional) second cpe plane, and the planes that decide the eligibility of the targets.
+	struct doubleImage *cpe;
+	struct doubleImage *cpe2;
+	struct pxm_img *plane;
+	struct pxm_img *before;
+	struct doubleImage *cpp;
+
+	int rowIndex;
+	int columnIndex;
+
+	// The window, clipped to the torus.
+	int minRowIndex;
+	int maxRowIndex;
+	int minColumnIndex;
+	int maxColumnIndex;
+
+	int isPadded;
+	int rowMask;
+	int columnMask;
+};
+
+// One run of candidates along a window row, contiguous in the image (or in its halo, see halo.h).
+struct scanRun
+{
+	const dbsReal *cpe;
+	const dbsReal *cpe2;
+	const uint8_t *plane;
+	const uint8_t *before;
+
+	// The Cpp row of the window row, NULL when it lies outside the Cpp support. The candidate k of the run is
+	// cppColumn + k columns away from the source, and its Cpp entry is cpp[|cppColumn + k|] within the support.
+	const dbsReal *cpp;
+	int cppColumn;
+
+	int count;
+
+	// The position of the first candidate in the scalar scan order.
+	double firstPosition;
+};
+
+// The first minimum met by each vector lane. The scalar kernel uses lane 0.
+struct scanResult
+{
+	double laneValues[SWAP_SCAN_MAX_LANES];
+	double lanePositions[SWAP_SCAN_MAX_LANES];
+};
+
+typedef void (*scanRegionKernel)(const struct scanRegion *region, struct scanResult *result);
+
+// Cuts window row i into its runs: a single one on a padded plane, or two where the row wraps around the torus.
+// Returns the number of runs. It is inlined into the vector kernels, since a call into code built without AVX would
+// cost them a transition of the vector state per window row.
+static inline __attribute__((always_inline)) int getScanRuns(const struct scanRegion *region, int i, struct scanRun runs[2]) {
+
+	struct doubleImage *cpe = region->cpe;
+	int windowWidth = region->maxColumnIndex - region->minColumnIndex + 1;
+
+	int targetRowIndex = region->isPadded ? i : WRAP(i, cpe->height, region->rowMask);
+	int cppRowIndex = abs(i - region->rowIndex);
+	const dbsReal *cpp = cppRowIndex <= region->cpp->borderSize ? region->cpp->data[cppRowIndex] : NULL;
+
+	int runCount = 0;
+	int j = region->minColumnIndex;
+
+	while (j <= region->maxColumnIndex) {
+
+		int targetColumnIndex = region->isPadded ? j : WRAP(j, cpe->width, region->columnMask);
+		int end = region->isPadded ? region->maxColumnIndex : MIN(region->maxColumnIndex, j + cpe->width - targetColumnIndex - 1);
+
+		struct scanRun *run = &runs[runCount++];
+		run->cpe = cpe->data[targetRowIndex] + targetColumnIndex;
+		run->cpe2 = (region->cpe2 != NULL) ? region->cpe2->data[targetRowIndex] + targetColumnIndex : NULL;
+		run->plane = region->plane->mono[targetRowIndex] + targetColumnIndex;
+		run->before = (region->before != NULL) ? region->before->mono[targetRowIndex] + targetColumnIndex : NULL;
+		run->cpp = cpp;
+		run->cppColumn = j - region->columnIndex;
+		run->count = end - j + 1;
+		run->firstPosition = (double) (i - region->minRowIndex) * windowWidth + (j - region->minColumnIndex);
+
+		j = end + 1;
+	}
+
+	return runCount;
+}
+
+// Scores the candidates one at a time.
+static void scanRegionScalar(const struct scanRegion *region, struct scanResult *result) {
+
+	int border = region->cpp->borderSize;
+	double best = result->laneValues[0];
+	double bestPosition = result->lanePositions[0];
+
+	for (int i = region->minRowIndex; i <= region->maxRowIndex; i++) {
+
+		struct scanRun runs[2];
+		int runCount = getScanRuns(region, i, runs);
+
+		for (int r = 0; r < runCount; r++) {
+
+			const struct scanRun *run = &runs[r];
+
+			for (int k = 0; k < run->count; k++) {
+
+				int isEligible;
+				switch (region->rule) {
+				case SWAP_SCAN_RULE_PLANE_SET: isEligible = run->plane[k] == 1; break;
+				case SWAP_SCAN_RULE_DIFFERENT_FROM_BEFORE: isEligible = run->plane[k] != run->before[k]; break;
+				default: isEligible = run->plane[k] != region->sourcePixel; break;
+				}
+
+				if (!isEligible) {
+					continue;
+				}
+
+				int cppColumnIndex = abs(run->cppColumn + k);
+				int hasCpp = run->cpp != NULL && cppColumnIndex <= border;
+
+				double deltaError = region->constant - region->a1 * run->cpe[k];
+				double cppTerm = 0.0;
+
+				if (hasCpp) {
+					cppTerm = -2.0 * run->cpp[cppColumnIndex];
+					deltaError += cppTerm;
+				}
+
+				if (run->cpe2 != NULL) {
+					double deltaError2 = region->constant2 - region->a1_2 * run->cpe2[k];
+					if (hasCpp) {
+						deltaError2 += cppTerm;
+					}
+					deltaError = deltaError + deltaError2;
+				}
+
+				if (deltaError < best) {
+					best = deltaError;
+					bestPosition = run->firstPosition + k;
+				}
+			}
+		}
+	}
+
+	result->laneValues[0] = best;
+	result->lanePositions[0] = bestPosition;
+}
+
+#ifdef SWAP_SCAN_HAS_X86_KERNELS
+
+// The bits of the lanes [first, last], none if first > last.
+static inline unsigned getLaneBits(int first, int last) {
+
+	return first <= last ? ((2u << last) - 1) & ~((1u << first) - 1) : 0;
+}
+
+// Reads the up to 8 plane bytes of the candidates [k, count) of a run, 0 past its end.
+static inline uint64_t loadPlaneBytes(const uint8_t *plane, int k, int count) {
+
+	uint64_t bytes = 0;
+
+	if (count - k >= 8) {
+		memcpy(&bytes, plane + k, sizeof(bytes));
+	}
+	else {
+		for (int l = count - k - 1; l >= 0; l--) {
+			bytes = (bytes << 8) | plane[k + l];
+		}
+	}
+
+	return bytes;
+}
+
+// Masked loads of 4 / 8 samples widened to double, so that the deltas are formed in double as in the scalar scan. The
+// lanes out of the mask read 0, and never fault.
+#ifdef DBS_SINGLE_PRECISION
+#define maskLoadSamples256(first, last, samples)    _mm256_cvtps_pd(_mm_maskload_ps(samples, getLaneMask128(first, last)))
+#define maskLoadSamples512(bits, samples)           _mm512_cvtps_pd(_mm512_castps512_ps256(_mm512_maskz_loadu_ps((__mmask16) (bits), samples)))
+#else
+#define maskLoadSamples256(first, last, samples)    _mm256_maskload_pd(samples, getLaneMask256(first, last))
+#define maskLoadSamples512(bits, samples)           _mm512_maskz_loadu_pd((__mmask8) (bits), samples)
+#endif
+
+// All ones in the 64 bit lanes [first, last] of 4.
+__attribute__((target("avx2")))
+static inline __m256i getLaneMask256(int first, int last) {
+
+	const __m256i lanes = _mm256_set_epi64x(3, 2, 1, 0);
+	__m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(_mm256_set1_epi64x(first), lanes),
+			_mm256_cmpgt_epi64(lanes, _mm256_set1_epi64x(last)));
+
+	return _mm256_xor_si256(outside, _mm256_set1_epi64x(-1));
+}
+
+// All ones in the 32 bit lanes [first, last] of 4.
+__attribute__((target("avx2")))
+static inline __m128i getLaneMask128(int first, int last) {
+
+	const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+	__m128i outside = _mm_or_si128(_mm_cmpgt_epi32(_mm_set1_epi32(first), lanes), _mm_cmpgt_epi32(lanes, _mm_set1_epi32(last)));
+
+	return _mm_xor_si128(outside, _mm_set1_epi32(-1));
+}
+
+// The Cpp entries of the 4 candidates at columns column .. column + 3 from the source: cpp[|c|] within the support, 0
+// out of it. The entries left of the source are read backward, as getSwapDeltaError reads them at |c|.
+__attribute__((target("avx2")))
+static inline __m256d loadCppAvx2(const dbsReal *cpp, int column, int border) {
+
+	// Most vectors lie on one side of the source, inside the support.
+	if (column >= 0 && column + 3 <= border) {
+		return maskLoadSamples256(0, 3, cpp + column);
+	}
+	if (column + 3 < 0 && -column <= border) {
+		return _mm256_permute4x64_pd(maskLoadSamples256(0, 3, cpp - column - 3), 0x1B);
+	}
+
+	int forwardFirst = MAX(0, -column);
+	int forwardLast = MIN(3, border - column);
+	int backwardFirst = MAX(0, -border - column);
+	int backwardLast = MIN(3, -1 - column);
+
+	__m256d entries = _mm256_setzero_pd();
+
+	if (forwardFirst <= forwardLast) {
+		entries = maskLoadSamples256(forwardFirst, forwardLast, cpp + column);
+	}
+
+	// Lane l reads cpp[-column - l], the sample 3 - l of the 4 from cpp - column - 3.
+	if (backwardFirst <= backwardLast) {
+		__m256d mirrored = _mm256_permute4x64_pd(maskLoadSamples256(3 - backwardLast, 3 - backwardFirst, cpp - column - 3), 0x1B);
+		entries = _mm256_blendv_pd(entries, mirrored, _mm256_castsi256_pd(getLaneMask256(backwardFirst, backwardLast)));
+	}
+
+	return entries;
+}
+
+__attribute__((target("avx2")))
+static void scanRegionAvx2(const struct scanRegion *region, struct scanResult *result) {
+
+	__m256d best = _mm256_loadu_pd(result->laneValues);
+	__m256d bestPosition = _mm256_loadu_pd(result->lanePositions);
+
+	const __m256d lanePositions = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+	const __m256d step = _mm256_set1_pd(4.0);
+	const __m256d minusTwo = _mm256_set1_pd(-2.0);
+	const __m256d constant = _mm256_set1_pd(region->constant);
+	const __m256d a1 = _mm256_set1_pd(region->a1);
+	const __m256d constant2 = _mm256_set1_pd(region->constant2);
+	const __m256d a1_2 = _mm256_set1_pd(region->a1_2);
+	const __m256i sourcePixel = _mm256_set1_epi64x(region->sourcePixel);
+	const __m256i one = _mm256_set1_epi64x(1);
+	int border = region->cpp->borderSize;
+
+	for (int i = region->minRowIndex; i <= region->maxRowIndex; i++) {
+
+		struct scanRun runs[2];
+		int runCount = getScanRuns(region, i, runs);
+
+		for (int r = 0; r < runCount; r++) {
+
+			const struct scanRun *run = &runs[r];
+			__m256d position = _mm256_add_pd(_mm256_set1_pd(run->firstPosition), lanePositions);
+
+			for (int k = 0; k < run->count; k += 4) {
+
+				// The lanes past the end of the run read 0, and are not eligible.
+				int last = MIN(3, run->count - k - 1);
+				__m256d isValid = (last == 3) ? _mm256_castsi256_pd(_mm256_set1_epi64x(-1)) : _mm256_castsi256_pd(getLaneMask256(0, last));
+
+				// Widen 4 plane bytes to 4 x 64 bits, so that the compare gives a mask over the double lanes.
+				__m256i plane = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128((int) loadPlaneBytes(run->plane, k, run->count)));
+
+				__m256d deltaError = _mm256_sub_pd(constant, _mm256_mul_pd(a1, maskLoadSamples256(0, last, run->cpe + k)));
+				__m256d cppTerm = _mm256_setzero_pd();
+
+				// Out of the support the Cpp term is -0.0, which leaves the deltas unchanged.
+				if (run->cpp != NULL) {
+					cppTerm = _mm256_mul_pd(minusTwo, loadCppAvx2(run->cpp, run->cppColumn + k, border));
+					deltaError = _mm256_add_pd(deltaError, cppTerm);
+				}
+
+				if (run->cpe2 != NULL) {
+					__m256d deltaError2 = _mm256_sub_pd(constant2, _mm256_mul_pd(a1_2, maskLoadSamples256(0, last, run->cpe2 + k)));
+					if (run->cpp != NULL) {
+						deltaError2 = _mm256_add_pd(deltaError2, cppTerm);
+					}
+					deltaError = _mm256_add_pd(deltaError, deltaError2);
+				}
+
+				__m256d isEligible;
+
+				switch (region->rule) {
+				case SWAP_SCAN_RULE_PLANE_SET:
+					isEligible = _mm256_and_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(plane, one)), isValid);
+					break;
+				case SWAP_SCAN_RULE_DIFFERENT_FROM_BEFORE: {
+					__m256i before = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128((int) loadPlaneBytes(run->before, k, run->count)));
+					isEligible = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(plane, before)), isValid);
+					break;
+				}
+				default:
+					isEligible = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(plane, sourcePixel)), isValid);
+					break;
+				}
+
+				__m256d mask = _mm256_and_pd(isEligible, _mm256_cmp_pd(deltaError, best, _CMP_LT_OQ));
+
+				best = _mm256_blendv_pd(best, deltaError, mask);
+				bestPosition = _mm256_blendv_pd(bestPosition, position, mask);
+				position = _mm256_add_pd(position, step);
+			}
+		}
+	}
+
+	_mm256_storeu_pd(result->laneValues, best);
+	_mm256_storeu_pd(result->lanePositions, bestPosition);
+}
+
+// The Cpp entries of the 8 candidates at columns column .. column + 7 from the source, as loadCppAvx2.
+__attribute__((target("avx512f")))
+static inline __m512d loadCppAvx512(const dbsReal *cpp, int column, int border, __m512i reverse) {
+
+	// Most vectors lie on one side of the source, inside the support.
+	if (column >= 0 && column + 7 <= border) {
+		return maskLoadSamples512(0xFF, cpp + column);
+	}
+	if (column + 7 < 0 && -column <= border) {
+		return _mm512_permutexvar_pd(reverse, maskLoadSamples512(0xFF, cpp - column - 7));
+	}
+
+	unsigned forward = getLaneBits(MAX(0, -column), MIN(7, border - column));
+	int backwardFirst = MAX(0, -border - column);
+	int backwardLast = MIN(7, -1 - column);
+
+	__m512d entries = _mm512_setzero_pd();
+
+	if (forward != 0) {
+		entries = maskLoadSamples512(forward, cpp + column);
+	}
+
+	// Lane l reads cpp[-column - l], the sample 7 - l of the 8 from cpp - column - 7.
+	if (backwardFirst <= backwardLast) {
+		__m512d mirrored = _mm512_permutexvar_pd(reverse,
+				maskLoadSamples512(getLaneBits(7 - backwardLast, 7 - backwardFirst), cpp - column - 7));
+		entries = _mm512_mask_blend_pd((__mmask8) getLaneBits(backwardFirst, backwardLast), entries, mirrored);
+	}
+
+	return entries;
+}
+
+__attribute__((target("avx512f")))
+static void scanRegionAvx512(const struct scanRegion *region, struct scanResult *result) {
+
+	__m512d best = _mm512_loadu_pd(result->laneValues);
+	__m512d bestPosition = _mm512_loadu_pd(result->lanePositions);
+
+	const __m512d lanePositions = _mm512_set_pd(7.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0, 0.0);
+	const __m512d step = _mm512_set1_pd(8.0);
+	const __m512d minusTwo = _mm512_set1_pd(-2.0);
+	const __m512d constant = _mm512_set1_pd(region->constant);
+	const __m512d a1 = _mm512_set1_pd(region->a1);
+	const __m512d constant2 = _mm512_set1_pd(region->constant2);
+	const __m512d a1_2 = _mm512_set1_pd(region->a1_2);
+	const __m512i sourcePixel = _mm512_set1_epi64(region->sourcePixel);
+	const __m512i one = _mm512_set1_epi64(1);
+	const __m512i reverse = _mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+	int border = region->cpp->borderSize;
+
+	for (int i = region->minRowIndex; i <= region->maxRowIndex; i++) {
+
+		struct scanRun runs[2];
+		int runCount = getScanRuns(region, i, runs);
+
+		for (int r = 0; r < runCount; r++) {
+
+			const struct scanRun *run = &runs[r];
+			__m512d position = _mm512_add_pd(_mm512_set1_pd(run->firstPosition), lanePositions);
+
+			for (int k = 0; k < run->count; k += 8) {
+
+				// The lanes past the end of the run read 0, and are not eligible.
+				__mmask8 isValid = (__mmask8) getLaneBits(0, MIN(7, run->count - k - 1));
+
+				uint64_t planeBytes = loadPlaneBytes(run->plane, k, run->count);
+				__m512i plane = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *) &planeBytes));
+
+				__m512d deltaError = _mm512_sub_pd(constant, _mm512_mul_pd(a1, maskLoadSamples512(isValid, run->cpe + k)));
+				__m512d cppTerm = _mm512_setzero_pd();
+
+				// Out of the support the Cpp term is -0.0, which leaves the deltas unchanged.
+				if (run->cpp != NULL) {
+					cppTerm = _mm512_mul_pd(minusTwo, loadCppAvx512(run->cpp, run->cppColumn + k, border, reverse));
+					deltaError = _mm512_add_pd(deltaError, cppTerm);
+				}
+
+				if (run->cpe2 != NULL) {
+					__m512d deltaError2 = _mm512_sub_pd(constant2, _mm512_mul_pd(a1_2, maskLoadSamples512(isValid, run->cpe2 + k)));
+					if (run->cpp != NULL) {
+						deltaError2 = _mm512_add_pd(deltaError2, cppTerm);
+					}
+					deltaError = _mm512_add_pd(deltaError, deltaError2);
+				}
+
+				__mmask8 isEligible;
+
+				switch (region->rule) {
+				case SWAP_SCAN_RULE_PLANE_SET:
+					isEligible = _mm512_mask_cmpeq_epi64_mask(isValid, plane, one);
+					break;
+				case SWAP_SCAN_RULE_DIFFERENT_FROM_BEFORE: {
+					uint64_t beforeBytes = loadPlaneBytes(run->before, k, run->count);
+					isEligible = _mm512_mask_cmpneq_epi64_mask(isValid, plane,
+							_mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *) &beforeBytes)));
+					break;
+				}
+				default:
+					isEligible = _mm512_mask_cmpneq_epi64_mask(isValid, plane, sourcePixel);
+					break;
+				}
+
+				__mmask8 mask = _mm512_mask_cmp_pd_mask(isEligible, deltaError, best, _CMP_LT_OQ);
+
+				best = _mm512_mask_blend_pd(mask, best, deltaError);
+				bestPosition = _mm512_mask_blend_pd(mask, bestPosition, position);
+				position = _mm512_add_pd(position, step);
+			}
+		}
+	}
+
+	_mm512_storeu_pd(result->laneValues, best);
+	_mm512_storeu_pd(result->lanePositions, bestPosition);
+}
+
+#endif
+
+int resolveScanKernel(int requestedKernel) {
+
+	if (requestedKernel == DBS_SCAN_KERNEL_SCALAR) {
+		return DBS_SCAN_KERNEL_SCALAR;
+	}
+
+#ifdef SWAP_SCAN_HAS_X86_KERNELS
+	__builtin_cpu_init();
+
+	if (requestedKernel != DBS_SCAN_KERNEL_AVX2 && __builtin_cpu_supports("avx512f")) {
+		return DBS_SCAN_KERNEL_AVX512;
+	}
+
+	if (__builtin_cpu_supports("avx2")) {
+		return DBS_SCAN_KERNEL_AVX2;
+	}
+#endif
+
+	return DBS_SCAN_KERNEL_SCALAR;
+}
+
+double scanSwapRegionVectorized(struct Config *config, int kernel, int rule,
+		struct pxm_img *halftone, struct doubleImage *cpe, struct pxm_img *halftone2, struct doubleImage *cpe2,
+		struct pxm_img *eligibilityPlane, struct pxm_img *beforePlane, struct doubleImage *cpp,
+		int rowIndex, int columnIndex, int *swapTargetRowIndex, int *swapTargetColumnIndex) {
+
+	scanRegionKernel scanRegion = scanRegionScalar;
+
+#ifdef SWAP_SCAN_HAS_X86_KERNELS
+	if (kernel == DBS_SCAN_KERNEL_AVX512) {
+		scanRegion = scanRegionAvx512;
+	}
+	else if (kernel == DBS_SCAN_KERNEL_AVX2) {
+		scanRegion = scanRegionAvx2;
+	}
+#endif
+
+	struct scanRegion region;
+	region.rule = rule;
+	region.sourcePixel = halftone->mono[rowIndex][columnIndex];
+
+	// The source terms of getSwapDeltaError, per plane.
+	double cppPeak = cpp->data[0][0];
+	double a0 = region.sourcePixel ? -1.0 : 1.0;
+	region.constant = 2.0 * cppPeak - 2.0 * a0 * cpe->data[rowIndex][columnIndex];
+	region.a1 = -2.0 * a0;
+
+	region.constant2 = 0.0;
+	region.a1_2 = 0.0;
+	if (cpe2 != NULL) {
+		double a0_2 = halftone2->mono[rowIndex][columnIndex] ? -1.0 : 1.0;
+		region.constant2 = 2.0 * cppPeak - 2.0 * a0_2 * cpe2->data[rowIndex][columnIndex];
+		region.a1_2 = -2.0 * a0_2;
+	}
+
+	region.cpe = cpe;
+	region.cpe2 = cpe2;
+	region.plane = eligibilityPlane;
+	region.before = beforePlane;
+	region.cpp = cpp;
+	region.rowIndex = rowIndex;
+	region.columnIndex = columnIndex;
+
+	// The swap region, clipped to the torus. A padded plane holds the whole region, so a row never has to be cut where
+	// the image wraps.
+	getSwapWindowRange(config, rowIndex, cpe->height, &region.minRowIndex, &region.maxRowIndex);
+	getSwapWindowRange(config, columnIndex, cpe->width, &region.minColumnIndex, &region.maxColumnIndex);
+	region.isPadded = cpe->haloSize > 0;
+	region.rowMask = getWrapMask(cpe->height);
+	region.columnMask = getWrapMask(cpe->width);
+
+	struct scanResult result;
+	for (int lane = 0; lane < SWAP_SCAN_MAX_LANES; lane++) {
+		result.laneValues[lane] = 0.0;
+		result.lanePositions[lane] = -1.0;
+	}
+
+	scanRegion(&region, &result);
+
+	// Reduce the lanes: the lowest delta wins, and the lowest scan position breaks ties.
+	double minDeltaError = 0.0;
+	double bestPosition = -1.0;
+
+	for (int lane = 0; lane < SWAP_SCAN_MAX_LANES; lane++) {
+		if (result.laneValues[lane] < minDeltaError ||
+			(result.laneValues[lane] == minDeltaError && result.lanePositions[lane] >= 0.0 &&
+			 (bestPosition < 0.0 || result.lanePositions[lane] < bestPosition))) {
+
+			minDeltaError = result.laneValues[lane];
+			bestPosition = result.lanePositions[lane];
+		}
+	}
+
+	if (minDeltaError < 0.0) {
+		int windowWidth = region.maxColumnIndex - region.minColumnIndex + 1;
+		int position = (int) bestPosition;
+		*swapTargetRowIndex = MOD(region.minRowIndex + position / windowWidth, cpe->height);
+		*swapTargetColumnIndex = MOD(region.minColumnIndex + position % windowWidth, cpe->width);
+	}
+	else {
+		minDeltaError = 0.0;
+	}
+
+	return minDeltaError;
+}
@@ -0,0 +1,36 @@
+#ifndef SWAP_SCAN_H
+#define SWAP_SCAN_H
+
+#include <stdint.h>
+
+struct Config;
+struct doubleImage;
+struct pxm_img;
+
+// Eligibility rules of the swap targets, one per getSwapDeltaErrorInRegion_* variant.
+// DIFFERENT_FROM_SOURCE: the target differs from the source pixel (_2).
+// PLANE_SET: the target is a dot of the second plane (_1).
+// DIFFERENT_FROM_BEFORE: the target of the second plane changed since the previous level (_3).
+#define SWAP_SCAN_RULE_DIFFERENT_FROM_SOURCE    0
+#define SWAP_SCAN_RULE_PLANE_SET                1
+#define SWAP_SCAN_RULE_DIFFERENT_FROM_BEFORE    2
+
+// Maps a requested DBS_SCAN_KERNEL_* value to the best kernel this processor can run.
+int resolveScanKernel(int requestedKernel);
+
+// Vectorized equivalent of getSwapDeltaErrorInRegion_*. The delta of the first plane (halftone, cpe) is always
+// scored, and the delta of the second plane (halftone2, cpe2) is added when cpe2 is not NULL. The rule decides the
+// eligible targets from eligibilityPlane (and beforePlane).
+//
+// Tie-break: among equal deltas, the candidate that comes first in the scalar scan order wins, i.e. the lowest
+// window row, then the lowest window column, both counted from the unwrapped top-left corner of the window. Each
+// lane keeps the first minimum of its own candidates, and the final reduction picks the lowest position among the
+// lanes holding the minimum, which gives the same target as the scalar loop. Deltas are formed with the same
+// operations, in the same order, as getSwapDeltaError. Their products are by -2 or 2, and so exact, which keeps the two
+// paths equal bit for bit even where the compiler contracts them into FMAs.
+double scanSwapRegionVectorized(struct Config *config, int kernel, int rule,
+		struct pxm_img *halftone, struct doubleImage *cpe, struct pxm_img *halftone2, struct doubleImage *cpe2,
+		struct pxm_img *eligibilityPlane, struct pxm_img *beforePlane, struct doubleImage *cpp,
+		int rowIndex, int columnIndex, int *swapTargetRowIndex, int *swapTargetColumnIndex);
+
+#endif
@@ -0,0 +1,113 @@
+/******************************************************************
+* file: swapWindow.c
+* Implementing: Histograms of the accepted swap distances
+* Every design call keeps the histogram of its own swaps, and adds it to that of the whole design when it ends, so that
+* the swaps themselves are counted without a lock.
+*******************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "dbs.h"
+#include "swapWindow.h"
+
+static pthread_mutex_t designHistogramLock = PTHREAD_MUTEX_INITIALIZER;
+static struct swapHistogram *designHistogram = NULL;
+
+struct swapHistogram* createSwapHistogram(int maxDistance) {
+
+	struct swapHistogram *histogram = (struct swapHistogram *) malloc(sizeof(struct swapHistogram));
+	histogram->maxDistance = MAX(maxDistance, 0);
+	histogram->swapCount = 0;
+	histogram->counts = (long *) calloc(histogram->maxDistance + 1, sizeof(long));
+
+	return histogram;
+}
+
+void deallocateSwapHistogram(struct swapHistogram *histogram) {
+
+	free(histogram->counts);
+	free(histogram);
+}
+
+void clearSwapHistogram(struct swapHistogram *histogram) {
+
+	memset(histogram->counts, 0, (histogram->maxDistance + 1) * sizeof(long));
+	histogram->swapCount = 0;
+}
+
+void addSwapDistance(struct swapHistogram *histogram, int distance) {
+
+	histogram->counts[MIN(distance, histogram->maxDistance)]++;
+	histogram->swapCount++;
+}
+
+void mergeSwapHistogram(struct swapHistogram *total, struct swapHistogram *histogram) {
+
+	for (int distance = 0; distance <= histogram->maxDistance; distance++) {
+		total->counts[MIN(distance, total->maxDistance)] += histogram->counts[distance];
+	}
+
+	total->swapCount += histogram->swapCount;
+}
+
+int getSwapDistancePercentile(struct swapHistogram *histogram, double fraction) {
+
+	long swapCount = 0;
+
+	for (int distance = 0; distance <= histogram->maxDistance; distance++) {
+
+		swapCount += histogram->counts[distance];
+		if (swapCount > 0 && swapCount >= fraction * histogram->swapCount) {
+			return distance;
+		}
+	}
+
+	return 0;
+}
+
+void recordDesignSwapHistogram(struct swapHistogram *histogram) {
+
+	pthread_mutex_lock(&designHistogramLock);
+
+	// The design histogram grows to the longest distance of its calls.
+	if (designHistogram == NULL || designHistogram->maxDistance < histogram->maxDistance) {
+
+		struct swapHistogram *grown = createSwapHistogram(histogram->maxDistance);
+		if (designHistogram != NULL) {
+			mergeSwapHistogram(grown, designHistogram);
+			deallocateSwapHistogram(designHistogram);
+		}
+		designHistogram = grown;
+	}
+
+	mergeSwapHistogram(designHistogram, histogram);
+
+	pthread_mutex_unlock(&designHistogramLock);
+}
+
+void printDesignSwapHistogram(FILE *output, const char *label) {
+
+	pthread_mutex_lock(&designHistogramLock);
+
+	fprintf(output, "Swap distances of %s: %ld swaps\n", label, designHistogram != NULL ? designHistogram->swapCount : 0L);
+
+	if (designHistogram != NULL && designHistogram->swapCount > 0) {
+
+		long swapCount = 0;
+		fprintf(output, "distance\tswaps\tcumulative\n");
+
+		for (int distance = 0; distance <= designHistogram->maxDistance; distance++) {
+
+			swapCount += designHistogram->counts[distance];
+			if (designHistogram->counts[distance] > 0) {
+				fprintf(output, "%d\t%ld\t%.2f%%\n", distance, designHistogram->counts[distance],
+						100.0 * swapCount / designHistogram->swapCount);
+			}
+		}
+
+		clearSwapHistogram(designHistogram);
+	}
+
+	pthread_mutex_unlock(&designHistogramLock);
+}
@@ -0,0 +1,39 @@
+#ifndef SWAP_WINDOW_H
+#define SWAP_WINDOW_H
+
+#include <stdio.h>
+
+// Histograms of the distances of the accepted swaps, on which the adaptive swap window is built (see
+// swapWindowPercentile in dbs.h). The distance of a swap is the larger of its row and column distances on the torus,
+// which is the smallest swap reach whose window holds its target.
+struct swapHistogram
+{
+	int maxDistance;
+	long swapCount;
+
+	// The swaps of every distance, from 0 to maxDistance.
+	long *counts;
+};
+
+// Creates an empty histogram of the distances up to maxDistance. Longer ones are counted as maxDistance.
+struct swapHistogram* createSwapHistogram(int maxDistance);
+
+void deallocateSwapHistogram(struct swapHistogram *histogram);
+
+void clearSwapHistogram(struct swapHistogram *histogram);
+
+void addSwapDistance(struct swapHistogram *histogram, int distance);
+
+// Adds the swaps of a histogram to another one.
+void mergeSwapHistogram(struct swapHistogram *total, struct swapHistogram *histogram);
+
+// Returns the shortest distance that holds the given fraction of the swaps, 0 if there is none.
+int getSwapDistancePercentile(struct swapHistogram *histogram, double fraction);
+
+// Adds a histogram to that of the whole design. It may be called from several threads.
+void recordDesignSwapHistogram(struct swapHistogram *histogram);
+
+// Prints the histogram of the design since the last call, headed by label, and clears it.
+void printDesignSwapHistogram(FILE *output, const char *label);
+
+#endif
@@ -0,0 +1,220 @@
+/******************************************************************
+* file: sweep.c
+* Implementing: Parameter sweep over a list of configurations
+* The read-only tables and images are set up once, serially, and the designs then run on a thread pool, one
+* configuration per task, each on its own copies of the halftones and cpe planes.
+*******************************************************************/
+
+#include "dbs.h"
+#include "allocate.h"
+#include "sweep.h"
+#include "parseXml.h"
+#include "threadPool.h"
+#include "swapScan.h"
+#include "fftConvolve.h"
+#include "hvsCache.h"
+#include "imageStorage.h"
+#include "initialDesign.h"
+#include "randomStream.h"
+
+// The psf and Cpp of an HVS model.
+struct sweepModel
+{
+	int scaleFactor;
+	int hvsSpreadSize;
+	struct doubleImage *psf;
+	struct doubleImage *cpp;
+};
+
+// The input images of the runs, and the initial patterns they start from.
+struct sweepInputs
+{
+	char *inputImagePath;
+	char *inputImagePath2;
+	char *initialHalftonePath;
+	double gamma;
+	unsigned int randomSeed;
+
+	struct doubleImage *inputImage;
+	struct doubleImage *inputImage2;
+	struct pxm_img *halftoneCMY;
+
+	// The stream past the draws of halftoneCMY, from which every run splits it.
+	struct randomStream random;
+};
+
+struct sweepRun
+{
+	Config config;
+	struct sweepModel *model;
+	struct sweepInputs *inputs;
+
+	// The wall time of the design, and the RMS errors of the CMY, C, M and Y planes at its end.
+	double seconds;
+	double rmsErrors[4];
+
+	char *output;
+	size_t outputSize;
+};
+
+static struct sweepModel* getSweepModel(struct sweepModel *models, int *modelCount, Config *config) {
+
+	for (int k = 0; k < *modelCount; k++) {
+		if (models[k].scaleFactor == config->scaleFactor && models[k].hvsSpreadSize == config->hvsSpreadSize) {
+			return &models[k];
+		}
+	}
+
+	struct sweepModel *model = &models[(*modelCount)++];
+	model->scaleFactor = config->scaleFactor;
+	model->hvsSpreadSize = config->hvsSpreadSize;
+	getHvsTables(config, &model->psf, &model->cpp);
+
+	return model;
+}
+
+static struct sweepInputs* getSweepInputs(struct sweepInputs *inputs, int *inputsCount, Config *config) {
+
+	for (int k = 0; k < *inputsCount; k++) {
+		if (!strcmp(inputs[k].inputImagePath, config->inputImagePath) &&
+			!strcmp(inputs[k].inputImagePath2, config->inputImagePath2) &&
+			!strcmp(inputs[k].initialHalftonePath, config->initialHalftonePath) && inputs[k].gamma == config->gamma &&
+			inputs[k].randomSeed == config->randomSeed) {
+			return &inputs[k];
+		}
+	}
+
+	double maxGrayLevel = 255.0;
+
+	struct sweepInputs *input = &inputs[(*inputsCount)++];
+	input->inputImagePath = config->inputImagePath;
+	input->inputImagePath2 = config->inputImagePath2;
+	input->initialHalftonePath = config->initialHalftonePath;
+	input->gamma = config->gamma;
+	input->randomSeed = config->randomSeed;
+
+	input->inputImage = readDoubleImage(config->inputImagePath, maxGrayLevel, config->gamma);
+	input->inputImage2 = readDoubleImage(config->inputImagePath2, maxGrayLevel, config->gamma);
+
+	// The initial halftone is drawn here, once, from stream 0 of the seed, and every run of the inputs splits it with
+	// its own copy of the stream that follows, so that all of them start from the patterns of the design of app.c.
+	initRandomStream(&input->random, config->randomSeed, 0);
+	input->halftoneCMY = getInitialHalftone(config->initialHalftonePath, input->inputImage, maxGrayLevel, &input->random);
+
+	return input;
+}
+
+static void performSweepRun(void *argument, int index) {
+
+	struct sweepRun *run = &((struct sweepRun *) argument)[index];
+	struct sweepInputs *inputs = run->inputs;
+	struct doubleImage *cpp = run->model->cpp;
+	Config *config = &run->config;
+
+	FILE *output = open_memstream(&run->output, &run->outputSize);
+	setDesignOutput(output);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct pxm_img *halftoneCMY = samepattern(inputs->halftoneCMY);
+	struct pxm_img *halftoneC = createHalftone(halftoneCMY->height, halftoneCMY->width);
+	struct pxm_img *halftoneM = createHalftone(halftoneCMY->height, halftoneCMY->width);
+	struct pxm_img *halftoneY = createHalftone(halftoneCMY->height, halftoneCMY->width);
+
+	if (config->portfolioSeedCount > 1) {
+		designInitialPortfolio(config, inputs->inputImage, inputs->inputImage2, cpp, halftoneCMY, halftoneC, halftoneM,
+				halftoneY, run->rmsErrors);
+	}
+	else {
+		struct randomStream random = inputs->random;
+		designInitialPatterns(config, inputs->inputImage, inputs->inputImage2, cpp, &random, halftoneCMY, halftoneC,
+				halftoneM, halftoneY, run->rmsErrors);
+	}
+
+	run->seconds = getElapsedSeconds(&start);
+
+	free_pxm(halftoneCMY);
+	free_pxm(halftoneC);
+	free_pxm(halftoneM);
+	free_pxm(halftoneY);
+
+	setDesignOutput(NULL);
+	fclose(output);
+}
+
+int runConfigurationSweep(struct Config *baseConfig, char *listPath) {
+
+	int runCount;
+	Config *configs = parseConfigurationList(listPath, baseConfig, &runCount);
+
+	if (configs == NULL) {
+		return -1;
+	}
+
+	struct sweepRun *runs = (struct sweepRun *) calloc(MAX(runCount, 1), sizeof(struct sweepRun));
+	struct sweepModel *models = (struct sweepModel *) malloc(MAX(runCount, 1) * sizeof(struct sweepModel));
+	struct sweepInputs *inputs = (struct sweepInputs *) malloc(MAX(runCount, 1) * sizeof(struct sweepInputs));
+	int modelCount = 0;
+	int inputsCount = 0;
+
+	// Everything the runs share is read, computed and transformed before they start, and only read afterwards.
+	for (int k = 0; k < runCount; k++) {
+
+		struct sweepRun *run = &runs[k];
+		run->config = configs[k];
+		run->config.scanKernel = resolveScanKernel(run->config.scanKernel);
+		run->model = getSweepModel(models, &modelCount, &run->config);
+		run->inputs = getSweepInputs(inputs, &inputsCount, &run->config);
+
+		if (chooseConvolutionMethod(&run->config, run->inputs->inputImage, run->model->cpp) == DBS_CONVOLUTION_FFT) {
+			prepareKernelSpectrum(run->model->cpp, run->inputs->inputImage->height, run->inputs->inputImage->width);
+		}
+	}
+
+	printf("Sweep of %d configurations, over %d HVS models and %d input sets\n", runCount, modelCount, inputsCount);
+	fflush(stdout);
+
+	struct threadPool *pool = createThreadPool(0);
+	runParallelFor(pool, runCount, performSweepRun, runs);
+	destroyThreadPool(pool);
+
+	for (int k = 0; k < runCount; k++) {
+		printf("\n---------------------------------------- Run %d ----------------------------------------\n", k + 1);
+		fwrite(runs[k].output, 1, runs[k].outputSize, stdout);
+		free(runs[k].output);
+	}
+
+	printf("\n%4s %11s %13s %8s %9s %17s %9s %9s %9s %9s %9s\n", "run", "scaleFactor", "hvsSpreadSize", "swapSize",
+			"block", "maxIterationCount", "seconds", "rmsCMY", "rmsC", "rmsM", "rmsY");
+
+	for (int k = 0; k < runCount; k++) {
+
+		Config *config = &runs[k].config;
+		char block[32];
+		sprintf(block, "%dx%d", config->blockHeight, config->blockWidth);
+
+		printf("%4d %11d %13d %8d %9s %17d %9.2f %9.6f %9.6f %9.6f %9.6f\n", k + 1, config->scaleFactor,
+				config->hvsSpreadSize, config->swapSize, block, config->maxIterationCount, runs[k].seconds,
+				runs[k].rmsErrors[0], runs[k].rmsErrors[1], runs[k].rmsErrors[2], runs[k].rmsErrors[3]);
+	}
+	fflush(stdout);
+
+	for (int k = 0; k < modelCount; k++) {
+		deallocateShiftedImage(models[k].cpp);
+		deallocateShiftedImage(models[k].psf);
+	}
+
+	for (int k = 0; k < inputsCount; k++) {
+		deallocateImage(inputs[k].inputImage);
+		deallocateImage(inputs[k].inputImage2);
+		free_pxm(inputs[k].halftoneCMY);
+	}
+
+	free(models);
+	free(inputs);
+	free(runs);
+	free(configs);
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+struct Config;
+
+// Runs the initial joint design of app.c (see initialDesign.h) for every configuration of the list at listPath (see
+// parseConfigurationList), several at a time, and prints the output of every run followed by a table of its runtime
+// and final RMS errors. The runs that share their HVS model (scaleFactor and hvsSpreadSize) share its psf and Cpp, and
+// those that share their input paths, gamma and randomSeed share the input images and the initial halftone, which they
+// split as app.c does. A run of a portfolioSeedCount above 1 draws the halftones of its portfolio on its own. A run
+// can set the options of parseStory, although those of the level by level design only (dotSelectionMode and
+// enableConcurrentColorants) have no effect on the sweep. Returns 0, or -1 if the list cannot be read.
+int runConfigurationSweep(struct Config *baseConfig, char *listPath);
+
+#endif
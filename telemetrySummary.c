@@ -0,0 +1,309 @@
+/******************************************************************
+* file: telemetrySummary.c
+* Implementing: Summary of the pass records of a design (see passTelemetry.h)
+* Adds up the passes and their time per level and per design phase, from a CSV or a JSON Lines file. The passes that
+* accepted fewer than a given number of changes are counted apart, to see what a higher minAcceptableChangeCount would
+* save.
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SUMMARY_LINE_SIZE 1024
+#define SUMMARY_COLUMN_COUNT 16
+
+// The passes of a level of a design phase.
+struct levelSummary
+{
+	int phase;
+	int level;
+	int callCount;
+	int passCount;
+	int maxPassIndex;
+	long changeCount;
+	double seconds;
+
+	// The passes with fewer changes than the threshold, and their time.
+	int smallPassCount;
+	double smallSeconds;
+};
+
+// The fields of a record that the summary uses.
+struct summaryRecord
+{
+	int phase;
+	int level;
+	int passIndex;
+	long changeCount;
+	double seconds;
+};
+
+// Reads a value of a JSON Lines record, or returns 0 if it has no such field.
+static int getJsonField(char *line, const char *name, double *value) {
+
+	char key[64];
+	snprintf(key, sizeof(key), "\"%s\":", name);
+
+	char *position = strstr(line, key);
+	if (position == NULL) {
+		return 0;
+	}
+
+	*value = strtod(position + strlen(key), NULL);
+	return 1;
+}
+
+static int parseJsonRecord(char *line, struct summaryRecord *record) {
+
+	double phase, level, passIndex, toggleCount, swapCount, seconds;
+
+	if (!getJsonField(line, "phase", &phase) || !getJsonField(line, "level", &level) || !getJsonField(line, "pass", &passIndex)
+			|| !getJsonField(line, "toggles", &toggleCount) || !getJsonField(line, "swaps", &swapCount)
+			|| !getJsonField(line, "seconds", &seconds)) {
+		return 0;
+	}
+
+	record->phase = (int) phase;
+	record->level = (int) level;
+	record->passIndex = (int) passIndex;
+	record->changeCount = (long) (toggleCount + swapCount);
+	record->seconds = seconds;
+	return 1;
+}
+
+// Splits a CSV line in place, and returns the number of fields.
+static int splitCsvLine(char *line, char **fields) {
+
+	int count = 0;
+	line[strcspn(line, "\r\n")] = '\0';
+
+	while (count < SUMMARY_COLUMN_COUNT) {
+		fields[count++] = line;
+
+		char *comma = strchr(line, ',');
+		if (comma == NULL) {
+			break;
+		}
+		*comma = '\0';
+		line = comma + 1;
+	}
+
+	return count;
+}
+
+// The column of every field of the CSV header, -1 if it is missing.
+struct csvColumns
+{
+	int phase;
+	int level;
+	int passIndex;
+	int toggleCount;
+	int swapCount;
+	int seconds;
+};
+
+static int findColumn(char **fields, int fieldCount, const char *name) {
+
+	for (int k = 0; k < fieldCount; k++) {
+		if (strcmp(fields[k], name) == 0) {
+			return k;
+		}
+	}
+
+	return -1;
+}
+
+static int parseCsvRecord(char *line, struct csvColumns *columns, struct summaryRecord *record) {
+
+	char *fields[SUMMARY_COLUMN_COUNT];
+	int fieldCount = splitCsvLine(line, fields);
+
+	int lastColumn = columns->phase;
+	int used[5] = { columns->level, columns->passIndex, columns->toggleCount, columns->swapCount, columns->seconds };
+	for (int k = 0; k < 5; k++) {
+		lastColumn = used[k] > lastColumn ? used[k] : lastColumn;
+	}
+
+	if (fieldCount <= lastColumn) {
+		return 0;
+	}
+
+	record->phase = atoi(fields[columns->phase]);
+	record->level = atoi(fields[columns->level]);
+	record->passIndex = atoi(fields[columns->passIndex]);
+	record->changeCount = atol(fields[columns->toggleCount]) + atol(fields[columns->swapCount]);
+	record->seconds = strtod(fields[columns->seconds], NULL);
+	return 1;
+}
+
+static struct levelSummary* getLevelSummary(struct levelSummary **levels, int *levelCount, int *levelCapacity,
+		int phase, int level) {
+
+	// The records of a level are contiguous, unless its designs ran concurrently with another level's.
+	for (int k = *levelCount - 1; k >= 0; k--) {
+		if ((*levels)[k].phase == phase && (*levels)[k].level == level) {
+			return &(*levels)[k];
+		}
+	}
+
+	if (*levelCount == *levelCapacity) {
+		*levelCapacity = *levelCapacity > 0 ? 2 * *levelCapacity : 256;
+		*levels = (struct levelSummary *) realloc(*levels, *levelCapacity * sizeof(struct levelSummary));
+	}
+
+	struct levelSummary *summary = &(*levels)[(*levelCount)++];
+	memset(summary, 0, sizeof(struct levelSummary));
+	summary->phase = phase;
+	summary->level = level;
+	return summary;
+}
+
+static void addLevelSummary(struct levelSummary *total, struct levelSummary *summary) {
+
+	total->callCount += summary->callCount;
+	total->passCount += summary->passCount;
+	total->maxPassIndex = summary->maxPassIndex > total->maxPassIndex ? summary->maxPassIndex : total->maxPassIndex;
+	total->changeCount += summary->changeCount;
+	total->seconds += summary->seconds;
+	total->smallPassCount += summary->smallPassCount;
+	total->smallSeconds += summary->smallSeconds;
+}
+
+static void printLevelSummary(const char *label, struct levelSummary *summary) {
+
+	printf("%s\t%d\t%d\t%.2f\t%d\t%ld\t%.3f\t%d\t%.3f\n", label, summary->callCount, summary->passCount,
+			summary->callCount > 0 ? (double) summary->passCount / summary->callCount : 0.0, summary->maxPassIndex,
+			summary->changeCount, summary->seconds, summary->smallPassCount, summary->smallSeconds);
+}
+
+int main(int argc, char **argv) {
+
+	int changeThreshold = 5;
+	int option;
+
+	while ((option = getopt(argc, argv, "c:")) != -1) {
+		if (option == 'c') {
+			changeThreshold = atoi(optarg);
+		}
+		else {
+			optind = argc + 1;
+			break;
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-c changeCount] telemetry.csv|telemetry.jsonl\n", argv[0]);
+		return -1;
+	}
+
+	FILE *file = fopen(argv[optind], "r");
+	if (file == NULL) {
+		fprintf(stderr, "cannot open %s\n", argv[optind]);
+		return -1;
+	}
+
+	struct levelSummary *levels = NULL;
+	int levelCount = 0;
+	int levelCapacity = 0;
+
+	struct csvColumns columns = { -1, -1, -1, -1, -1, -1 };
+	int isCsv = 0;
+	int lineIndex = 0;
+	int skippedCount = 0;
+	char line[SUMMARY_LINE_SIZE];
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+
+		lineIndex++;
+
+		// A CSV file starts with its header.
+		if (lineIndex == 1 && line[0] != '{') {
+
+			char *fields[SUMMARY_COLUMN_COUNT];
+			int fieldCount = splitCsvLine(line, fields);
+
+			columns.phase = findColumn(fields, fieldCount, "phase");
+			columns.level = findColumn(fields, fieldCount, "level");
+			columns.passIndex = findColumn(fields, fieldCount, "pass");
+			columns.toggleCount = findColumn(fields, fieldCount, "toggles");
+			columns.swapCount = findColumn(fields, fieldCount, "swaps");
+			columns.seconds = findColumn(fields, fieldCount, "seconds");
+
+			if (columns.phase < 0 || columns.level < 0 || columns.passIndex < 0 || columns.toggleCount < 0
+					|| columns.swapCount < 0 || columns.seconds < 0) {
+				fprintf(stderr, "%s is missing a column of the pass records\n", argv[optind]);
+				return -1;
+			}
+
+			isCsv = 1;
+			continue;
+		}
+
+		struct summaryRecord record;
+		if (!(isCsv ? parseCsvRecord(line, &columns, &record) : parseJsonRecord(line, &record))) {
+			skippedCount++;
+			continue;
+		}
+
+		struct levelSummary *summary = getLevelSummary(&levels, &levelCount, &levelCapacity, record.phase, record.level);
+
+		summary->callCount += record.passIndex == 1;
+		summary->passCount++;
+		summary->maxPassIndex = record.passIndex > summary->maxPassIndex ? record.passIndex : summary->maxPassIndex;
+		summary->changeCount += record.changeCount;
+		summary->seconds += record.seconds;
+
+		if (record.changeCount < changeThreshold) {
+			summary->smallPassCount++;
+			summary->smallSeconds += record.seconds;
+		}
+	}
+
+	fclose(file);
+
+	if (skippedCount > 0) {
+		fprintf(stderr, "skipped %d lines that are not pass records\n", skippedCount);
+	}
+
+	char label[64];
+	printf("level\tcalls\tpasses\tpasses_per_call\tmax_pass\tchanges\tseconds\tpasses_under_%d\tseconds_under_%d\n",
+			changeThreshold, changeThreshold);
+
+	for (int k = 0; k < levelCount; k++) {
+		snprintf(label, sizeof(label), "%d:%d", levels[k].phase, levels[k].level);
+		printLevelSummary(label, &levels[k]);
+	}
+
+	// The totals of every design phase, in the order they ran, then of the whole design.
+	printf("\n");
+	struct levelSummary total = { 0 };
+
+	for (int k = 0; k < levelCount; k++) {
+
+		int isFirst = 1;
+		for (int l = 0; l < k; l++) {
+			isFirst &= levels[l].phase != levels[k].phase;
+		}
+		if (!isFirst) {
+			continue;
+		}
+
+		struct levelSummary phaseTotal = { 0 };
+		for (int l = k; l < levelCount; l++) {
+			if (levels[l].phase == levels[k].phase) {
+				addLevelSummary(&phaseTotal, &levels[l]);
+			}
+		}
+
+		snprintf(label, sizeof(label), "phase %d", levels[k].phase);
+		printLevelSummary(label, &phaseTotal);
+		addLevelSummary(&total, &phaseTotal);
+	}
+
+	printLevelSummary("total", &total);
+
+	free(levels);
+	return 0;
+}
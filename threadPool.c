@@ -0,0 +1,167 @@
+/******************************************************************
+* file: threadPool.c
+* Implementing: A fixed-size pthread pool used to run the independent parts of a DBS pass in parallel
+* Indices are handed out dynamically, so uneven blocks (e.g. a block without any candidate pixel) balance out.
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "threadPool.h"
+
+struct threadPool
+{
+	// The number of threads taking part in a loop, including the caller.
+	int threadCount;
+	pthread_t *workers;
+
+	pthread_mutex_t lock;
+	pthread_cond_t workReady;
+	pthread_cond_t workDone;
+
+	// Incremented for every loop, so that the workers can tell a new loop from a spurious wake up.
+	unsigned long generation;
+	int activeWorkerCount;
+	int isShuttingDown;
+
+	// The loop currently being run.
+	parallelTask task;
+	void *context;
+	int count;
+	atomic_int nextIndex;
+};
+
+// Runs loop indices until none is left.
+static void drainLoop(struct threadPool *pool) {
+
+	for (;;) {
+		int index = atomic_fetch_add(&pool->nextIndex, 1);
+		if (index >= pool->count) {
+			return;
+		}
+
+		pool->task(pool->context, index);
+	}
+}
+
+static void* runWorker(void *argument) {
+
+	struct threadPool *pool = (struct threadPool *) argument;
+	unsigned long seenGeneration = 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	for (;;) {
+
+		while (!pool->isShuttingDown && pool->generation == seenGeneration) {
+			pthread_cond_wait(&pool->workReady, &pool->lock);
+		}
+
+		if (pool->isShuttingDown) {
+			break;
+		}
+
+		seenGeneration = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		drainLoop(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->activeWorkerCount == 0) {
+			pthread_cond_signal(&pool->workDone);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+struct threadPool* createThreadPool(int threadCount) {
+
+	if (threadCount < 1) {
+		threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+
+	struct threadPool *pool = (struct threadPool *) calloc(1, sizeof(struct threadPool));
+	pool->threadCount = threadCount;
+	pool->workers = (pthread_t *) calloc(threadCount, sizeof(pthread_t));
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->workReady, NULL);
+	pthread_cond_init(&pool->workDone, NULL);
+	atomic_init(&pool->nextIndex, 0);
+
+	// The caller is the first thread of the pool, so only start the rest.
+	for (int i = 1; i < threadCount; i++) {
+		if (pthread_create(&pool->workers[i], NULL, runWorker, pool) != 0) {
+			fprintf(stderr, "Cannot start worker thread %d, continuing with %d threads.\n", i, i);
+			pool->threadCount = i;
+			break;
+		}
+	}
+
+	return pool;
+}
+
+int getThreadPoolSize(struct threadPool *pool) {
+	return pool->threadCount;
+}
+
+void runParallelFor(struct threadPool *pool, int count, parallelTask task, void *context) {
+
+	if (count <= 0) {
+		return;
+	}
+
+	// Nothing to share, so do not pay for waking up the workers.
+	if (pool->threadCount == 1 || count == 1) {
+		for (int i = 0; i < count; i++) {
+			task(context, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->task = task;
+	pool->context = context;
+	pool->count = count;
+	atomic_store(&pool->nextIndex, 0);
+	pool->activeWorkerCount = pool->threadCount - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->workReady);
+	pthread_mutex_unlock(&pool->lock);
+
+	drainLoop(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->activeWorkerCount > 0) {
+		pthread_cond_wait(&pool->workDone, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void destroyThreadPool(struct threadPool *pool) {
+
+	pthread_mutex_lock(&pool->lock);
+	pool->isShuttingDown = 1;
+	pthread_cond_broadcast(&pool->workReady);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 1; i < pool->threadCount; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->workReady);
+	pthread_cond_destroy(&pool->workDone);
+
+	free(pool->workers);
+	free(pool);
+}
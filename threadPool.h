@@ -0,0 +1,23 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// A small fixed-size pool of worker threads that runs parallel-for loops. The calling thread takes part in every
+// loop, so a pool of N threads starts N - 1 workers.
+struct threadPool;
+
+// The body of a parallel-for loop. It is called once for every index in [0, count), from any thread of the pool.
+typedef void (*parallelTask)(void *context, int index);
+
+// Creates a pool with the given number of threads. A count < 1 uses the number of online processors.
+struct threadPool* createThreadPool(int threadCount);
+
+// Returns the number of threads (including the caller) that take part in a loop.
+int getThreadPoolSize(struct threadPool *pool);
+
+// Runs task(context, index) for every index in [0, count), and returns once all of them have completed.
+void runParallelFor(struct threadPool *pool, int count, parallelTask task, void *context);
+
+// Stops the workers and releases the pool.
+void destroyThreadPool(struct threadPool *pool);
+
+#endif